@@ -0,0 +1,296 @@
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../libs/json/json.hpp"
+#include "../libs/musoci/metrics.hpp"
+#include "../libs/musoci/postgresql.hpp"
+#include "../libs/musoci/sqlite.hpp"
+
+// Замеры musoci на синтетических таблицах заданной формы.
+// Результаты пишутся в JSON и могут сравниваться с прошлым прогоном (--baseline).
+
+namespace {
+
+const std::string TABLE = "aleto_bench";
+
+struct Shape {
+    int rows = 100000;
+    int columns = 8;
+    int width = 32;
+    bool index = true;
+};
+
+struct Options {
+    Shape shape;
+    int iterations = 200;
+    std::string label = "aleto";
+    std::string sqlitePath = "aleto_bench.db";
+    std::vector<std::string> postgres;
+    std::string out;
+    std::string baseline;
+};
+
+struct Scenario {
+    std::string name;
+    metrics::Histogram latency;
+    uint64_t rows = 0;
+    double seconds = 0;
+};
+
+void usage() {
+    std::cerr << "usage: aleto_bench [--rows N] [--columns N] [--width N] [--no-index] [--iterations N] [--label NAME]\n"
+                 "                   [--sqlite PATH] [--pg HOST PORT USER PASSWORD DATABASE] [--out FILE] [--baseline FILE]\n";
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--rows")
+            options.shape.rows = std::stoi(next());
+        else if (arg == "--columns")
+            options.shape.columns = std::max(2, std::stoi(next()));
+        else if (arg == "--width")
+            options.shape.width = std::stoi(next());
+        else if (arg == "--no-index")
+            options.shape.index = false;
+        else if (arg == "--iterations")
+            options.iterations = std::stoi(next());
+        else if (arg == "--label")
+            options.label = next();
+        else if (arg == "--sqlite")
+            options.sqlitePath = next();
+        else if (arg == "--pg") {
+            for (int k = 0; k < 5; ++k) {
+                options.postgres.push_back(next());
+            }
+        } else if (arg == "--out")
+            options.out = next();
+        else if (arg == "--baseline")
+            options.baseline = next();
+        else
+            return false;
+    }
+    return true;
+}
+
+std::string randomText(std::mt19937& rng, int width) {
+    std::uniform_int_distribution<int> letter('a', 'z');
+    std::string text(width, ' ');
+    for (auto& c : text) {
+        c = static_cast<char>(letter(rng));
+    }
+    return text;
+}
+
+// Многострочный INSERT: строки с id из [first, first + count)
+std::string insertSql(std::mt19937& rng, const Shape& shape, int first, int count) {
+    std::ostringstream sql;
+    sql << "INSERT INTO " << TABLE << " VALUES ";
+    for (int id = first; id < first + count; ++id) {
+        sql << (id == first ? "(" : ", (") << id;
+        for (int c = 1; c < shape.columns; ++c) {
+            sql << ", '" << randomText(rng, shape.width) << "'";
+        }
+        sql << ")";
+    }
+    sql << ";";
+    return sql.str();
+}
+
+void populate(base::Database& db, const Shape& shape) {
+    db.dropTable(TABLE);
+
+    types::TableSchema schema{TABLE, {types::Column("id", false, true, "INTEGER")}};
+    for (int c = 1; c < shape.columns; ++c) {
+        schema.columns.emplace_back("c" + std::to_string(c), true, false, "TEXT");
+    }
+    db.createTable(schema);
+
+    std::mt19937 rng(42);
+    const int batch = 500;
+    for (int first = 1; first <= shape.rows; first += batch) {
+        db.executeQuery(insertSql(rng, shape, first, std::min(batch, shape.rows - first + 1)));
+    }
+    if (shape.index)
+        db.executeQuery("CREATE INDEX " + TABLE + "_c1 ON " + TABLE + " (c1);");
+}
+
+// Вызов call возвращает число обработанных строк
+Scenario run(const std::string& name, int iterations, const std::function<uint64_t(int)>& call) {
+    Scenario scenario;
+    scenario.name = name;
+    for (int i = 0; i < iterations; ++i) {
+        auto started = std::chrono::steady_clock::now();
+        uint64_t rows = call(i);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - started;
+        scenario.latency.record(static_cast<uint64_t>(elapsed.count() * 1e6));
+        scenario.rows += rows;
+        scenario.seconds += elapsed.count();
+    }
+    return scenario;
+}
+
+std::vector<Scenario> runSuite(base::Database& db, const Options& options) {
+    const Shape& shape = options.shape;
+    const int n = options.iterations;
+    const int page = 1000;
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> anyRow(1, shape.rows);
+    int nextId = shape.rows + 1;
+
+    std::vector<Scenario> scenarios;
+    scenarios.push_back(run("listTables", n, [&](int) { return db.listTables().size(); }));
+    scenarios.push_back(run("getTables", std::max(5, n / 10), [&](int) { return db.getTables().size(); }));
+    scenarios.push_back(run("select.shallow", n, [&](int) { return db.select(TABLE, 0, page, {}).data.size(); }));
+    scenarios.push_back(run("select.deep", n, [&](int) { return db.select(TABLE, shape.rows * 9 / 10, page, {}).data.size(); }));
+    scenarios.push_back(run("select.projected", n, [&](int) { return db.select(TABLE, 0, page, {"id", "c1"}).data.size(); }));
+    scenarios.push_back(run("seek.deep", n, [&](int) {
+        return db.seek(TABLE, "id", std::to_string(shape.rows * 9 / 10), true, 0, page, {}, false).data.size();
+    }));
+    scenarios.push_back(run("search", n, [&](int) { return db.search(TABLE, "c1", "abc", 100).data.size(); }));
+    scenarios.push_back(run("editRow", n, [&](int) {
+        db.editRow(TABLE, {"id", std::to_string(anyRow(rng))}, {{"c1", randomText(rng, shape.width)}});
+        return 1;
+    }));
+    scenarios.push_back(run("addRow", n, [&](int) {
+        std::vector<std::pair<std::string, std::string>> values{{"id", std::to_string(nextId++)}};
+        for (int c = 1; c < shape.columns; ++c) {
+            values.emplace_back("c" + std::to_string(c), randomText(rng, shape.width));
+        }
+        db.addRow(TABLE, values);
+        return 1;
+    }));
+    scenarios.push_back(run("bulk.insertValues", std::max(5, n / 10), [&](int) {
+        db.executeQuery(insertSql(rng, shape, nextId, page));
+        nextId += page;
+        return page;
+    }));
+    return scenarios;
+}
+
+// Прогоны сравниваются по виду базы и форме данных: адрес подключения меняется между машинами и не должен разрывать сравнение
+nlohmann::json toJson(const std::string& backend, const std::string& connection, const Shape& shape, const std::vector<Scenario>& scenarios) {
+    nlohmann::json run;
+    run["backend"] = backend;
+    run["connection"] = connection;
+    run["shape"] = {{"rows", shape.rows}, {"columns", shape.columns}, {"width", shape.width}, {"index", shape.index}};
+    for (const auto& s : scenarios) {
+        run["scenarios"][s.name] = {
+            {"calls", s.latency.count()},
+            {"rows", s.rows},
+            {"seconds", s.seconds},
+            {"ops_per_s", s.seconds > 0 ? s.latency.count() / s.seconds : 0},
+            {"rows_per_s", s.seconds > 0 ? s.rows / s.seconds : 0},
+            {"p50_us", s.latency.percentile(50)},
+            {"p99_us", s.latency.percentile(99)},
+            {"max_us", s.latency.max()},
+        };
+    }
+    return run;
+}
+
+std::string runKey(const nlohmann::json& run) {
+    const auto& shape = run["shape"];
+    return run["backend"].get<std::string>() + " " + std::to_string(shape["rows"].get<int>()) + "x" + std::to_string(shape["columns"].get<int>()) +
+           "x" + std::to_string(shape["width"].get<int>()) + (shape["index"].get<bool>() ? "" : " no-index");
+}
+
+// Изменение p50 и пропускной способности относительно прошлого прогона, в процентах
+nlohmann::json compare(const nlohmann::json& current, const nlohmann::json& baseline) {
+    nlohmann::json diff = nlohmann::json::object();
+    for (const auto& run : current["runs"]) {
+        for (const auto& old : baseline["runs"]) {
+            if (runKey(old) != runKey(run))
+                continue;
+            for (const auto& [name, now] : run["scenarios"].items()) {
+                if (!old["scenarios"].contains(name))
+                    continue;
+                const auto& was = old["scenarios"][name];
+                auto change = [](double before, double after) { return before > 0 ? (after - before) / before * 100.0 : 0.0; };
+                diff[runKey(run)][name] = {
+                    {"p50_change_pct", change(was["p50_us"].get<double>(), now["p50_us"].get<double>())},
+                    {"ops_per_s_change_pct", change(was["ops_per_s"].get<double>(), now["ops_per_s"].get<double>())},
+                };
+            }
+        }
+    }
+    return diff;
+}
+
+void printSummary(const nlohmann::json& result) {
+    for (const auto& run : result["runs"]) {
+        std::cerr << runKey(run) << " (" << run["connection"].get<std::string>() << ")\n";
+        for (const auto& [name, s] : run["scenarios"].items()) {
+            std::fprintf(stderr, "  %-18s %10.1f ops/s %12.1f rows/s  p50 %8llu us  p99 %8llu us\n", name.c_str(), s["ops_per_s"].get<double>(),
+                         s["rows_per_s"].get<double>(), s["p50_us"].get<unsigned long long>(), s["p99_us"].get<unsigned long long>());
+        }
+    }
+    if (result.contains("baseline_diff")) {
+        for (const auto& [backend, scenarios] : result["baseline_diff"].items()) {
+            std::cerr << backend << " vs baseline\n";
+            for (const auto& [name, d] : scenarios.items()) {
+                std::fprintf(stderr, "  %-18s p50 %+7.1f%%  ops/s %+7.1f%%\n", name.c_str(), d["p50_change_pct"].get<double>(),
+                             d["ops_per_s_change_pct"].get<double>());
+            }
+        }
+    }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            usage();
+            return 2;
+        }
+
+        nlohmann::json result;
+        result["label"] = options.label;
+        result["runs"] = nlohmann::json::array();
+
+        {
+            sqlite::SQLiteDB db(options.sqlitePath);
+            populate(db, options.shape);
+            result["runs"].push_back(toJson("sqlite", db.connectionId(), options.shape, runSuite(db, options)));
+        }
+
+        if (!options.postgres.empty()) {
+            const auto& pg = options.postgres;
+            postgresql::PostgreSqlDB db(pg[0], std::stoi(pg[1]), pg[2], pg[3], pg[4]);
+            populate(db, options.shape);
+            result["runs"].push_back(toJson("postgresql", db.connectionId(), options.shape, runSuite(db, options)));
+            db.dropTable(TABLE);
+        }
+
+        if (!options.baseline.empty()) {
+            std::ifstream in(options.baseline);
+            result["baseline_diff"] = compare(result, nlohmann::json::parse(in));
+        }
+
+        printSummary(result);
+        if (options.out.empty()) {
+            std::cout << result.dump(2) << std::endl;
+        } else {
+            std::ofstream out(options.out);
+            out << result.dump(2) << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "aleto_bench: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
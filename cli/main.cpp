@@ -0,0 +1,445 @@
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../libs/musoci/bulk.hpp"
+#include "../libs/musoci/diff.hpp"
+#include "../libs/musoci/dump.hpp"
+#include "../libs/musoci/importer.hpp"
+#include "../libs/musoci/incremental.hpp"
+#include "../libs/musoci/metrics.hpp"
+#include "../libs/musoci/paging.hpp"
+#include "../libs/musoci/postgresql.hpp"
+#include "../libs/musoci/sqlite.hpp"
+#include "../libs/musoci/trace.hpp"
+#include "../libs/musoci/transfer.hpp"
+#include "../libs/musoci/writer.hpp"
+
+// Консольный клиент: те же пути musoci, что и в интерфейсе, без wxWidgets
+
+namespace {
+
+// Ctrl+C прерывает потоковые выгрузки и COPY
+std::atomic<bool> interrupted{false};
+
+struct Options {
+    std::string sqlitePath;
+    std::vector<std::string> postgres;
+    // Приёмник copy-table, вторая сторона diff
+    std::string toSqlite;
+    std::vector<std::string> toPostgres;
+    std::string format = "csv";
+    std::string output;
+    int pageSize = 1000;
+    int limit = 1000;
+    std::vector<std::string> columns;
+    std::string metrics;
+    std::string trace;
+    bool binary = false;
+    bool progress = false;
+    importer::Options import;
+    bulk::Options bulk;
+    transfer::Options transfer;
+    dump::Options dump;
+    diff::Options diff;
+    std::string watermark = "key";
+    std::string state = ".aleto-sync.json";
+    std::vector<std::string> command;
+};
+
+void usage() {
+    std::cerr << "usage: aleto-cli (--sqlite PATH | --pg HOST PORT USER PASSWORD DATABASE) [options] COMMAND\n"
+                 "commands:\n"
+                 "  tables                         list tables\n"
+                 "  describe TABLE                 list columns of a table\n"
+                 "  page TABLE N                   print page N (from 1)\n"
+                 "  search TABLE COLUMN PATTERN    rows where COLUMN contains PATTERN\n"
+                 "  sql QUERY                      run a query and print its result\n"
+                 "  export TABLE                   stream the whole table through a cursor\n"
+                 "  export-query QUERY             stream the result of a query through a cursor\n"
+                 "  import TABLE FILE              load CSV into TABLE (created when missing)\n"
+                 "  delete TABLE WHERE             delete rows matching WHERE in chunks\n"
+                 "  update TABLE COL=VALUE WHERE   set COL in rows matching WHERE in chunks (VALUE \\N - NULL)\n"
+                 "  copy-table TABLE [TARGET]      copy TABLE to --to-sqlite or --to-pg (created when missing)\n"
+                 "  diff TABLE [TARGET]            compare TABLE with --to-sqlite or --to-pg by hashed key ranges\n"
+                 "  sync TABLE                     stream rows changed since the previous sync of TABLE\n"
+                 "  dump DIR                       dump all tables from one snapshot in parallel into DIR\n"
+                 "  copy-out TABLE                 PostgreSQL COPY TO STDOUT (CSV with header or binary)\n"
+                 "  copy-in TABLE FILE             PostgreSQL COPY FROM STDIN, FILE - reads stdin\n"
+                 "options:\n"
+                 "  --format csv|jsonl|json|sql    CSV, one JSON object per line, a JSON array or INSERT statements\n"
+                 "  --out FILE                     write to FILE instead of stdout\n"
+                 "  --size N                       rows per page (page)\n"
+                 "  --limit N                      row limit (search)\n"
+                 "  --columns a,b,c                columns to fetch (page, export) or compare (diff)\n"
+                 "  --threads N                    CSV parser threads (import), connections (dump)\n"
+                 "  --split N                      rows per key range of large tables (dump)\n"
+                 "  --resume                       continue an interrupted dump in DIR\n"
+                 "  --delimiter C                  CSV field delimiter (import)\n"
+                 "  --no-header                    first CSV line is data (import)\n"
+                 "  --types a:BIGINT,b:TEXT        column types instead of inferred ones (import)\n"
+                 "  --chunk N                      rows per transaction (delete, update), per hashed range (diff)\n"
+                 "  --pause MS                     pause between transactions (delete, update)\n"
+                 "  --watermark key|xmin|column:C  how sync finds changed rows (default key)\n"
+                 "  --state FILE                   sync watermarks file (default .aleto-sync.json)\n"
+                 "  --to-sqlite PATH               target SQLite database (copy-table, diff)\n"
+                 "  --to-pg HOST PORT USER PASS DB target PostgreSQL database (copy-table, diff)\n"
+                 "  --replace                      drop the target table first (copy-table)\n"
+                 "  --binary                       binary COPY format (copy-out, copy-in)\n"
+                 "  --progress                     print transferred bytes to stderr (import, copy-out, copy-in)\n"
+                 "  --metrics FILE                 save call latencies as JSON\n"
+                 "  --trace FILE                   save Chrome trace (ALETO_TRACING builds)\n";
+}
+
+std::vector<std::string> split(const std::string& list, char separator) {
+    std::vector<std::string> parts;
+    std::stringstream ss(list);
+    std::string part;
+    while (std::getline(ss, part, separator)) {
+        if (!part.empty())
+            parts.push_back(part);
+    }
+    return parts;
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc)
+                throw std::runtime_error("Missing value for " + arg);
+            return argv[++i];
+        };
+        if (arg == "--sqlite")
+            options.sqlitePath = next();
+        else if (arg == "--pg") {
+            for (int k = 0; k < 5; ++k) {
+                options.postgres.push_back(next());
+            }
+        } else if (arg == "--to-sqlite")
+            options.toSqlite = next();
+        else if (arg == "--to-pg") {
+            for (int k = 0; k < 5; ++k) {
+                options.toPostgres.push_back(next());
+            }
+        } else if (arg == "--watermark")
+            options.watermark = next();
+        else if (arg == "--state")
+            options.state = next();
+        else if (arg == "--replace")
+            options.transfer.replace = true;
+        else if (arg == "--format")
+            options.format = next();
+        else if (arg == "--out")
+            options.output = next();
+        else if (arg == "--size")
+            options.pageSize = std::stoi(next());
+        else if (arg == "--limit")
+            options.limit = std::stoi(next());
+        else if (arg == "--columns")
+            options.columns = options.diff.columns = split(next(), ',');
+        else if (arg == "--chunk") {
+            options.bulk.chunkRows = std::stoul(next());
+            options.diff.chunkRows = static_cast<int>(options.bulk.chunkRows);
+        } else if (arg == "--pause")
+            options.bulk.pause = std::chrono::milliseconds(std::stoi(next()));
+        else if (arg == "--metrics")
+            options.metrics = next();
+        else if (arg == "--trace")
+            options.trace = next();
+        else if (arg == "--threads")
+            options.import.threads = options.dump.threads = static_cast<unsigned>(std::stoul(next()));
+        else if (arg == "--split")
+            options.dump.splitRows = std::stoi(next());
+        else if (arg == "--resume")
+            options.dump.resume = true;
+        else if (arg == "--delimiter")
+            options.import.delimiter = next().at(0);
+        else if (arg == "--no-header")
+            options.import.header = false;
+        else if (arg == "--types") {
+            for (const auto& pair : split(next(), ',')) {
+                size_t colon = pair.find(':');
+                if (colon == std::string::npos)
+                    return false;
+                options.import.types[pair.substr(0, colon)] = pair.substr(colon + 1);
+            }
+        } else if (arg == "--binary")
+            options.binary = true;
+        else if (arg == "--progress")
+            options.progress = true;
+        else if (arg.rfind("--", 0) == 0)
+            return false;
+        else
+            options.command.push_back(arg);
+    }
+    bool connection = options.sqlitePath.empty() != options.postgres.empty();
+    return connection && !options.command.empty() && (options.format == "csv" || options.format == "jsonl" || options.format == "json" || options.format == "sql");
+}
+
+std::unique_ptr<base::Database> connect(const std::string& sqlitePath, const std::vector<std::string>& pg) {
+    if (!sqlitePath.empty())
+        return std::make_unique<sqlite::SQLiteDB>(sqlitePath);
+    return std::make_unique<postgresql::PostgreSqlDB>(pg[0], std::stoi(pg[1]), pg[2], pg[3], pg[4]);
+}
+
+// Уже прочитанный результат через тот же writer
+void print(writer::Writer& out, const std::vector<std::string>& names, const std::vector<std::vector<std::string>>& rows) {
+    types::TableData data;
+    for (const auto& name : names) {
+        data.columns.emplace_back(name, true, false, "");
+    }
+    data.data = rows;
+    out.write(data);
+}
+
+void run(base::Database& db, writer::Writer& out, const Options& options) {
+    const auto& cmd = options.command;
+    auto need = [&cmd](size_t count) {
+        if (cmd.size() != count)
+            throw std::runtime_error("Wrong number of arguments for " + cmd[0]);
+    };
+
+    if (cmd[0] == "tables") {
+        need(1);
+        std::vector<std::vector<std::string>> rows;
+        for (const auto& table : db.getTables()) {
+            rows.push_back({table.title, std::to_string(table.columns.size())});
+        }
+        print(out, {"table", "columns"}, rows);
+    } else if (cmd[0] == "describe") {
+        need(2);
+        std::vector<std::vector<std::string>> rows;
+        for (const auto& column : db.describe(cmd[1]).columns) {
+            rows.push_back({column.name, column.type, column.nullable ? "1" : "0", column.primary_key ? "1" : "0"});
+        }
+        print(out, {"name", "type", "nullable", "primary_key"}, rows);
+    } else if (cmd[0] == "page") {
+        need(3);
+        int page = std::max(1, std::stoi(cmd[2]));
+        out.write(paging::fetchPage(db, nullptr, db.describe(cmd[1]), (page - 1) * options.pageSize, options.pageSize, options.columns));
+    } else if (cmd[0] == "search") {
+        need(4);
+        out.write(db.search(cmd[1], cmd[2], cmd[3], options.limit));
+    } else if (cmd[0] == "sql") {
+        need(2);
+        out.write(db.query(cmd[1]));
+    } else if (cmd[0] == "export") {
+        need(2);
+        out.setTable(cmd[1], base::isPostgres(db));
+        db.streamTable(cmd[1], options.columns, out, interrupted);
+    } else if (cmd[0] == "export-query") {
+        need(2);
+        db.stream(cmd[1], out, interrupted);
+    } else if (cmd[0] == "import") {
+        need(3);
+        importer::Progress progress = [&options](size_t done, size_t total) {
+            if (options.progress)
+                std::cerr << "\r" << (done >> 20) << " / " << (total >> 20) << " MiB" << std::flush;
+        };
+        importer::Report report = importer::importCsv(db, cmd[2], cmd[1], options.import, progress, interrupted);
+        std::cerr << (options.progress ? "\n" : "") << report.rows << " rows in " << report.seconds << " s ("
+                  << static_cast<size_t>(report.rowsPerSecond()) << " rows/s), bad lines: " << report.badLines << std::endl;
+        for (const auto& diagnostic : report.diagnostics) {
+            std::cerr << "line " << diagnostic.line << ": " << diagnostic.message << std::endl;
+        }
+    } else if (cmd[0] == "delete" || cmd[0] == "update") {
+        bool remove = cmd[0] == "delete";
+        need(remove ? 3 : 4);
+        std::string key = db.describe(cmd[1]).rowKey;
+        if (key.empty())
+            throw std::runtime_error("Table " + cmd[1] + " has no key column");
+        bulk::Progress progress = [&options](size_t done, size_t) {
+            if (options.progress)
+                std::cerr << "\r" << done << " rows" << std::flush;
+        };
+        size_t changed = 0;
+        if (remove) {
+            changed = bulk::removeWhere(db, cmd[1], key, cmd[2], options.bulk, progress, interrupted);
+        } else {
+            size_t equals = cmd[2].find('=');
+            if (equals == std::string::npos)
+                throw std::runtime_error("Expected COLUMN=VALUE: " + cmd[2]);
+            std::string value = cmd[2].substr(equals + 1);
+            changed = bulk::updateWhere(db, cmd[1], key, cmd[3], {{cmd[2].substr(0, equals), value}}, {value == "\\N"}, options.bulk, progress,
+                                        interrupted);
+        }
+        std::cerr << (options.progress ? "\n" : "") << changed << " rows changed" << std::endl;
+    } else if (cmd[0] == "sync") {
+        need(2);
+        incremental::Options syncOptions = incremental::parseWatermark(options.watermark);
+        incremental::State state(options.state);
+        std::string id = incremental::State::id(db, cmd[1], syncOptions);
+        out.setTable(cmd[1], base::isPostgres(db));
+        incremental::Report report = incremental::exportChanges(db, cmd[1], syncOptions, state.get(id), out, interrupted);
+        if (interrupted)
+            throw std::runtime_error("Interrupted, watermark not saved");
+        // Отметка сохраняется только после того, как вывод дописан
+        out.finish();
+        state.set(id, report.next);
+        state.save();
+        std::cerr << report.rows << " rows since " << (report.since.empty() ? "the beginning" : report.since) << ", next watermark "
+                  << report.next << std::endl;
+    } else if (cmd[0] == "dump") {
+        need(2);
+        dump::Options dumpOptions = options.dump;
+        dumpOptions.format = writer::parseFormat(options.format);
+        dump::Progress progress = [&options](size_t done, size_t total) {
+            if (options.progress)
+                std::cerr << "\r" << done << " / " << total << " parts" << std::flush;
+        };
+        dump::Report report = dump::dumpDatabase(db, cmd[1], dumpOptions, progress, interrupted);
+        std::cerr << (options.progress ? "\n" : "") << report.tables << " tables, " << report.parts << " parts (" << report.skipped
+                  << " from the previous run), " << report.rows << " rows in " << report.seconds << " s" << (report.interrupted ? ", interrupted" : "")
+                  << std::endl;
+    } else if (cmd[0] == "diff") {
+        if (cmd.size() != 2 && cmd.size() != 3)
+            throw std::runtime_error("Wrong number of arguments for " + cmd[0]);
+        if (options.toSqlite.empty() == options.toPostgres.empty())
+            throw std::runtime_error(cmd[0] + " requires --to-sqlite or --to-pg");
+        auto target = connect(options.toSqlite, options.toPostgres);
+        std::string targetTable = cmd.size() == 3 ? cmd[2] : transfer::targetName(cmd[1], base::isPostgres(db), options.toSqlite.empty());
+        // Строки с отличиями: - только в TABLE, + только в TARGET, < и > - обе версии изменённой строки
+        std::vector<types::Column> columns{types::Column("change", false, false, "TEXT")};
+        for (const auto& name : diff::comparedColumns(db.describe(cmd[1]), options.diff)) {
+            columns.emplace_back(name, true, false, "");
+        }
+        out.begin(columns);
+        auto emit = [&out](const char* change, const diff::Row& row) {
+            std::vector<std::string_view> values{change};
+            values.insert(values.end(), row.values.begin(), row.values.end());
+            std::vector<bool> nulls{false};
+            nulls.insert(nulls.end(), row.nulls.begin(), row.nulls.end());
+            out.row(values, nulls);
+        };
+        diff::Visitor visit = [&emit](diff::Change change, const diff::Row& left, const diff::Row& right) {
+            if (change != diff::Change::Extra)
+                emit(change == diff::Change::Missing ? "-" : "<", left);
+            if (change != diff::Change::Missing)
+                emit(change == diff::Change::Extra ? "+" : ">", right);
+        };
+        diff::Progress progress = [&options](size_t done, size_t total) {
+            if (options.progress)
+                std::cerr << "\r" << done << " / " << total << " ranges" << std::flush;
+        };
+        diff::Report report = diff::compareTables(db, *target, cmd[1], targetTable, options.diff, visit, progress, interrupted);
+        std::cerr << (options.progress ? "\n" : "") << report.missing << " missing, " << report.extra << " extra, " << report.changed
+                  << " changed; " << report.hashes << " range hashes, " << report.fetched << " rows fetched in " << report.seconds << " s"
+                  << std::endl;
+        if (report.interrupted)
+            throw std::runtime_error("Interrupted, the diff is incomplete");
+    } else if (cmd[0] == "copy-table") {
+        if (cmd.size() != 2 && cmd.size() != 3)
+            throw std::runtime_error("Wrong number of arguments for " + cmd[0]);
+        if (options.toSqlite.empty() == options.toPostgres.empty())
+            throw std::runtime_error(cmd[0] + " requires --to-sqlite or --to-pg");
+        auto target = connect(options.toSqlite, options.toPostgres);
+        transfer::Progress progress = [&options](size_t rows) {
+            if (options.progress)
+                std::cerr << "\r" << rows << " rows" << std::flush;
+        };
+        std::string targetTable = cmd.size() == 3 ? cmd[2] : transfer::targetName(cmd[1], base::isPostgres(db), options.toSqlite.empty());
+        transfer::Report report = transfer::copyTable(db, *target, cmd[1], targetTable, options.transfer, progress, interrupted);
+        std::cerr << (options.progress ? "\n" : "") << report.rows << " rows in " << report.seconds << " s ("
+                  << static_cast<size_t>(report.rowsPerSecond()) << " rows/s)" << std::endl;
+    } else {
+        throw std::runtime_error("Unknown command: " + cmd[0]);
+    }
+}
+
+// COPY минует MeteredDatabase, поэтому учитывается в реестре отдельно
+std::string runCopy(const Options& options, metrics::Registry& registry) {
+    const auto& cmd = options.command;
+    if (options.postgres.empty())
+        throw std::runtime_error(cmd[0] + " requires --pg");
+    bool out = cmd[0] == "copy-out";
+    if (cmd.size() != (out ? 2 : 3))
+        throw std::runtime_error("Wrong number of arguments for " + cmd[0]);
+
+    const auto& pg = options.postgres;
+    postgresql::PostgreSqlDB db(pg[0], std::stoi(pg[1]), pg[2], pg[3], pg[4]);
+    auto format = options.binary ? postgresql::CopyFormat::Binary : postgresql::CopyFormat::Csv;
+
+    size_t transferred = 0;
+    postgresql::CopyProgress progress = [&options, &transferred](size_t bytes) {
+        transferred = bytes;
+        if (options.progress)
+            std::cerr << "\r" << (bytes >> 20) << " MiB" << std::flush;
+    };
+
+    std::string path = out ? options.output : (cmd[2] == "-" ? "" : cmd[2]);
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(nullptr, &std::fclose);
+    if (!path.empty()) {
+        file.reset(std::fopen(path.c_str(), out ? "wb" : "rb"));
+        if (!file)
+            throw std::runtime_error("Failed to open " + path);
+    }
+    std::FILE* stream = file ? file.get() : (out ? stdout : stdin);
+
+    auto started = std::chrono::steady_clock::now();
+    auto elapsed = [&started] {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+    };
+    size_t rows = 0;
+    try {
+        rows = out ? db.copyOut(cmd[1], options.columns, format, stream, progress, interrupted)
+                   : db.copyIn(cmd[1], options.columns, format, stream, progress, interrupted);
+    } catch (...) {
+        registry.record(cmd[0], elapsed(), 0, transferred, true);
+        throw;
+    }
+    std::fflush(stream);
+    registry.record(cmd[0], elapsed(), rows, transferred, false);
+    if (options.progress)
+        std::cerr << "\r" << rows << " rows, " << (transferred >> 20) << " MiB" << std::endl;
+    return db.connectionId();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    auto registry = std::make_shared<metrics::Registry>();
+    try {
+        if (!parseOptions(argc, argv, options)) {
+            usage();
+            return 2;
+        }
+
+        std::signal(SIGINT, [](int) { interrupted = true; });
+
+        std::string label;
+        if (options.command[0] == "copy-out" || options.command[0] == "copy-in") {
+            label = runCopy(options, *registry);
+        } else {
+            metrics::MeteredDatabase db(connect(options.sqlitePath, options.postgres), registry);
+            std::unique_ptr<std::FILE, int (*)(std::FILE*)> file(nullptr, &std::fclose);
+            if (!options.output.empty()) {
+                file.reset(std::fopen(options.output.c_str(), "wb"));
+                if (!file)
+                    throw std::runtime_error("Failed to open " + options.output);
+            }
+            writer::Writer out(file ? file.get() : stdout, writer::parseFormat(options.format));
+            run(db, out, options);
+            out.finish();
+            label = db.connectionId();
+        }
+
+        if (!options.metrics.empty()) {
+            std::ofstream out(options.metrics);
+            out << registry->toJson(label) << std::endl;
+        }
+        if (!options.trace.empty())
+            trace::dump(options.trace);
+    } catch (const std::exception& e) {
+        std::cerr << "aleto-cli: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
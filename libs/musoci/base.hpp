@@ -1,24 +1,211 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <string_view>
+
 #include "types.hpp"
 
 namespace base {
 
+// Получатель строк при потоковом чтении; values действительны только во время вызова row
+class RowSink {
+ public:
+    virtual ~RowSink() = default;
+
+    virtual void begin(const std::vector<types::Column>& columns) = 0;
+    virtual void row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) = 0;
+};
+
+// Параметры пакетной загрузки
+struct LoadOptions {
+    // Значения BLOB приходят в шестнадцатеричной записи \x... (выгрузка другой базы) и декодируются, иначе пишутся как есть
+    bool hexBlobs = false;
+};
+
+// Загрузка строк в таблицу одним писателем. Без finish загруженное откатывается
+class BulkLoader : public RowSink {
+ public:
+    void begin(const std::vector<types::Column>&) override {}
+    // Фиксирует загрузку, возвращает число записанных строк
+    virtual size_t finish() = 0;
+};
+
+// Уведомления об изменении таблиц на собственном подключении
+class ChangeFeed {
+ public:
+    virtual ~ChangeFeed() = default;
+
+    // Ждёт не дольше timeout, возвращает изменившиеся таблицы (пусто - изменений не было)
+    virtual std::vector<std::string> wait(std::chrono::milliseconds timeout) = 0;
+};
+
 class Database {
  public:
     virtual ~Database() = default;
     Database() = default;
 
+    // Новое подключение с теми же параметрами (для фоновых задач)
+    virtual std::unique_ptr<Database> clone() const = 0;
+    virtual std::string connectionId() const = 0;
+    // Признак версии данных: меняется после любой фиксации в базе, включая изменения схемы (лишние изменения допустимы,
+    // пропущенные - нет). Значения сравнимы только в пределах одного подключения
+    virtual std::string dataVersion() = 0;
+    // Версии таблиц, сравнимые между подключениями и запусками: по ним проверяются сохранённые на диске страницы.
+    // Пустая версия - изменения данных не отслеживаются (представления). Пустой результат - версии не поддерживаются
+    virtual std::map<std::string, std::string> tableVersions() = 0;
+    // Версия списка таблиц и их схем, сравнимая между подключениями и запусками (пусто - не поддерживается)
+    virtual std::string catalogVersion() = 0;
+
     virtual bool executeQuery(const std::string& sql) = 0;
+    // Произвольный запрос с результатом
+    virtual types::TableData query(const std::string& sql) = 0;
+    // Построчная передача результата курсором без накопления в памяти, возвращает число строк
+    virtual size_t stream(const std::string& sql, RowSink& sink, const std::atomic<bool>& stop) = 0;
+    virtual size_t streamTable(const std::string& table, const std::vector<std::string>& columns, RowSink& sink,
+                               const std::atomic<bool>& stop) = 0;
+    // Строки с from <= key < to в порядке key (пустая граница - без ограничения)
+    virtual size_t streamRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key, const std::string& from,
+                               const std::string& to, RowSink& sink, const std::atomic<bool>& stop) = 0;
+    // Число и хеш строк с from <= key < to (пустая граница - без ограничения) по колонкам columns. Значения приводятся
+    // к тексту одинаково в SQLite и PostgreSQL (логические - 1/0, двоичные - \x...), поэтому сводки разных баз сравнимы
+    virtual types::RangeHash hashRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key,
+                                       const std::string& from, const std::string& to) = 0;
+    // Общий снимок для согласованного чтения несколькими подключениями. exportSnapshot держит снимок на этом подключении
+    // до releaseSnapshot (другие запросы на нём в это время недоступны), после useSnapshot(id) потоковое чтение
+    // другого подключения видит данные снимка
+    virtual std::string exportSnapshot() = 0;
+    virtual void useSnapshot(const std::string& id) = 0;
+    virtual void releaseSnapshot() = 0;
+    // Наблюдение за таблицами. installTriggers - создать в базе триггеры, сообщающие об изменениях (PostgreSQL)
+    virtual std::unique_ptr<ChangeFeed> watch(const std::vector<std::string>& tables, bool installTriggers) = 0;
+    // Только названия таблиц, без колонок: быстро и для десятков тысяч таблиц. Колонки - через describe
+    virtual std::vector<std::string> listTables() = 0;
     virtual std::vector<types::TableSchema> getTables() = 0;
-    virtual types::TableData select(const std::string& table, int offset, int limit) = 0;
+    virtual types::TableSchema describe(const std::string& table) = 0;
+    // columns - список выбираемых колонок, пустой список означает все колонки
+    virtual types::TableData select(const std::string& table, int offset, int limit, const std::vector<std::string>& columns) = 0;
+    // Строки в порядке key начиная с from (пустой from - с начала таблицы).
+    // hashes - тем же запросом посчитать хеши строк (как в seekHashes) в TableData::hashes
+    virtual types::TableData seek(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                  int limit, const std::vector<std::string>& columns, bool hashes) = 0;
+    // Ключ и хеш содержимого каждой строки того же диапазона, что и seek. Хеш считается сервером по всей строке,
+    // поэтому для сравнения страниц передаются только ключи и хеши
+    virtual types::TableData seekHashes(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                        int limit) = 0;
+    // Строки с перечисленными ключами, порядок не гарантирован
+    virtual types::TableData selectKeys(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                        const std::vector<std::string>& columns) = 0;
+    // Ключ каждой step-й строки в порядке key
+    virtual std::vector<std::string> pageAnchors(const std::string& table, const std::string& key, int step, const std::atomic<bool>& stop) = 0;
     virtual bool editRow(const std::string& table, const std::pair<std::string, std::string>& where,
                          const std::vector<std::pair<std::string, std::string>>& values) = 0;
     virtual bool addRow(const std::string& table, const std::vector<std::pair<std::string, std::string>>& values) = 0;
+    // Вставка пакета в одной транзакции. continueOnError - строки с ошибками пропускаются и попадают в errors,
+    // иначе первая ошибка отменяет весь пакет (inserted = 0)
+    virtual types::BatchResult addRows(const std::string& table, const types::ColumnBatch& batch, bool continueOnError) = 0;
+    // Пакетная вставка: SQLite - одна транзакция с одним подготовленным запросом, PostgreSQL - COPY
+    virtual std::unique_ptr<BulkLoader> bulkLoad(const std::string& table, const std::vector<std::string>& columns, const LoadOptions& options) = 0;
     virtual bool removeRow(const std::string& table, const std::pair<std::string, std::string>& where) = 0;
+    // Изменение строк по списку ключей в одной транзакции, возвращают число затронутых строк.
+    // nulls[i] - колонка values[i] получает NULL вместо значения; пуст, если NULL нет
+    virtual size_t removeRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys) = 0;
+    virtual size_t updateRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                              const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls) = 0;
+    // Ключи строк, подходящих под условие where (SQL, пустое - все строки), по порядку key после from
+    virtual std::vector<std::string> filterKeys(const std::string& table, const std::string& key, const std::string& where, const std::string& from,
+                                                int limit) = 0;
     virtual types::TableData search(const std::string& table, const std::string& column, const std::string& pattern, int limit) = 0;
     virtual bool createTable(const types::TableSchema& schema) = 0;
     virtual bool dropTable(const std::string& tableName) = 0;
+
+    // Часть значения с позиции offset в единицах источника: символы для текста PostgreSQL, байты для bytea и значений SQLite.
+    // offset сдвигается на прочитанную часть, поэтому его нельзя считать по длине результата: bytea приходит в hex-виде
+    // (с \x в первой части), а символы текста занимают несколько байт UTF-8. Пустая строка - конец значения.
+    // column - описание колонки из describe, чтобы не перечитывать его для каждой части
+    virtual std::string readValue(const std::string& table, const std::pair<std::string, std::string>& where, const types::Column& column,
+                                  size_t& offset, size_t length) = 0;
+
+    // Ограничение длины больших значений в select и seek (0 - без ограничения)
+    virtual void setPreviewLimit(size_t bytes) { previewLimit = bytes; }
+    size_t getPreviewLimit() const { return previewLimit; }
+
+ protected:
+    size_t previewLimit = 0;
+
+    static bool isLargeType(std::string type) {
+        std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return std::toupper(c); });
+        for (const char* large : {"TEXT", "CHAR", "CLOB", "BLOB", "JSON", "BYTEA", "XML"}) {
+            if (type.find(large) != std::string::npos)
+                return true;
+        }
+        return type.empty();
+    }
+
+    // Переносит последнюю колонку строк (хеш строки) в hashes
+    static void takeHashes(types::TableData& result) {
+        result.hashes.reserve(result.data.size());
+        for (auto& row : result.data) {
+            result.hashes.push_back(std::move(row.back()));
+            row.pop_back();
+        }
+    }
+
+    // Отрезает колонки длин в конце строк и отмечает усечённые значения
+    void applyPreview(types::TableData& result, const std::vector<int>& large) const {
+        for (int i = 0; i < result.data.size(); ++i) {
+            auto& row = result.data[i];
+            size_t base = row.size() - large.size();
+            for (size_t k = 0; k < large.size(); ++k) {
+                const std::string& length = row[base + k];
+                size_t full = length.empty() || length == "NULL" ? 0 : std::stoull(length);
+                if (full > previewLimit)
+                    result.truncated[{i, large[k]}] = full;
+            }
+            row.resize(base);
+            result.nulls.erase(result.nulls.lower_bound({i, static_cast<int>(base)}), result.nulls.lower_bound({i + 1, 0}));
+        }
+    }
 };
 
+inline bool isPostgres(const Database& db) {
+    return db.connectionId().rfind("postgresql://", 0) == 0;
+}
+
+// Идентификатор в двойных кавычках, одинаковый для SQLite и PostgreSQL
+inline std::string quoteName(std::string_view name) {
+    std::string quoted = "\"";
+    for (char c : name) {
+        quoted += c;
+        if (c == '"')
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+// Таблицы PostgreSQL вне public называются «схема.таблица», таблицы public - без схемы; таблица public с точкой в имени
+// получает схему явно, чтобы название однозначно делилось по первой точке
+inline std::pair<std::string, std::string> splitTable(const std::string& table) {
+    size_t dot = table.find('.');
+    if (dot == std::string::npos)
+        return {"public", table};
+    return {table.substr(0, dot), table.substr(dot + 1)};
+}
+
+// Название таблицы в запросе: для PostgreSQL - схема и таблица отдельно, в SQLite точка - часть имени
+inline std::string quoteTable(const std::string& table, bool postgres) {
+    if (!postgres)
+        return quoteName(table);
+    auto [schema, name] = splitTable(table);
+    return quoteName(schema) + "." + quoteName(name);
+}
+
+inline std::string quoteTable(const Database& db, const std::string& table) {
+    return quoteTable(table, isPostgres(db));
+}
+
 }  // namespace base
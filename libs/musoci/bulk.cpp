@@ -0,0 +1,90 @@
+#include <thread>
+
+#include "bulk.hpp"
+#include "trace.hpp"
+
+namespace bulk {
+
+namespace {
+
+using Apply = std::function<size_t(const std::vector<std::string>& keys)>;
+
+// Пауза прерывается по stop, чтобы отмена не ждала её окончания
+void pause(std::chrono::milliseconds duration, const std::atomic<bool>& stop) {
+    auto until = std::chrono::steady_clock::now() + duration;
+    while (!stop && std::chrono::steady_clock::now() < until) {
+        std::this_thread::sleep_for(std::min(duration, std::chrono::milliseconds(10)));
+    }
+}
+
+size_t byKeys(const std::vector<std::string>& keys, const Options& options, const Progress& progress, const std::atomic<bool>& stop,
+              const Apply& apply) {
+    size_t changed = 0;
+    size_t chunk = std::max<size_t>(1, options.chunkRows);
+    for (size_t first = 0; first < keys.size() && !stop; first += chunk) {
+        if (first != 0)
+            pause(options.pause, stop);
+        if (stop)
+            break;
+        TRACE_SPAN("bulk.chunk");
+        std::vector<std::string> slice(keys.begin() + first, keys.begin() + std::min(keys.size(), first + chunk));
+        changed += apply(slice);
+        if (progress)
+            progress(first + slice.size(), keys.size());
+    }
+    return changed;
+}
+
+size_t where(base::Database& db, const std::string& table, const std::string& key, const std::string& condition, const Options& options,
+             const Progress& progress, const std::atomic<bool>& stop, const Apply& apply) {
+    size_t changed = 0, done = 0;
+    int chunk = static_cast<int>(std::max<size_t>(1, options.chunkRows));
+    std::string last;
+    while (!stop) {
+        if (done != 0)
+            pause(options.pause, stop);
+        if (stop)
+            break;
+        TRACE_SPAN("bulk.chunk");
+        std::vector<std::string> keys = db.filterKeys(table, key, condition, last, chunk);
+        if (keys.empty())
+            break;
+        changed += apply(keys);
+        done += keys.size();
+        last = keys.back();
+        if (progress)
+            progress(done, 0);
+        if (keys.size() < chunk)
+            break;
+    }
+    return changed;
+}
+
+}  // namespace
+
+size_t removeByKeys(base::Database& db, const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                    const Options& options, const Progress& progress, const std::atomic<bool>& stop) {
+    return byKeys(keys, options, progress, stop, [&](const std::vector<std::string>& slice) { return db.removeRows(table, key, slice); });
+}
+
+size_t updateByKeys(base::Database& db, const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                    const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls, const Options& options,
+                    const Progress& progress, const std::atomic<bool>& stop) {
+    return byKeys(keys, options, progress, stop,
+                  [&](const std::vector<std::string>& slice) { return db.updateRows(table, key, slice, values, nulls); });
+}
+
+size_t removeWhere(base::Database& db, const std::string& table, const std::string& key, const std::string& condition, const Options& options,
+                   const Progress& progress, const std::atomic<bool>& stop) {
+    return where(db, table, key, condition, options, progress, stop,
+                 [&](const std::vector<std::string>& keys) { return db.removeRows(table, key, keys); });
+}
+
+size_t updateWhere(base::Database& db, const std::string& table, const std::string& key, const std::string& condition,
+                   const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls, const Options& options,
+                   const Progress& progress, const std::atomic<bool>& stop) {
+    return where(db, table, key, condition, options, progress, stop,
+                 [&](const std::vector<std::string>& keys) { return db.updateRows(table, key, keys, values, nulls); });
+}
+
+}  // namespace bulk
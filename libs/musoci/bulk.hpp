@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+#include "base.hpp"
+
+namespace bulk {
+
+// Каждый блок - отдельная короткая транзакция, между блоками пауза, чтобы не держать блокировки долго
+struct Options {
+    size_t chunkRows = 1000;
+    std::chrono::milliseconds pause{50};
+};
+
+// Обработано строк из общего числа (0, если число заранее неизвестно)
+using Progress = std::function<void(size_t done, size_t total)>;
+
+// Удаление и изменение выбранных строк по списку ключей, возвращают число затронутых строк.
+// nulls - как в base::Database::updateRows
+size_t removeByKeys(base::Database& db, const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                    const Options& options, const Progress& progress, const std::atomic<bool>& stop);
+size_t updateByKeys(base::Database& db, const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                    const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls, const Options& options,
+                    const Progress& progress, const std::atomic<bool>& stop);
+
+// То же для строк под условием where: ключи очередного блока выбираются по порядку key после последнего обработанного
+size_t removeWhere(base::Database& db, const std::string& table, const std::string& key, const std::string& where, const Options& options,
+                   const Progress& progress, const std::atomic<bool>& stop);
+size_t updateWhere(base::Database& db, const std::string& table, const std::string& key, const std::string& where,
+                   const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls, const Options& options,
+                   const Progress& progress, const std::atomic<bool>& stop);
+
+}  // namespace bulk
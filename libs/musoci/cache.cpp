@@ -0,0 +1,962 @@
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+
+#include "cache.hpp"
+#include "trace.hpp"
+
+namespace cache {
+
+namespace {
+
+// Ключ из операции и аргументов: каждое значение с длиной, чтобы разные наборы аргументов не склеивались в одну строку
+class Key {
+ public:
+    explicit Key(const char* operation) { add(operation); }
+
+    Key& add(const std::string& value) {
+        text += std::to_string(value.size()) + ":" + value;
+        return *this;
+    }
+
+    Key& add(long long value) { return add(std::to_string(value)); }
+
+    Key& add(const std::vector<std::string>& values) {
+        add(static_cast<long long>(values.size()));
+        for (const auto& value : values) {
+            add(value);
+        }
+        return *this;
+    }
+
+    const std::string& str() const { return text; }
+
+ private:
+    std::string text;
+};
+
+// Оценка занимаемой памяти: значения длиннее встроенного буфера std::string лежат в куче
+size_t sizeOf(const std::string& value) {
+    return sizeof(std::string) + (value.size() > 15 ? value.size() + 1 : 0);
+}
+
+size_t sizeOf(const std::vector<std::string>& values) {
+    size_t bytes = sizeof(values);
+    for (const auto& value : values) {
+        bytes += sizeOf(value);
+    }
+    return bytes;
+}
+
+size_t sizeOf(const types::TableSchema& schema) {
+    size_t bytes = sizeof(types::TableSchema) + sizeOf(schema.title) + sizeOf(schema.rowKey);
+    for (const auto& column : schema.columns) {
+        bytes += sizeof(types::Column) + sizeOf(column.name) + sizeOf(column.type);
+    }
+    return bytes;
+}
+
+size_t sizeOf(const std::vector<types::TableSchema>& schemas) {
+    size_t bytes = sizeof(schemas);
+    for (const auto& schema : schemas) {
+        bytes += sizeOf(schema);
+    }
+    return bytes;
+}
+
+size_t sizeOf(const types::TableData& data) {
+    size_t bytes = sizeof(types::TableData) - sizeof(types::TableSchema) + sizeOf(static_cast<const types::TableSchema&>(data)) +
+                   (data.truncated.size() + data.nulls.size()) * 64 + sizeOf(data.hashes);
+    for (const auto& row : data.data) {
+        bytes += sizeof(row);
+        for (const auto& value : row) {
+            bytes += sizeOf(value);
+        }
+    }
+    return bytes;
+}
+
+// Двоичный вид для файла вытеснения: числа - varint, строки - длина и байты без разделителей
+void put(std::string& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+void put(std::string& out, const std::string& value) {
+    put(out, value.size());
+    out.append(value);
+}
+
+void put(std::string& out, const std::vector<std::string>& values) {
+    put(out, values.size());
+    for (const auto& value : values) {
+        put(out, value);
+    }
+}
+
+void put(std::string& out, const types::TableSchema& schema) {
+    put(out, schema.title);
+    put(out, schema.rowKey);
+    put(out, schema.columns.size());
+    for (const auto& column : schema.columns) {
+        put(out, column.name);
+        put(out, column.type);
+        put(out, (column.nullable ? 1 : 0) | (column.primary_key ? 2 : 0));
+    }
+}
+
+void put(std::string& out, const std::vector<types::TableSchema>& schemas) {
+    put(out, schemas.size());
+    for (const auto& schema : schemas) {
+        put(out, schema);
+    }
+}
+
+void put(std::string& out, const types::TableData& data) {
+    put(out, static_cast<const types::TableSchema&>(data));
+    put(out, static_cast<uint64_t>(data.page));
+    put(out, static_cast<uint64_t>(data.count));
+    put(out, data.data.size());
+    for (const auto& row : data.data) {
+        put(out, row.size());
+        for (const auto& value : row) {
+            put(out, value);
+        }
+    }
+    put(out, data.truncated.size());
+    for (const auto& [cell, length] : data.truncated) {
+        put(out, static_cast<uint64_t>(cell.first));
+        put(out, static_cast<uint64_t>(cell.second));
+        put(out, length);
+    }
+    put(out, data.nulls.size());
+    for (const auto& cell : data.nulls) {
+        put(out, static_cast<uint64_t>(cell.first));
+        put(out, static_cast<uint64_t>(cell.second));
+    }
+    put(out, data.hashes);
+}
+
+class Reader {
+ public:
+    Reader(const char* data, size_t size) : begin(data), data(data), end(data + size) {}
+
+    size_t position() const { return static_cast<size_t>(data - begin); }
+
+    uint64_t number() {
+        uint64_t value = 0;
+        for (int shift = 0; data < end; shift += 7) {
+            auto byte = static_cast<unsigned char>(*data++);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (byte < 0x80)
+                return value;
+        }
+        throw std::runtime_error("Corrupted cache spill record");
+    }
+
+    // Число элементов: каждый занимает хотя бы байт, поэтому испорченная длина не приводит к огромному выделению памяти
+    size_t count() {
+        uint64_t value = number();
+        if (value > static_cast<uint64_t>(end - data))
+            throw std::runtime_error("Corrupted cache spill record");
+        return static_cast<size_t>(value);
+    }
+
+    std::string string() {
+        size_t size = number();
+        if (size > static_cast<size_t>(end - data))
+            throw std::runtime_error("Corrupted cache spill record");
+        std::string value(data, size);
+        data += size;
+        return value;
+    }
+
+    void read(std::vector<std::string>& values) {
+        values.resize(count());
+        for (auto& value : values) {
+            value = string();
+        }
+    }
+
+    void read(types::TableSchema& schema) {
+        schema.title = string();
+        schema.rowKey = string();
+        schema.columns.resize(count());
+        for (auto& column : schema.columns) {
+            column.name = string();
+            column.type = string();
+            uint64_t flags = number();
+            column.nullable = flags & 1;
+            column.primary_key = flags & 2;
+        }
+    }
+
+    void read(std::vector<types::TableSchema>& schemas) {
+        schemas.resize(count());
+        for (auto& schema : schemas) {
+            read(schema);
+        }
+    }
+
+    void read(types::TableData& data) {
+        read(static_cast<types::TableSchema&>(data));
+        data.page = static_cast<int>(number());
+        data.count = static_cast<int>(number());
+        data.data.resize(count());
+        for (auto& row : data.data) {
+            row.resize(count());
+            for (auto& value : row) {
+                value = string();
+            }
+        }
+        for (size_t i = count(); i > 0; --i) {
+            int row = static_cast<int>(number());
+            int column = static_cast<int>(number());
+            data.truncated[{row, column}] = number();
+        }
+        for (size_t i = count(); i > 0; --i) {
+            int row = static_cast<int>(number());
+            data.nulls.emplace(row, static_cast<int>(number()));
+        }
+        read(data.hashes);
+    }
+
+ private:
+    const char* begin;
+    const char* data;
+    const char* end;
+};
+
+// Записи подключения сбрасываются, когда загрузка зафиксирована или отменена
+class InvalidatingLoader : public base::BulkLoader {
+ public:
+    InvalidatingLoader(std::unique_ptr<base::BulkLoader> inner, std::function<void()> invalidate)
+        : inner(std::move(inner)), invalidate(std::move(invalidate)) {}
+
+    ~InvalidatingLoader() override { invalidate(); }
+
+    void begin(const std::vector<types::Column>& columns) override { inner->begin(columns); }
+    void row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) override { inner->row(values, nulls); }
+
+    size_t finish() override {
+        size_t written = inner->finish();
+        invalidate();
+        return written;
+    }
+
+ private:
+    std::unique_ptr<base::BulkLoader> inner;
+    std::function<void()> invalidate;
+};
+
+// flock на время области. Блокировка общая для всех процессов, открывших файл, в отличие от mutex хранилища
+class FileLock {
+ public:
+    FileLock(int fd, int operation) : fd(fd) {
+        while (::flock(fd, operation) != 0 && errno == EINTR) {
+        }
+    }
+
+    ~FileLock() { ::flock(fd, LOCK_UN); }
+
+    FileLock(const FileLock&) = delete;
+    FileLock& operator=(const FileLock&) = delete;
+
+ private:
+    int fd;
+};
+
+}  // namespace
+
+template <typename T>
+const Codec& codecOf() {
+    static const Codec codec{
+        [](const void* value, std::string& out) { put(out, *static_cast<const T*>(value)); },
+        [](const char* data, size_t size) -> std::shared_ptr<const void> {
+            auto value = std::make_shared<T>();
+            Reader(data, size).read(*value);
+            return value;
+        },
+        [](const void* value) { return sizeOf(*static_cast<const T*>(value)); },
+    };
+    return codec;
+}
+
+template const Codec& codecOf<std::vector<std::string>>();
+template const Codec& codecOf<std::vector<types::TableSchema>>();
+template const Codec& codecOf<types::TableSchema>();
+template const Codec& codecOf<types::TableData>();
+
+// Удалённый сразу после создания файл фиксированного размера, отображённый в память целиком.
+// Страницы выделяются по мере записи, вытеснять их на диск и подгружать обратно решает ядро
+class ResultCache::SpillFile {
+ public:
+    SpillFile(const std::string& dir, size_t length) : length(length) {
+        std::string path = (dir.empty() ? std::filesystem::temp_directory_path() : std::filesystem::path(dir)) / "aleto-cache-XXXXXX";
+        int fd = ::mkstemp(path.data());
+        if (fd < 0)
+            throw std::runtime_error("Failed to create " + path);
+        ::unlink(path.c_str());
+        if (::ftruncate(fd, static_cast<off_t>(length)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to resize " + path);
+        }
+        void* mapped = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            throw std::runtime_error("Failed to map " + path);
+        ::madvise(mapped, length, MADV_RANDOM);
+        bytes = static_cast<char*>(mapped);
+    }
+
+    ~SpillFile() { ::munmap(bytes, length); }
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+ private:
+    char* bytes = nullptr;
+    size_t length;
+};
+
+ResultCache::ResultCache(size_t budget, size_t spillBytes, std::string spillDir)
+    : budget(budget), spillBytes(spillBytes), spillDir(std::move(spillDir)) {}
+
+ResultCache::~ResultCache() = default;
+
+std::shared_ptr<const void> ResultCache::find(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it == entries.end()) {
+        ++counters.misses;
+        return nullptr;
+    }
+    Entry& entry = it->second;
+    if (entry.value) {
+        ++counters.hits;
+        recent.splice(recent.begin(), recent, entry.used);
+        return entry.value;
+    }
+
+    TRACE_SPAN("cache.fault");
+    std::shared_ptr<const void> value;
+    try {
+        value = entry.codec->decode(spill->data() + entry.offset, entry.length);
+    } catch (const std::exception&) {
+        // Испорченная запись в файле - промах: она удаляется, и значение читается из базы заново
+        erase(it);
+        ++counters.misses;
+        return nullptr;
+    }
+    ++counters.hits;
+    ++counters.faults;
+    dropSpilled(entry);
+    size_t bytes = entry.codec->size(value.get()) + key.size();
+    // Освобождая место, запись уже не числится ни в памяти, ни в файле, поэтому не может быть вытеснена сама
+    makeRoom(bytes);
+    entry.value = value;
+    entry.bytes = bytes;
+    recent.push_front(key);
+    entry.used = recent.begin();
+    counters.bytes += bytes;
+    return value;
+}
+
+void ResultCache::store(const std::string& key, std::shared_ptr<const void> value, const Codec& codec) {
+    size_t bytes = codec.size(value.get()) + key.size();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.find(key);
+    if (it != entries.end())
+        erase(it);
+    if (bytes > budget / 4)
+        return;
+
+    makeRoom(bytes);
+    recent.push_front(key);
+    entries.emplace(key, Entry{std::move(value), &codec, bytes, recent.begin()});
+    counters.bytes += bytes;
+}
+
+void ResultCache::invalidate(const std::string& prefix) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = entries.lower_bound(prefix);
+    while (it != entries.end() && it->first.compare(0, prefix.size(), prefix) == 0) {
+        erase(it++);
+    }
+}
+
+std::string ResultCache::newScope() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return std::to_string(++scopes) + "/";
+}
+
+Stats ResultCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats result = counters;
+    result.entries = entries.size() - counters.spilledEntries;
+    return result;
+}
+
+void ResultCache::makeRoom(size_t bytes) {
+    while (!recent.empty() && counters.bytes + bytes > budget) {
+        auto it = entries.find(recent.back());
+        Entry& entry = it->second;
+        recent.pop_back();
+        counters.bytes -= entry.bytes;
+        if (!spillOut(entry, it->first)) {
+            entries.erase(it);
+            ++counters.evictions;
+        }
+    }
+}
+
+bool ResultCache::spillOut(Entry& entry, const std::string& key) {
+    if (spillBytes == 0)
+        return false;
+    if (!spill) {
+        try {
+            spill = std::make_unique<SpillFile>(spillDir, spillBytes);
+        } catch (const std::exception&) {
+            // Без файла кеш продолжает работать только в памяти
+            spillBytes = 0;
+            return false;
+        }
+    }
+
+    TRACE_SPAN("cache.spill");
+    encoded.clear();
+    entry.codec->encode(entry.value.get(), encoded);
+    if (encoded.size() > spill->size() / 4)
+        return false;
+    if (spillEnd + encoded.size() > spill->size())
+        spillEnd = 0;
+
+    // Записи, которые окажутся перезаписаны, удаляются
+    size_t end = spillEnd + encoded.size();
+    for (auto it = spilled.lower_bound(spillEnd); it != spilled.end() && it->first < end;) {
+        auto victim = entries.find(it->second);
+        counters.spilledBytes -= victim->second.length;
+        --counters.spilledEntries;
+        entries.erase(victim);
+        ++counters.evictions;
+        it = spilled.erase(it);
+    }
+
+    std::memcpy(spill->data() + spillEnd, encoded.data(), encoded.size());
+    entry.value.reset();
+    entry.bytes = 0;
+    entry.offset = spillEnd;
+    entry.length = encoded.size();
+    spilled.emplace(spillEnd, key);
+    spillEnd = end;
+    ++counters.spills;
+    counters.spilledBytes += entry.length;
+    ++counters.spilledEntries;
+    return true;
+}
+
+void ResultCache::dropSpilled(Entry& entry) {
+    spilled.erase(entry.offset);
+    counters.spilledBytes -= entry.length;
+    --counters.spilledEntries;
+}
+
+void ResultCache::erase(std::map<std::string, Entry>::iterator it) {
+    if (it->second.value) {
+        counters.bytes -= it->second.bytes;
+        recent.erase(it->second.used);
+    } else {
+        dropSpilled(it->second);
+    }
+    entries.erase(it);
+}
+
+// Файл таблицы: заголовок с подключением, таблицей и версией, затем записи «длина ключа, ключ, длина значения, значение».
+// Запись с тем же ключом дописывается заново, при чтении действует последняя. Файл бывает открыт и в других запусках:
+// записи дописываются через O_APPEND под исключительной блокировкой flock, чтение идёт под разделяемой, а найденная
+// запись перед чтением сверяется с заголовком и своим ключом, потому что другой запуск мог начать файл заново
+class PageStore::TableFile {
+ public:
+    TableFile(const std::string& path, std::string header, size_t limit) : header(std::move(header)), limit(limit) {
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0)
+            return;
+        FileLock lock(fd, LOCK_EX);
+        remap();
+        if (!matches()) {
+            restart();
+            return;
+        }
+        // Оборванная последняя запись (запуск завершился во время записи) не индексируется
+        size_t offset = this->header.size();
+        while (offset < length) {
+            Reader reader(bytes + offset, length - offset);
+            try {
+                std::string key = reader.string();
+                size_t size = reader.number();
+                size_t start = reader.position() + offset;
+                if (size > length - start)
+                    break;
+                index[key] = offset;
+                offset = start + size;
+            } catch (const std::exception&) {
+                break;
+            }
+        }
+    }
+
+    ~TableFile() {
+        unmap();
+        if (fd >= 0)
+            ::close(fd);
+    }
+
+    TableFile(const TableFile&) = delete;
+    TableFile& operator=(const TableFile&) = delete;
+
+    const std::string& version() const { return header; }
+
+    // Заново с новым заголовком: другая версия таблицы
+    void reset(const std::string& newHeader) {
+        header = newHeader;
+        if (fd < 0)
+            return;
+        FileLock lock(fd, LOCK_EX);
+        restart();
+    }
+
+    std::shared_ptr<const void> find(const std::string& key, const Codec& codec) {
+        auto it = index.find(key);
+        if (it == index.end() || fd < 0)
+            return nullptr;
+        FileLock lock(fd, LOCK_SH);
+        // Отображение должно совпадать с текущим размером: за его концом у укороченного файла чтение падает с SIGBUS
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+            return nullptr;
+        if (static_cast<size_t>(st.st_size) != length)
+            remap();
+        if (!matches() || it->second >= length)
+            return nullptr;
+        try {
+            Reader reader(bytes + it->second, length - it->second);
+            if (reader.string() != key)
+                return nullptr;
+            size_t size = reader.number();
+            size_t start = it->second + reader.position();
+            if (size > length - start)
+                return nullptr;
+            return codec.decode(bytes + start, size);
+        } catch (const std::exception&) {
+            return nullptr;
+        }
+    }
+
+    void append(const std::string& key, const std::string& value) {
+        if (fd < 0)
+            return;
+        std::string record;
+        put(record, key);
+        put(record, value.size());
+        record += value;
+
+        FileLock lock(fd, LOCK_EX);
+        struct stat st;
+        if (::fstat(fd, &st) != 0)
+            return;
+        size_t offset = static_cast<size_t>(st.st_size);
+        // Предел считается по всему файлу вместе с записями других запусков; другая версия в заголовке - тоже повод начать заново
+        if (offset + record.size() > limit || !headerOnDisk()) {
+            if (!restart())
+                return;
+            offset = header.size();
+        }
+        if (!writeAll(record)) {
+            // Недописанная запись отрезается, чтобы следующие не легли за ней
+            if (::ftruncate(fd, static_cast<off_t>(offset)) != 0)
+                restart();
+            return;
+        }
+        index[key] = offset;
+    }
+
+ private:
+    int fd = -1;
+    std::string header;
+    size_t limit;
+    // Начало записи по ключу
+    std::map<std::string, size_t> index;
+    char* bytes = nullptr;
+    size_t length = 0;
+
+    bool matches() const { return length >= header.size() && std::memcmp(bytes, header.data(), header.size()) == 0; }
+
+    bool headerOnDisk() const {
+        std::string stored(header.size(), '\0');
+        return ::pread(fd, stored.data(), stored.size(), 0) == static_cast<ssize_t>(stored.size()) && stored == header;
+    }
+
+    // Под исключительной блокировкой: файл из одного заголовка
+    bool restart() {
+        unmap();
+        index.clear();
+        if (::ftruncate(fd, 0) != 0)
+            return false;
+        if (writeAll(header))
+            return true;
+        (void)::ftruncate(fd, 0);
+        return false;
+    }
+
+    bool writeAll(const std::string& data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void unmap() {
+        if (bytes)
+            ::munmap(bytes, length);
+        bytes = nullptr;
+        length = 0;
+    }
+
+    void remap() {
+        unmap();
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* mapped = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                bytes = static_cast<char*>(mapped);
+                length = static_cast<size_t>(st.st_size);
+            }
+        }
+    }
+};
+
+PageStore::PageStore(std::string dir, size_t tableBytes) : dir(std::move(dir)), tableBytes(tableBytes) {
+    std::error_code ec;
+    std::filesystem::create_directories(this->dir, ec);
+}
+
+PageStore::~PageStore() = default;
+
+PageStore::TableFile& PageStore::open(const std::string& connection, const std::string& table, const std::string& version) {
+    std::string header = "aleto-pages 3\n" + connection + "\n" + table + "\n" + version + "\n";
+    std::ostringstream name;
+    name << std::hex << std::hash<std::string>{}(connection + "\n" + table) << ".pages";
+    std::string path = (std::filesystem::path(dir) / name.str()).string();
+
+    auto& file = files[path];
+    if (!file)
+        file = std::make_unique<TableFile>(path, header, tableBytes);
+    else if (file->version() != header)
+        file->reset(header);
+    return *file;
+}
+
+std::shared_ptr<const void> PageStore::find(const std::string& connection, const std::string& table, const std::string& version,
+                                            const std::string& key, const Codec& codec) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return open(connection, table, version).find(key, codec);
+}
+
+void PageStore::store(const std::string& connection, const std::string& table, const std::string& version, const std::string& key,
+                      const void* value, const Codec& codec) {
+    TRACE_SPAN("cache.persist");
+    std::lock_guard<std::mutex> lock(mutex);
+    encoded.clear();
+    codec.encode(value, encoded);
+    open(connection, table, version).append(key, encoded);
+}
+
+CachedDatabase::~CachedDatabase() {
+    cache->invalidate(scope);
+}
+
+bool CachedDatabase::fresh() {
+    auto now = std::chrono::steady_clock::now();
+    uint64_t changes;
+    {
+        std::lock_guard<std::mutex> lock(written->mutex);
+        changes = written->changes;
+    }
+    // Запрос версии у PostgreSQL - обращение к статистике, поэтому подряд идущие чтения обходятся одной сверкой
+    if (!version.empty() && changes == seenChanges && now - checked < recheck)
+        return true;
+
+    std::string current;
+    try {
+        current = inner->dataVersion();
+    } catch (const std::exception&) {
+        // Версию не прочитать (старый сервер, разорванное подключение) - чтение идёт мимо кеша
+        invalidate();
+        return false;
+    }
+    if (current != version) {
+        cache->invalidate(scope);
+        version = current;
+        tablesRead = false;
+    }
+    checked = now;
+    seenChanges = changes;
+    return true;
+}
+
+void CachedDatabase::invalidate() {
+    cache->invalidate(scope);
+    version.clear();
+    tablesRead = false;
+    std::lock_guard<std::mutex> lock(written->mutex);
+    ++written->changes;
+}
+
+std::string CachedDatabase::tableVersion(const std::string& table) {
+    if (!tablesRead) {
+        try {
+            tables = inner->tableVersions();
+        } catch (const std::exception&) {
+            tables.clear();
+        }
+        tablesRead = true;
+    }
+    auto it = tables.find(table);
+    return it == tables.end() ? "" : it->second;
+}
+
+void CachedDatabase::markWritten(const std::string& table) {
+    std::lock_guard<std::mutex> lock(written->mutex);
+    if (table.empty())
+        written->any = true;
+    else
+        written->tables.insert(table);
+}
+
+bool CachedDatabase::wasWritten(const std::string& table) {
+    std::lock_guard<std::mutex> lock(written->mutex);
+    return written->any || written->tables.count(table) > 0;
+}
+
+template <typename T, typename F>
+T CachedDatabase::remember(const std::string& table, const std::string& key, F&& read) {
+    if (!fresh()) {
+        ++reads;
+        return read();
+    }
+    std::string stored = std::to_string(previewLimit) + "/" + key;
+    std::string full = scope + stored;
+    if (auto found = cache->find(full))
+        return *std::static_pointer_cast<const T>(found);
+
+    std::string persisted = store && !wasWritten(table) ? tableVersion(table) : "";
+    if (!persisted.empty()) {
+        if (auto found = store->find(inner->connectionId(), table, persisted, stored, codecOf<T>())) {
+            cache->store(full, found, codecOf<T>());
+            return *std::static_pointer_cast<const T>(found);
+        }
+    }
+
+    TRACE_SPAN("cache.miss");
+    ++reads;
+    auto result = std::make_shared<const T>(read());
+    cache->store(full, result, codecOf<T>());
+    if (!persisted.empty())
+        store->store(inner->connectionId(), table, persisted, stored, result.get(), codecOf<T>());
+    return *result;
+}
+
+template <typename F>
+auto CachedDatabase::change(const std::string& table, F&& call) -> decltype(call()) {
+    markWritten(table);
+    return invalidating(std::forward<F>(call));
+}
+
+template <typename F>
+auto CachedDatabase::invalidating(F&& call) -> decltype(call()) {
+    try {
+        auto result = call();
+        invalidate();
+        return result;
+    } catch (...) {
+        invalidate();
+        throw;
+    }
+}
+
+std::unique_ptr<base::Database> CachedDatabase::clone() const {
+    auto copy = std::make_unique<CachedDatabase>(inner->clone(), cache, store, recheck);
+    copy->written = written;
+    copy->setPreviewLimit(previewLimit);
+    return copy;
+}
+
+bool CachedDatabase::executeQuery(const std::string& sql) {
+    return change("", [&] { return inner->executeQuery(sql); });
+}
+
+// Через query идут чтения (начало tail, отметка sync), поэтому таблицы не отмечаются изменёнными и диск остаётся в ходу;
+// записи в памяти сбрасываются на случай, если запрос всё же что-то изменил
+types::TableData CachedDatabase::query(const std::string& sql) {
+    return invalidating([&] { return inner->query(sql); });
+}
+
+size_t CachedDatabase::stream(const std::string& sql, base::RowSink& sink, const std::atomic<bool>& stop) {
+    return inner->stream(sql, sink, stop);
+}
+
+size_t CachedDatabase::streamTable(const std::string& table, const std::vector<std::string>& columns, base::RowSink& sink,
+                                   const std::atomic<bool>& stop) {
+    return inner->streamTable(table, columns, sink, stop);
+}
+
+size_t CachedDatabase::streamRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key,
+                                   const std::string& from, const std::string& to, base::RowSink& sink, const std::atomic<bool>& stop) {
+    return inner->streamRange(table, columns, key, from, to, sink, stop);
+}
+
+types::RangeHash CachedDatabase::hashRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key,
+                                           const std::string& from, const std::string& to) {
+    return inner->hashRange(table, columns, key, from, to);
+}
+
+std::string CachedDatabase::exportSnapshot() {
+    return inner->exportSnapshot();
+}
+
+// Снимок меняет видимые подключению данные
+void CachedDatabase::useSnapshot(const std::string& id) {
+    invalidate();
+    inner->useSnapshot(id);
+}
+
+void CachedDatabase::releaseSnapshot() {
+    invalidate();
+    inner->releaseSnapshot();
+}
+
+std::unique_ptr<base::ChangeFeed> CachedDatabase::watch(const std::vector<std::string>& tables, bool installTriggers) {
+    return inner->watch(tables, installTriggers);
+}
+
+std::vector<std::string> CachedDatabase::listTables() {
+    return remember<std::vector<std::string>>("", Key("listTables").str(), [&] { return inner->listTables(); });
+}
+
+std::vector<types::TableSchema> CachedDatabase::getTables() {
+    return remember<std::vector<types::TableSchema>>("", Key("getTables").str(), [&] { return inner->getTables(); });
+}
+
+types::TableSchema CachedDatabase::describe(const std::string& table) {
+    return remember<types::TableSchema>(table, Key("describe").add(table).str(), [&] { return inner->describe(table); });
+}
+
+types::TableData CachedDatabase::select(const std::string& table, int offset, int limit, const std::vector<std::string>& columns) {
+    return remember<types::TableData>(table, Key("select").add(table).add(offset).add(limit).add(columns).str(),
+                                      [&] { return inner->select(table, offset, limit, columns); });
+}
+
+types::TableData CachedDatabase::seek(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                      int limit, const std::vector<std::string>& columns, bool hashes) {
+    return remember<types::TableData>(table, Key("seek").add(table).add(key).add(from).add(inclusive).add(offset).add(limit).add(columns).add(hashes).str(),
+                                      [&] { return inner->seek(table, key, from, inclusive, offset, limit, columns, hashes); });
+}
+
+// Хеши и строки по ключам запрашиваются, чтобы обнаружить изменения, поэтому всегда читаются из базы
+types::TableData CachedDatabase::seekHashes(const std::string& table, const std::string& key, const std::string& from, bool inclusive,
+                                            int offset, int limit) {
+    return inner->seekHashes(table, key, from, inclusive, offset, limit);
+}
+
+types::TableData CachedDatabase::selectKeys(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                            const std::vector<std::string>& columns) {
+    return inner->selectKeys(table, key, keys, columns);
+}
+
+std::vector<std::string> CachedDatabase::pageAnchors(const std::string& table, const std::string& key, int step, const std::atomic<bool>& stop) {
+    return inner->pageAnchors(table, key, step, stop);
+}
+
+bool CachedDatabase::editRow(const std::string& table, const std::pair<std::string, std::string>& where,
+                             const std::vector<std::pair<std::string, std::string>>& values) {
+    return change(table, [&] { return inner->editRow(table, where, values); });
+}
+
+bool CachedDatabase::addRow(const std::string& table, const std::vector<std::pair<std::string, std::string>>& values) {
+    return change(table, [&] { return inner->addRow(table, values); });
+}
+
+types::BatchResult CachedDatabase::addRows(const std::string& table, const types::ColumnBatch& batch, bool continueOnError) {
+    return change(table, [&] { return inner->addRows(table, batch, continueOnError); });
+}
+
+std::unique_ptr<base::BulkLoader> CachedDatabase::bulkLoad(const std::string& table, const std::vector<std::string>& columns,
+                                                           const base::LoadOptions& options) {
+    markWritten(table);
+    return std::make_unique<InvalidatingLoader>(inner->bulkLoad(table, columns, options), [this] { invalidate(); });
+}
+
+bool CachedDatabase::removeRow(const std::string& table, const std::pair<std::string, std::string>& where) {
+    return change(table, [&] { return inner->removeRow(table, where); });
+}
+
+size_t CachedDatabase::removeRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys) {
+    return change(table, [&] { return inner->removeRows(table, key, keys); });
+}
+
+size_t CachedDatabase::updateRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                  const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls) {
+    return change(table, [&] { return inner->updateRows(table, key, keys, values, nulls); });
+}
+
+std::vector<std::string> CachedDatabase::filterKeys(const std::string& table, const std::string& key, const std::string& where,
+                                                    const std::string& from, int limit) {
+    return inner->filterKeys(table, key, where, from, limit);
+}
+
+types::TableData CachedDatabase::search(const std::string& table, const std::string& column, const std::string& pattern, int limit) {
+    return remember<types::TableData>(table, Key("search").add(table).add(column).add(pattern).add(limit).str(),
+                                      [&] { return inner->search(table, column, pattern, limit); });
+}
+
+bool CachedDatabase::createTable(const types::TableSchema& schema) {
+    return change(schema.title, [&] { return inner->createTable(schema); });
+}
+
+bool CachedDatabase::dropTable(const std::string& tableName) {
+    return change(tableName, [&] { return inner->dropTable(tableName); });
+}
+
+std::string CachedDatabase::readValue(const std::string& table, const std::pair<std::string, std::string>& where, const types::Column& column,
+                                      size_t& offset, size_t length) {
+    return inner->readValue(table, where, column, offset, length);
+}
+
+void CachedDatabase::setPreviewLimit(size_t bytes) {
+    previewLimit = bytes;
+    inner->setPreviewLimit(bytes);
+}
+
+}  // namespace cache
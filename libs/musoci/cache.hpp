@@ -0,0 +1,239 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+
+#include "base.hpp"
+
+namespace cache {
+
+struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Записи, удалённые совсем, вынесенные в файл и поднятые из файла обратно
+    uint64_t evictions = 0;
+    uint64_t spills = 0;
+    uint64_t faults = 0;
+    size_t bytes = 0;
+    size_t entries = 0;
+    size_t spilledBytes = 0;
+    size_t spilledEntries = 0;
+};
+
+// Преобразование запомненного значения в компактный двоичный вид для файла вытеснения и оценка занимаемой памяти
+struct Codec {
+    void (*encode)(const void* value, std::string& out);
+    std::shared_ptr<const void> (*decode)(const char* data, size_t size);
+    size_t (*size)(const void* value);
+};
+
+// Кодек запоминаемых значений: std::vector<std::string>, std::vector<types::TableSchema>, types::TableSchema, types::TableData
+template <typename T>
+const Codec& codecOf();
+
+// Результаты чтений всех подключений процесса в общем бюджете памяти. При превышении бюджета давно не использованные
+// записи выносятся в отображённый в память временный файл и поднимаются обратно при обращении; файл заполняется по кругу,
+// перезаписываемые записи удаляются. Без файла (spillBytes = 0) лишнее удаляется сразу. Запись крупнее четверти
+// бюджета (или четверти файла при вытеснении) не сохраняется
+class ResultCache {
+ public:
+    // spillDir - каталог временного файла (пусто - системный каталог временных файлов); файл создаётся при первом вытеснении
+    explicit ResultCache(size_t budget, size_t spillBytes = 0, std::string spillDir = "");
+    ~ResultCache();
+
+    std::shared_ptr<const void> find(const std::string& key);
+    void store(const std::string& key, std::shared_ptr<const void> value, const Codec& codec);
+    // Удаляет записи, ключи которых начинаются с prefix
+    void invalidate(const std::string& prefix);
+    // Префикс ключей нового подключения
+    std::string newScope();
+
+    Stats stats() const;
+
+ private:
+    class SpillFile;
+
+    struct Entry {
+        // Пусто, если запись вынесена в файл
+        std::shared_ptr<const void> value;
+        const Codec* codec;
+        size_t bytes = 0;
+        std::list<std::string>::iterator used;
+        size_t offset = 0;
+        size_t length = 0;
+    };
+
+    mutable std::mutex mutex;
+    size_t budget;
+    size_t spillBytes;
+    std::string spillDir;
+    std::unique_ptr<SpillFile> spill;
+    // Следующая позиция записи в файле
+    size_t spillEnd = 0;
+    std::string encoded;
+
+    std::map<std::string, Entry> entries;
+    // Ключи записей в памяти от недавно использованных к давно не использованным
+    std::list<std::string> recent;
+    // Ключи вынесенных записей по смещению в файле
+    std::map<size_t, std::string> spilled;
+    Stats counters;
+    uint64_t scopes = 0;
+
+    void makeRoom(size_t bytes);
+    bool spillOut(Entry& entry, const std::string& key);
+    void dropSpilled(Entry& entry);
+    void erase(std::map<std::string, Entry>::iterator it);
+};
+
+// Страницы и схемы удалённых таблиц на диске между запусками: файл на пару (подключение, таблица) с версией таблицы
+// в заголовке и записями «ключ - значение» в том же двоичном виде, что и файл вытеснения. Файл читается через
+// отображение в память; при другой версии таблицы он начинается заново, как и при превышении tableBytes.
+// Один файл могут использовать несколько запусков сразу: запись и чтение разделяет flock
+class PageStore {
+ public:
+    PageStore(std::string dir, size_t tableBytes);
+    ~PageStore();
+
+    std::shared_ptr<const void> find(const std::string& connection, const std::string& table, const std::string& version, const std::string& key,
+                                     const Codec& codec);
+    void store(const std::string& connection, const std::string& table, const std::string& version, const std::string& key, const void* value,
+               const Codec& codec);
+
+ private:
+    class TableFile;
+
+    std::mutex mutex;
+    std::string dir;
+    size_t tableBytes;
+    std::map<std::string, std::unique_ptr<TableFile>> files;
+    std::string encoded;
+
+    TableFile& open(const std::string& connection, const std::string& table, const std::string& version);
+};
+
+// Обёртка над подключением, запоминающая результаты listTables, getTables, describe, select, seek и search по операции и её аргументам.
+// Перед таким чтением сверяется версия данных подключения (dataVersion): если она изменилась, все записи
+// подключения сбрасываются. Сверка идёт не чаще раза в recheck; раньше - после изменений через это подключение или его копии
+// и после expire. Изменения через саму обёртку сбрасывают записи сразу. Произвольный SQL (query, stream)
+// не кешируется: в нём могут быть изменения и функции вроде now() или nextval().
+// С store результаты дополнительно сохраняются на диск и при промахе в памяти берутся оттуда, если версия таблицы
+// (tableVersions) совпадает с сохранённой. Версии перечитываются после каждого изменения версии данных. Список таблиц
+// на диск не сохраняется: между запусками его хранит catalog::Store.
+// Счётчики изменений в версии таблицы PostgreSQL отстают от записи, поэтому для таблиц, изменённых этим подключением
+// или его копиями, диск не используется до конца сеанса: иначе страница после изменения легла бы под старую версию.
+// executeQuery отмечает изменёнными все таблицы, query считается чтением и только сбрасывает записи в памяти
+class CachedDatabase : public base::Database {
+ public:
+    CachedDatabase(std::unique_ptr<base::Database> inner, std::shared_ptr<ResultCache> cache, std::shared_ptr<PageStore> store = nullptr,
+                   std::chrono::milliseconds recheck = std::chrono::milliseconds(0))
+        : inner(std::move(inner)),
+          cache(std::move(cache)),
+          store(std::move(store)),
+          recheck(recheck),
+          scope(this->cache->newScope()),
+          written(std::make_shared<Written>()) {}
+    ~CachedDatabase() override;
+
+    std::unique_ptr<base::Database> clone() const override;
+    // Копия обёрнутого подключения без кеша: для опроса, чьи результаты сразу устаревают
+    std::unique_ptr<base::Database> uncachedClone() const { return inner->clone(); }
+    // Кешируемые чтения, дошедшие до базы: по разнице до и после вызова видно, ответил ли кеш
+    uint64_t databaseReads() const { return reads; }
+    // Следующее чтение сверит версию данных, не дожидаясь recheck (пришло уведомление об изменении, обновление вручную)
+    void expire() { checked = {}; }
+    std::string connectionId() const override { return inner->connectionId(); }
+    std::string dataVersion() override { return inner->dataVersion(); }
+    std::map<std::string, std::string> tableVersions() override { return inner->tableVersions(); }
+    std::string catalogVersion() override { return inner->catalogVersion(); }
+
+    bool executeQuery(const std::string& sql) override;
+    types::TableData query(const std::string& sql) override;
+    size_t stream(const std::string& sql, base::RowSink& sink, const std::atomic<bool>& stop) override;
+    size_t streamTable(const std::string& table, const std::vector<std::string>& columns, base::RowSink& sink,
+                       const std::atomic<bool>& stop) override;
+    size_t streamRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key, const std::string& from,
+                       const std::string& to, base::RowSink& sink, const std::atomic<bool>& stop) override;
+    types::RangeHash hashRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key, const std::string& from,
+                               const std::string& to) override;
+    std::string exportSnapshot() override;
+    void useSnapshot(const std::string& id) override;
+    void releaseSnapshot() override;
+    std::unique_ptr<base::ChangeFeed> watch(const std::vector<std::string>& tables, bool installTriggers) override;
+    std::vector<std::string> listTables() override;
+    std::vector<types::TableSchema> getTables() override;
+    types::TableSchema describe(const std::string& table) override;
+    types::TableData select(const std::string& table, int offset, int limit, const std::vector<std::string>& columns) override;
+    types::TableData seek(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset, int limit,
+                          const std::vector<std::string>& columns, bool hashes) override;
+    types::TableData seekHashes(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                int limit) override;
+    types::TableData selectKeys(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                const std::vector<std::string>& columns) override;
+    std::vector<std::string> pageAnchors(const std::string& table, const std::string& key, int step, const std::atomic<bool>& stop) override;
+    bool editRow(const std::string& table, const std::pair<std::string, std::string>& where,
+                 const std::vector<std::pair<std::string, std::string>>& values) override;
+    bool addRow(const std::string& table, const std::vector<std::pair<std::string, std::string>>& values) override;
+    types::BatchResult addRows(const std::string& table, const types::ColumnBatch& batch, bool continueOnError) override;
+    std::unique_ptr<base::BulkLoader> bulkLoad(const std::string& table, const std::vector<std::string>& columns,
+                                               const base::LoadOptions& options) override;
+    bool removeRow(const std::string& table, const std::pair<std::string, std::string>& where) override;
+    size_t removeRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys) override;
+    size_t updateRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                      const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls) override;
+    std::vector<std::string> filterKeys(const std::string& table, const std::string& key, const std::string& where, const std::string& from,
+                                        int limit) override;
+    types::TableData search(const std::string& table, const std::string& column, const std::string& pattern, int limit) override;
+    bool createTable(const types::TableSchema& schema) override;
+    bool dropTable(const std::string& tableName) override;
+    std::string readValue(const std::string& table, const std::pair<std::string, std::string>& where, const types::Column& column, size_t& offset,
+                          size_t length) override;
+    void setPreviewLimit(size_t bytes) override;
+
+ private:
+    std::unique_ptr<base::Database> inner;
+    std::shared_ptr<ResultCache> cache;
+    std::shared_ptr<PageStore> store;
+    std::chrono::milliseconds recheck;
+    std::string scope;
+    // Версия данных, при которой сохранены записи подключения, время её сверки и число изменений через копии на тот момент
+    std::string version;
+    std::chrono::steady_clock::time_point checked{};
+    uint64_t seenChanges = 0;
+    // Версии таблиц для записей на диске, читаются при первом обращении к диску
+    std::map<std::string, std::string> tables;
+    bool tablesRead = false;
+    uint64_t reads = 0;
+
+    // Таблицы, изменённые в этом сеансе; общие для подключения и его копий
+    struct Written {
+        std::mutex mutex;
+        std::set<std::string> tables;
+        // Выполнен executeQuery, изменённые им таблицы неизвестны
+        bool any = false;
+        // Завершённые изменения: копия, увидев новое значение, сверяет версию данных сразу
+        uint64_t changes = 0;
+    };
+    std::shared_ptr<Written> written;
+
+    bool fresh();
+    void invalidate();
+    std::string tableVersion(const std::string& table);
+    // Пусто - произвольный SQL
+    void markWritten(const std::string& table);
+    bool wasWritten(const std::string& table);
+
+    template <typename T, typename F>
+    T remember(const std::string& table, const std::string& key, F&& read);
+    template <typename F>
+    auto change(const std::string& table, F&& call) -> decltype(call());
+    // Вызов со сбросом записей в памяти, без отметки изменённых таблиц
+    template <typename F>
+    auto invalidating(F&& call) -> decltype(call());
+};
+
+}  // namespace cache
@@ -0,0 +1,185 @@
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+
+#include "../json/json.hpp"
+#include "catalog.hpp"
+#include "trace.hpp"
+
+namespace catalog {
+
+Store::Store(std::string dir) : dir(std::move(dir)) {
+    std::error_code ec;
+    std::filesystem::create_directories(this->dir, ec);
+}
+
+std::string Store::path(const std::string& connection) const {
+    std::ostringstream name;
+    name << std::hex << std::hash<std::string>{}(connection) << ".catalog.json";
+    return (std::filesystem::path(dir) / name.str()).string();
+}
+
+bool Store::load(const std::string& connection, std::vector<std::string>& tables, std::string& version) const {
+    TRACE_SPAN("catalog.load");
+    std::ifstream in(path(connection));
+    if (!in)
+        return false;
+
+    // Файлы прежнего вида (таблицы с колонками) не читаются и просто перезаписываются
+    try {
+        nlohmann::json root = nlohmann::json::parse(in);
+        if (root.at("connection").get<std::string>() != connection)
+            return false;
+        auto loaded = root.at("tables").get<std::vector<std::string>>();
+        version = root.at("version").get<std::string>();
+        tables = std::move(loaded);
+        return true;
+    } catch (const nlohmann::json::exception&) {
+        return false;
+    }
+}
+
+void Store::save(const std::string& connection, const std::string& version, const std::vector<std::string>& tables) const {
+    TRACE_SPAN("catalog.save");
+    nlohmann::json root;
+    root["connection"] = connection;
+    root["version"] = version;
+    root["tables"] = tables;
+
+    std::string target = path(connection);
+    std::string temporary = target + ".tmp";
+    {
+        std::ofstream out(temporary);
+        out << root.dump();
+        if (!out)
+            throw std::runtime_error("Failed to write " + temporary);
+    }
+    std::filesystem::rename(temporary, target);
+}
+
+std::string version(base::Database& db) {
+    return db.catalogVersion();
+}
+
+std::vector<std::string> fetch(base::Database& db, const Store* store) {
+    TRACE_SPAN("catalog.fetch");
+    std::string current = store ? version(db) : "";
+    std::vector<std::string> tables = db.listTables();
+    // Без версии сохранённый список нельзя было бы проверить. Сохранение - только ускорение следующего запуска,
+    // поэтому ошибка записи (нет места, нет прав на каталог) не мешает вернуть список
+    if (store && !current.empty()) {
+        try {
+            store->save(db.connectionId(), current, tables);
+        } catch (const std::exception&) {
+        }
+    }
+    return tables;
+}
+
+bool revalidate(base::Database& db, const Store& store, const std::string& version, std::vector<std::string>& tables) {
+    TRACE_SPAN("catalog.revalidate");
+    std::string current = catalog::version(db);
+    if (!current.empty() && current == version)
+        return false;
+    tables = fetch(db, &store);
+    return true;
+}
+
+namespace {
+
+bool boundary(char c) {
+    return c == '.' || c == '_' || c == '-' || c == ' ';
+}
+
+}  // namespace
+
+NameIndex::NameIndex(const std::vector<std::string>& list) {
+    size_t total = 0;
+    for (const auto& name : list) {
+        total += name.size();
+    }
+    names.reserve(total);
+    offsets.reserve(list.size() + 1);
+    for (const auto& name : list) {
+        offsets.push_back(names.size());
+        for (char c : name) {
+            names.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+        }
+    }
+    offsets.push_back(names.size());
+}
+
+int NameIndex::score(size_t index, const std::string& query) const {
+    std::string_view name(names.data() + offsets[index], offsets[index + 1] - offsets[index]);
+    int result = 0;
+    size_t previous = std::string_view::npos;
+    size_t from = 0;
+    for (char c : query) {
+        size_t at = name.find(c, from);
+        if (at == std::string_view::npos)
+            return -1;
+        result += 1;
+        if (previous != std::string_view::npos && at == previous + 1)
+            result += 5;
+        if (at == 0 || boundary(name[at - 1]))
+            result += 8;
+        previous = at;
+        from = at + 1;
+    }
+
+    size_t substring = name.find(query);
+    if (substring != std::string_view::npos) {
+        result += 3 * static_cast<int>(query.size());
+        if (substring == 0 || boundary(name[substring - 1]))
+            result += 10;
+    }
+    // При прочих равных короче - ближе к запросу
+    return result * 64 - static_cast<int>(std::min<size_t>(name.size(), 63));
+}
+
+const std::vector<size_t>& NameIndex::filter(const std::string& text) {
+    std::string query;
+    for (char c : text) {
+        query.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+    }
+
+    // Продолжение предыдущего запроса подходит только к его совпадениям
+    bool narrowing = filtered && !last.empty() && query.compare(0, last.size(), last) == 0;
+    std::vector<size_t> candidates;
+    if (narrowing) {
+        candidates = std::move(matches);
+    } else {
+        candidates.resize(size());
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            candidates[i] = i;
+        }
+    }
+    last = query;
+    filtered = true;
+
+    if (query.empty()) {
+        matches = std::move(candidates);
+        return matches;
+    }
+
+    std::vector<std::pair<int, size_t>> scored;
+    for (size_t index : candidates) {
+        int value = score(index, query);
+        if (value >= 0)
+            scored.emplace_back(-value, index);
+    }
+    std::sort(scored.begin(), scored.end());
+
+    matches.clear();
+    matches.reserve(scored.size());
+    for (const auto& entry : scored) {
+        matches.push_back(entry.second);
+    }
+    return matches;
+}
+
+}  // namespace catalog
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "base.hpp"
+
+namespace catalog {
+
+// Названия таблиц между запусками: файл JSON на подключение вместе с версией списка
+// (catalogVersion: schema_version файла SQLite или отпечаток каталога PostgreSQL)
+class Store {
+ public:
+    explicit Store(std::string dir);
+
+    // false, если сохранённого списка нет или файл не читается
+    bool load(const std::string& connection, std::vector<std::string>& tables, std::string& version) const;
+    // Через временный файл, чтобы прерывание не испортило прежний список
+    void save(const std::string& connection, const std::string& version, const std::vector<std::string>& tables) const;
+
+ private:
+    std::string dir;
+
+    std::string path(const std::string& connection) const;
+};
+
+// Версия списка таблиц (пусто - подключение её не поддерживает)
+std::string version(base::Database& db);
+
+// Названия из базы (listTables, колонки не читаются) с сохранением в store (если он задан, ошибки записи пропускаются).
+// Версия читается до списка: изменение между запросами приведёт к лишней проверке при следующем запуске, а не к устаревшему списку
+std::vector<std::string> fetch(base::Database& db, const Store* store);
+
+// Проверка сохранённого списка: если версия изменилась, в tables - свежий список и возвращается true
+bool revalidate(base::Database& db, const Store& store, const std::string& version, std::vector<std::string>& tables);
+
+// Нечёткий поиск по названиям: символы запроса должны встречаться в названии по порядку. Выше ставятся подстроки,
+// подряд идущие символы и совпадения в начале названия или после «.», «_», «-», пробела. Названия приводятся
+// к нижнему регистру один раз при построении (только ASCII). Запрос, продолжающий предыдущий, проверяется
+// только по его совпадениям, поэтому ввод по символу не перебирает весь список заново
+class NameIndex {
+ public:
+    NameIndex() = default;
+    explicit NameIndex(const std::vector<std::string>& names);
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    // Номера подходящих названий: лучшие первыми, при равной оценке - в исходном порядке. Пустой запрос - все по порядку
+    const std::vector<size_t>& filter(const std::string& query);
+
+ private:
+    // Названия подряд, offsets[i] - начало i-го, последний элемент - конец буфера
+    std::string names;
+    std::vector<size_t> offsets;
+    std::string last;
+    bool filtered = false;
+    std::vector<size_t> matches;
+
+    // -1, если название не подходит
+    int score(size_t index, const std::string& query) const;
+};
+
+}  // namespace catalog
@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <stdexcept>
+
+#include "diff.hpp"
+#include "trace.hpp"
+
+namespace diff {
+
+namespace {
+
+// Строки куска по ключу (первая колонка). Логические t/f PostgreSQL приводятся к 1/0, как при копировании в SQLite
+class RowMap : public base::RowSink {
+ public:
+    explicit RowMap(std::vector<bool> booleans) : booleans(std::move(booleans)) {}
+
+    void begin(const std::vector<types::Column>&) override {}
+
+    void row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) override {
+        Row row{{values.begin(), values.end()}, nulls};
+        for (size_t i = 0; i < row.values.size() && i < booleans.size(); ++i) {
+            if (booleans[i] && !nulls[i])
+                row.values[i] = row.values[i] == "t" ? "1" : row.values[i] == "f" ? "0" : row.values[i];
+        }
+        rows.emplace(row.values[0], std::move(row));
+    }
+
+    std::map<std::string, Row> rows;
+
+ private:
+    std::vector<bool> booleans;
+};
+
+// Логические колонки PostgreSQL среди выбираемых
+std::vector<bool> booleanColumns(base::Database& db, const std::string& table, const std::vector<std::string>& columns) {
+    std::vector<types::Column> described = db.describe(table).columns;
+    std::vector<bool> booleans;
+    for (const auto& name : columns) {
+        auto it = std::find_if(described.begin(), described.end(), [&name](const types::Column& c) { return c.name == name; });
+        booleans.push_back(it != described.end() && it->type == "boolean");
+    }
+    return booleans;
+}
+
+class Comparer {
+ public:
+    Comparer(base::Database& left, base::Database& right, const std::string& table, const std::string& rightTable, std::string key,
+             std::vector<std::string> columns, const Options& options, const Visitor& visit, Report& report, const std::atomic<bool>& stop)
+        : left(left),
+          right(right),
+          table(table),
+          rightTable(rightTable),
+          key(std::move(key)),
+          columns(std::move(columns)),
+          options(options),
+          visit(visit),
+          report(report),
+          stop(stop),
+          leftBooleans(booleanColumns(left, table, this->columns)),
+          rightBooleans(booleanColumns(right, rightTable, this->columns)) {}
+
+    void compare(const std::string& from, const std::string& to) {
+        if (stop) {
+            report.interrupted = true;
+            return;
+        }
+        types::RangeHash leftHash = left.hashRange(table, columns, key, from, to);
+        types::RangeHash rightHash = right.hashRange(rightTable, columns, key, from, to);
+        report.hashes += 2;
+        if (leftHash == rightHash)
+            return;
+
+        size_t rows = std::max(leftHash.rows, rightHash.rows);
+        std::string middle;
+        if (rows > static_cast<size_t>(options.leafRows)) {
+            // Середина берётся по стороне, где строк больше: там деление точно продвигается
+            base::Database& db = leftHash.rows >= rightHash.rows ? left : right;
+            types::TableData found = db.seek(&db == &left ? table : rightTable, key, from, true, static_cast<int>(rows / 2), 1, {key}, false);
+            if (!found.data.empty())
+                middle = found.data[0][0];
+        }
+        if (middle.empty() || middle == from) {
+            compareRows(from, to);
+            return;
+        }
+        compare(from, middle);
+        compare(middle, to);
+    }
+
+ private:
+    base::Database& left;
+    base::Database& right;
+    const std::string& table;
+    const std::string& rightTable;
+    std::string key;
+    std::vector<std::string> columns;
+    const Options& options;
+    const Visitor& visit;
+    Report& report;
+    const std::atomic<bool>& stop;
+    std::vector<bool> leftBooleans;
+    std::vector<bool> rightBooleans;
+
+    void compareRows(const std::string& from, const std::string& to) {
+        TRACE_SPAN("diff.compareRows");
+        RowMap leftRows(leftBooleans), rightRows(rightBooleans);
+        left.streamRange(table, columns, key, from, to, leftRows, stop);
+        right.streamRange(rightTable, columns, key, from, to, rightRows, stop);
+        // Прерванное чтение отдаёт часть строк, и сверка выдала бы ложные Missing и Extra
+        if (stop) {
+            report.interrupted = true;
+            return;
+        }
+        report.fetched += leftRows.rows.size() + rightRows.rows.size();
+
+        auto l = leftRows.rows.begin();
+        auto r = rightRows.rows.begin();
+        while (l != leftRows.rows.end() || r != rightRows.rows.end()) {
+            if (r == rightRows.rows.end() || (l != leftRows.rows.end() && l->first < r->first)) {
+                ++report.missing;
+                visit(Change::Missing, l->second, {});
+                ++l;
+            } else if (l == leftRows.rows.end() || r->first < l->first) {
+                ++report.extra;
+                visit(Change::Extra, {}, r->second);
+                ++r;
+            } else {
+                if (!(l->second == r->second)) {
+                    ++report.changed;
+                    visit(Change::Changed, l->second, r->second);
+                }
+                ++l;
+                ++r;
+            }
+        }
+    }
+};
+
+}  // namespace
+
+std::vector<std::string> comparedColumns(const types::TableSchema& schema, const Options& options) {
+    std::vector<std::string> columns{schema.rowKey};
+    if (options.columns.empty()) {
+        for (const auto& column : schema.columns) {
+            if (column.name != schema.rowKey)
+                columns.push_back(column.name);
+        }
+    } else {
+        for (const auto& column : options.columns) {
+            if (column != schema.rowKey)
+                columns.push_back(column);
+        }
+    }
+    return columns;
+}
+
+Report compareTables(base::Database& left, base::Database& right, const std::string& table, const std::string& rightTable,
+                     const Options& options, const Visitor& visit, const Progress& progress, const std::atomic<bool>& stop) {
+    TRACE_SPAN("diff.compareTables");
+    auto started = std::chrono::steady_clock::now();
+    Report report;
+
+    types::TableSchema schema = left.describe(table);
+    if (schema.rowKey.empty())
+        throw std::runtime_error("Table " + table + " has no key column");
+
+    std::vector<std::string> columns = comparedColumns(schema, options);
+
+    // Границы кусков - якоря левой таблицы; крайние куски открыты, чтобы захватить строки правой вне её диапазона
+    std::vector<std::string> anchors = left.pageAnchors(table, schema.rowKey, std::max(options.chunkRows, 1), stop);
+    std::vector<std::string> bounds{""};
+    for (size_t i = 1; i < anchors.size(); ++i) {
+        bounds.push_back(anchors[i]);
+    }
+    bounds.push_back("");
+
+    Comparer comparer(left, right, table, rightTable, schema.rowKey, columns, options, visit, report, stop);
+    report.chunks = bounds.size() - 1;
+    size_t done = 0;
+    for (; done < report.chunks && !stop; ++done) {
+        comparer.compare(bounds[done], bounds[done + 1]);
+        if (progress)
+            progress(done + 1, report.chunks);
+    }
+    if (done < report.chunks)
+        report.interrupted = true;
+
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+}  // namespace diff
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+#include "base.hpp"
+
+namespace diff {
+
+struct Options {
+    // Строк в начальном куске (шаг якорей по ключу левой таблицы) и в куске, строки которого сравниваются напрямую
+    int chunkRows = 100000;
+    int leafRows = 1000;
+    // Сравниваемые колонки, пусто - все колонки левой таблицы
+    std::vector<std::string> columns;
+};
+
+enum class Change {
+    // Строка есть только слева
+    Missing,
+    // Строка есть только справа
+    Extra,
+    // Строки с одним ключом различаются
+    Changed,
+};
+
+struct Report {
+    size_t chunks = 0;
+    // Запросов сводок по обеим сторонам и строк, переданных для сравнения
+    size_t hashes = 0;
+    size_t fetched = 0;
+    size_t missing = 0;
+    size_t extra = 0;
+    size_t changed = 0;
+    double seconds = 0;
+    // Остановлено до сравнения всех кусков: найдены не все отличия
+    bool interrupted = false;
+
+    size_t differences() const { return missing + extra + changed; }
+};
+
+// Строка в текстовом виде; NULL отмечается отдельно, чтобы не путать его со строкой "NULL"
+struct Row {
+    std::vector<std::string> values;
+    std::vector<bool> nulls;
+
+    bool operator==(const Row& other) const { return values == other.values && nulls == other.nulls; }
+};
+
+// Колонки строк, передаваемых Visitor: ключ, затем остальные сравниваемые
+std::vector<std::string> comparedColumns(const types::TableSchema& schema, const Options& options);
+
+// Для Changed передаются обе строки, для Missing и Extra - одна, другая пуста
+using Visitor = std::function<void(Change change, const Row& left, const Row& right)>;
+using Progress = std::function<void(size_t done, size_t total)>;
+
+// Сравнение таблиц двух подключений по ключу левой таблицы. Куски сравниваются сводками, которые считает сервер,
+// несовпавшие делятся пополам по ключу, пока не станут меньше leafRows; только их строки передаются клиенту.
+// Значения сравниваются в текстовом виде, поэтому числа с плавающей точкой и numeric могут различаться записью
+Report compareTables(base::Database& left, base::Database& right, const std::string& table, const std::string& rightTable,
+                     const Options& options, const Visitor& visit, const Progress& progress, const std::atomic<bool>& stop);
+
+}  // namespace diff
@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "../json/json.hpp"
+#include "dump.hpp"
+#include "trace.hpp"
+
+namespace dump {
+
+namespace {
+
+const unsigned MAX_THREADS = 8;
+const char* MANIFEST = "dump.json";
+
+struct Part {
+    std::string table;
+    std::string file;
+    // Диапазон from <= key < to, пустой key - вся таблица
+    std::string key;
+    std::string from;
+    std::string to;
+    bool done = false;
+};
+
+const char* extension(writer::Format format) {
+    switch (format) {
+        case writer::Format::Csv:
+            return ".csv";
+        case writer::Format::JsonLines:
+            return ".jsonl";
+        case writer::Format::JsonArray:
+            return ".json";
+        case writer::Format::Sql:
+            return ".sql";
+    }
+    return "";
+}
+
+// Первичный ключ объявляется отдельным ограничением, чтобы составной ключ не превращался в несколько PRIMARY KEY
+std::string createStatement(const types::TableSchema& schema, bool postgres) {
+    std::string sql = "CREATE TABLE " + base::quoteTable(schema.title, postgres) + " (";
+    std::string key;
+    for (size_t i = 0; i < schema.columns.size(); ++i) {
+        const auto& column = schema.columns[i];
+        sql += (i == 0 ? "" : ", ") + base::quoteName(column.name) + " " + column.type;
+        if (!column.nullable)
+            sql += " NOT NULL";
+        if (column.primary_key)
+            key += (key.empty() ? "" : ", ") + base::quoteName(column.name);
+    }
+    if (!key.empty())
+        sql += ", PRIMARY KEY (" + key + ")";
+    return sql + ");\n";
+}
+
+// Имя файла из имени таблицы без разделителей пути
+std::string fileName(const std::string& table) {
+    std::string name = table;
+    std::replace_if(name.begin(), name.end(), [](char c) { return c == '/' || c == '\\'; }, '_');
+    return name;
+}
+
+class Manifest {
+ public:
+    Manifest(std::filesystem::path path, writer::Format format) : path(std::move(path)), format(format) {}
+
+    bool load() {
+        std::ifstream in(path);
+        if (!in)
+            return false;
+        nlohmann::json root = nlohmann::json::parse(in);
+        if (root.at("format").get<int>() != static_cast<int>(format))
+            throw std::runtime_error("Dump in " + path.parent_path().string() + " was started in another format");
+        for (const auto& item : root.at("parts")) {
+            parts.push_back({item.at("table"), item.at("file"), item.at("key"), item.at("from"), item.at("to"), item.at("done")});
+        }
+        return true;
+    }
+
+    // Через временный файл, чтобы прерывание не оставило недописанный план
+    void save() {
+        nlohmann::json root;
+        root["format"] = static_cast<int>(format);
+        nlohmann::json& items = root["parts"] = nlohmann::json::array();
+        for (const auto& part : parts) {
+            items.push_back({{"table", part.table}, {"file", part.file}, {"key", part.key}, {"from", part.from}, {"to", part.to}, {"done", part.done}});
+        }
+        std::filesystem::path temporary = path;
+        temporary += ".tmp";
+        {
+            std::ofstream out(temporary);
+            out << root.dump(1);
+            if (!out)
+                throw std::runtime_error("Failed to write " + temporary.string());
+        }
+        std::filesystem::rename(temporary, path);
+    }
+
+    std::vector<Part> parts;
+
+ private:
+    std::filesystem::path path;
+    writer::Format format;
+};
+
+// План: часть на таблицу, для больших таблиц с ключом - часть на каждые splitRows строк по якорям ключа
+void plan(base::Database& db, const Options& options, const std::filesystem::path& directory, Manifest& manifest, const std::atomic<bool>& stop) {
+    TRACE_SPAN("dump.plan");
+    std::ofstream schema(directory / "schema.sql");
+    for (const auto& table : db.listTables()) {
+        types::TableSchema described = db.describe(table);
+        schema << createStatement(described, base::isPostgres(db));
+
+        std::vector<std::string> anchors;
+        if (!described.rowKey.empty() && options.splitRows > 0)
+            anchors = db.pageAnchors(table, described.rowKey, options.splitRows, stop);
+        if (anchors.size() <= 1) {
+            manifest.parts.push_back({table, fileName(table) + extension(options.format), "", "", ""});
+            continue;
+        }
+        for (size_t i = 0; i < anchors.size(); ++i) {
+            char suffix[16];
+            std::snprintf(suffix, sizeof(suffix), ".%04zu", i + 1);
+            manifest.parts.push_back({table, fileName(table) + suffix + extension(options.format), described.rowKey, i == 0 ? "" : anchors[i],
+                                      i + 1 < anchors.size() ? anchors[i + 1] : ""});
+        }
+    }
+    if (!schema)
+        throw std::runtime_error("Failed to write schema.sql");
+}
+
+size_t dumpPart(base::Database& db, const Part& part, const std::filesystem::path& directory, writer::Format format, const std::atomic<bool>& stop) {
+    TRACE_SPAN("dump.part");
+    std::string path = (directory / part.file).string();
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> out(std::fopen(path.c_str(), "wb"), &std::fclose);
+    if (!out)
+        throw std::runtime_error("Failed to open " + path);
+    writer::Writer output(out.get(), format);
+    output.setTable(part.table, base::isPostgres(db));
+    size_t rows = part.key.empty() ? db.streamTable(part.table, {}, output, stop)
+                                   : db.streamRange(part.table, {}, part.key, part.from, part.to, output, stop);
+    output.finish();
+    if (std::ferror(out.get()))
+        throw std::runtime_error("Failed to write " + path);
+    return rows;
+}
+
+}  // namespace
+
+Report dumpDatabase(base::Database& db, const std::string& directory, const Options& options, const Progress& progress,
+                    const std::atomic<bool>& stop) {
+    TRACE_SPAN("dump.database");
+    auto started = std::chrono::steady_clock::now();
+    std::filesystem::path root(directory);
+    std::filesystem::create_directories(root);
+
+    Manifest manifest(root / MANIFEST, options.format);
+    if (!options.resume || !manifest.load()) {
+        plan(db, options, root, manifest, stop);
+        manifest.save();
+    }
+
+    Report report;
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < manifest.parts.size(); ++i) {
+        if (manifest.parts[i].done)
+            ++report.skipped;
+        else
+            pending.push_back(i);
+    }
+    report.parts = manifest.parts.size();
+    for (size_t i = 0; i < manifest.parts.size(); ++i) {
+        if (i == 0 || manifest.parts[i].table != manifest.parts[i - 1].table)
+            ++report.tables;
+    }
+
+    // Снимок держит отдельное подключение до конца выгрузки
+    std::unique_ptr<base::Database> holder = db.clone();
+    std::string snapshot = holder->exportSnapshot();
+
+    unsigned threads = options.threads != 0 ? options.threads : std::min(MAX_THREADS, std::max(1u, std::thread::hardware_concurrency()));
+    threads = std::max(1u, std::min<unsigned>(threads, static_cast<unsigned>(pending.size())));
+
+    std::mutex mutex;
+    size_t next = 0;
+    size_t done = report.skipped;
+    std::exception_ptr error;
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < threads; ++w) {
+        workers.emplace_back([&] {
+            try {
+                std::unique_ptr<base::Database> worker = db.clone();
+                worker->useSnapshot(snapshot);
+                while (!stop) {
+                    size_t index;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        if (error || next == pending.size())
+                            return;
+                        index = pending[next++];
+                    }
+                    size_t rows = dumpPart(*worker, manifest.parts[index], root, options.format, stop);
+                    if (stop)
+                        return;
+
+                    std::lock_guard<std::mutex> lock(mutex);
+                    manifest.parts[index].done = true;
+                    manifest.save();
+                    report.rows += rows;
+                    if (progress)
+                        progress(++done, manifest.parts.size());
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    holder->releaseSnapshot();
+
+    if (error)
+        std::rethrow_exception(error);
+    report.interrupted = done < manifest.parts.size();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+}  // namespace dump
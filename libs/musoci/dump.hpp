@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+#include "base.hpp"
+#include "writer.hpp"
+
+namespace dump {
+
+struct Options {
+    writer::Format format = writer::Format::Csv;
+    // Подключений-исполнителей, 0 - по числу ядер, но не больше MAX_THREADS
+    unsigned threads = 0;
+    // Таблицы с ключом больше этого числа строк делятся на диапазоны ключа такого размера
+    int splitRows = 1000000;
+    // Продолжить прерванную выгрузку в том же каталоге: готовые части пропускаются
+    bool resume = false;
+};
+
+struct Report {
+    size_t tables = 0;
+    size_t parts = 0;
+    // Части, готовые с прошлого запуска
+    size_t skipped = 0;
+    size_t rows = 0;
+    double seconds = 0;
+    // Остановлена до выгрузки всех частей, продолжить можно с resume
+    bool interrupted = false;
+};
+
+// Готово частей из общего числа
+using Progress = std::function<void(size_t done, size_t total)>;
+
+// Выгрузка всех таблиц в каталог: schema.sql с CREATE TABLE и файл на таблицу (или на диапазон ключа большой таблицы).
+// Части раздаются пулу подключений, все они читают один снимок (exportSnapshot), поэтому выгрузка согласована.
+// План и готовые части записываются в dump.json после каждой части; при resume план берётся оттуда,
+// но оставшиеся части читаются уже из нового снимка
+Report dumpDatabase(base::Database& db, const std::string& directory, const Options& options, const Progress& progress,
+                    const std::atomic<bool>& stop);
+
+}  // namespace dump
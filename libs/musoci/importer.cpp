@@ -0,0 +1,357 @@
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+#include "importer.hpp"
+#include "trace.hpp"
+
+namespace importer {
+
+namespace {
+
+// Строк первого блока для вывода типов
+const size_t INFER_ROWS = 1000;
+
+class MappedFile {
+ public:
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Failed to open " + path);
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Failed to stat " + path);
+        }
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped == MAP_FAILED) {
+                ::close(fd);
+                throw std::runtime_error("Failed to map " + path);
+            }
+            ::madvise(mapped, length, MADV_SEQUENTIAL);
+            bytes = static_cast<const char*>(mapped);
+        }
+        ::close(fd);
+    }
+
+    ~MappedFile() {
+        if (bytes)
+            ::munmap(const_cast<char*>(bytes), length);
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+ private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+};
+
+// Разобранный блок. Значения ссылаются на файл или на owned, если в поле были удвоенные кавычки
+struct Chunk {
+    std::vector<std::string_view> values;
+    std::vector<bool> nulls;
+    // Номер строки файла (от начала блока) для каждой записи
+    std::vector<size_t> lines;
+    std::deque<std::string> owned;
+    std::vector<Diagnostic> bad;
+    size_t newlines = 0;
+    size_t end = 0;
+};
+
+// Конец записи, начинающейся в begin: перевод строки вне кавычек
+size_t recordEnd(const char* data, size_t begin, size_t size) {
+    bool quoted = false;
+    for (size_t i = begin; i < size; ++i) {
+        if (data[i] == '"')
+            quoted = !quoted;
+        else if (data[i] == '\n' && !quoted)
+            return i + 1;
+    }
+    return size;
+}
+
+// Границы блоков по чётности кавычек: перевод строки - граница записи, только если до него чётное число кавычек
+std::vector<std::pair<size_t, size_t>> splitChunks(const char* data, size_t begin, size_t size, size_t chunkBytes) {
+    TRACE_SPAN("import.split");
+    std::vector<std::pair<size_t, size_t>> chunks;
+    bool quoted = false;
+    size_t pos = begin;
+    while (pos < size) {
+        size_t target = std::min(pos + chunkBytes, size);
+        if (std::count(data + pos, data + target, '"') % 2 != 0)
+            quoted = !quoted;
+        size_t end = target;
+        for (; end < size; ++end) {
+            if (data[end] == '"') {
+                quoted = !quoted;
+            } else if (data[end] == '\n' && !quoted) {
+                ++end;
+                break;
+            }
+        }
+        chunks.emplace_back(pos, end);
+        pos = end;
+    }
+    return chunks;
+}
+
+// Разбор записей [begin, end); columns == 0 - без проверки числа полей
+void parse(const char* begin, const char* end, char delimiter, size_t columns, Chunk& chunk) {
+    TRACE_SPAN("import.parse");
+    std::vector<std::string_view> fields;
+    std::vector<bool> nulls;
+    const char* p = begin;
+    size_t line = 0;
+
+    while (p < end) {
+        size_t recordLine = line;
+        const char* recordStart = p;
+        fields.clear();
+        nulls.clear();
+        std::string error;
+
+        while (true) {
+            if (p < end && *p == '"') {
+                const char* start = ++p;
+                std::string* own = nullptr;
+                std::string_view value;
+                while (true) {
+                    auto q = static_cast<const char*>(std::memchr(p, '"', end - p));
+                    if (q == nullptr) {
+                        line += std::count(p, end, '\n');
+                        p = end;
+                        error = "unterminated quoted field";
+                        break;
+                    }
+                    line += std::count(p, q, '\n');
+                    if (q + 1 < end && q[1] == '"') {
+                        if (own == nullptr)
+                            own = &chunk.owned.emplace_back(start, q + 1 - start);
+                        else
+                            own->append(p, q + 1 - p);
+                        p = q + 2;
+                        continue;
+                    }
+                    if (own != nullptr)
+                        own->append(p, q - p);
+                    value = own != nullptr ? std::string_view(*own) : std::string_view(start, q - start);
+                    p = q + 1;
+                    break;
+                }
+                fields.push_back(value);
+                nulls.push_back(false);
+            } else {
+                const char* start = p;
+                while (p < end && *p != delimiter && *p != '\n')
+                    ++p;
+                const char* stop = p;
+                if (stop > start && stop[-1] == '\r')
+                    --stop;
+                fields.emplace_back(start, stop - start);
+                nulls.push_back(stop == start);
+            }
+
+            if (p >= end || !error.empty())
+                break;
+            if (*p == delimiter) {
+                ++p;
+                continue;
+            }
+            if (*p == '\r' && p + 1 < end && p[1] == '\n')
+                ++p;
+            if (*p == '\n') {
+                ++p;
+                ++line;
+                break;
+            }
+            // Мусор после закрывающей кавычки: пропускаем остаток записи
+            error = "unexpected character after quoted field";
+            size_t next = recordEnd(p, 0, end - p);
+            line += std::count(p, p + next, '\n');
+            p += next;
+            break;
+        }
+
+        // Пустые строки пропускаются (в файле из одной колонки это NULL)
+        if (error.empty() && columns != 1 && fields.size() == 1 && nulls[0] && (p - recordStart) <= 2)
+            continue;
+        if (error.empty() && columns != 0 && fields.size() != columns)
+            error = "expected " + std::to_string(columns) + " fields, got " + std::to_string(fields.size());
+        if (!error.empty()) {
+            chunk.bad.push_back({recordLine, error});
+            continue;
+        }
+        chunk.values.insert(chunk.values.end(), fields.begin(), fields.end());
+        chunk.nulls.insert(chunk.nulls.end(), nulls.begin(), nulls.end());
+        chunk.lines.push_back(recordLine);
+    }
+    chunk.newlines = line;
+}
+
+bool isInteger(std::string_view value) {
+    if (value.empty())
+        return false;
+    size_t i = value[0] == '-' || value[0] == '+' ? 1 : 0;
+    if (i == value.size() || value.size() - i > 18)
+        return false;
+    return std::all_of(value.begin() + i, value.end(), [](unsigned char c) { return std::isdigit(c); });
+}
+
+bool isReal(std::string_view value) {
+    std::string text(value);
+    char* tail = nullptr;
+    std::strtod(text.c_str(), &tail);
+    return tail != text.c_str() && *tail == '\0' && text.find_first_of("xXnN") == std::string::npos;
+}
+
+// BIGINT, DOUBLE PRECISION или TEXT по первым строкам; имена типов понятны и SQLite, и PostgreSQL
+std::string inferType(const Chunk& chunk, size_t column, size_t columns) {
+    size_t rows = std::min(chunk.lines.size(), INFER_ROWS);
+    bool integer = true, real = true, any = false;
+    for (size_t r = 0; r < rows; ++r) {
+        size_t index = r * columns + column;
+        if (chunk.nulls[index])
+            continue;
+        any = true;
+        std::string_view value = chunk.values[index];
+        integer = integer && isInteger(value);
+        real = real && (integer || isReal(value));
+    }
+    if (!any)
+        return "TEXT";
+    return integer ? "BIGINT" : real ? "DOUBLE PRECISION" : "TEXT";
+}
+
+}  // namespace
+
+Report importCsv(base::Database& db, const std::string& path, const std::string& table, const Options& options, const Progress& progress,
+                 const std::atomic<bool>& stop) {
+    TRACE_SPAN("import.csv");
+    auto started = std::chrono::steady_clock::now();
+    MappedFile file(path);
+    const char* data = file.data();
+    size_t size = file.size();
+
+    // Заголовок или первая запись задают число колонок
+    size_t firstEnd = recordEnd(data, 0, size);
+    Chunk first;
+    parse(data, data + firstEnd, options.delimiter, 0, first);
+    size_t columns = first.lines.empty() ? 0 : first.values.size();
+    if (columns == 0)
+        throw std::runtime_error("No records in " + path);
+
+    std::vector<std::string> names;
+    for (size_t i = 0; i < columns; ++i) {
+        names.push_back(options.header ? std::string(first.values[i]) : "column" + std::to_string(i + 1));
+    }
+    size_t dataBegin = options.header ? firstEnd : 0;
+    size_t lineBase = options.header ? 1 + first.newlines : 1;
+
+    types::TableSchema existing = db.describe(table);
+    if (!existing.columns.empty()) {
+        if (!options.header) {
+            if (existing.columns.size() < columns)
+                throw std::runtime_error("Table " + table + " has fewer columns than the file");
+            for (size_t i = 0; i < columns; ++i) {
+                names[i] = existing.columns[i].name;
+            }
+        }
+        for (const auto& name : names) {
+            auto it = std::find_if(existing.columns.begin(), existing.columns.end(), [&name](const types::Column& c) { return c.name == name; });
+            if (it == existing.columns.end())
+                throw std::runtime_error("Unknown column " + name + " in table " + table);
+        }
+    }
+
+    unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::pair<size_t, size_t>> chunks = splitChunks(data, dataBegin, size, options.chunkBytes);
+
+    // Разбор идёт впереди писателя не больше чем на 2 блока на поток, чтобы не держать весь файл в памяти
+    std::deque<std::future<Chunk>> pending;
+    size_t next = 0;
+    auto launch = [&] {
+        while (pending.size() < threads * 2 && next < chunks.size()) {
+            auto [begin, end] = chunks[next++];
+            pending.push_back(std::async(std::launch::async, [data, begin = begin, end = end, &options, columns] {
+                Chunk chunk;
+                parse(data + begin, data + end, options.delimiter, columns, chunk);
+                chunk.end = end;
+                return chunk;
+            }));
+        }
+    };
+    launch();
+
+    Report report;
+    auto diagnose = [&report, &options](size_t line, const std::string& message) {
+        ++report.badLines;
+        if (report.diagnostics.size() < options.maxDiagnostics)
+            report.diagnostics.push_back({line, message});
+    };
+
+    std::unique_ptr<base::BulkLoader> loader;
+    auto open = [&](const Chunk& sample) {
+        if (existing.columns.empty()) {
+            types::TableSchema schema{table, {}};
+            for (size_t i = 0; i < columns; ++i) {
+                auto type = options.types.find(names[i]);
+                schema.columns.emplace_back(names[i], true, false, type != options.types.end() ? type->second : inferType(sample, i, columns));
+            }
+            if (!db.createTable(schema))
+                throw std::runtime_error("Failed to create table " + table);
+        }
+        loader = db.bulkLoad(table, names, base::LoadOptions{});
+    };
+
+    std::vector<std::string_view> values(columns);
+    std::vector<bool> nulls(columns);
+    while (!pending.empty() && !stop) {
+        Chunk chunk = pending.front().get();
+        pending.pop_front();
+        launch();
+        if (!loader)
+            open(chunk);
+
+        TRACE_SPAN("import.write");
+        for (const auto& bad : chunk.bad) {
+            diagnose(lineBase + bad.line, bad.message);
+        }
+        for (size_t r = 0; r < chunk.lines.size(); ++r) {
+            std::copy_n(chunk.values.begin() + r * columns, columns, values.begin());
+            std::copy_n(chunk.nulls.begin() + r * columns, columns, nulls.begin());
+            try {
+                loader->row(values, nulls);
+            } catch (const std::exception& e) {
+                diagnose(lineBase + chunk.lines[r], e.what());
+            }
+        }
+        lineBase += chunk.newlines;
+        if (progress)
+            progress(chunk.end, size);
+    }
+    if (stop)
+        return report;
+
+    if (!loader)
+        open(Chunk{});
+    report.rows = loader->finish();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+}  // namespace importer
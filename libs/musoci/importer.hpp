@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <map>
+
+#include "base.hpp"
+
+namespace importer {
+
+struct Options {
+    char delimiter = ',';
+    bool header = true;
+    // Потоков разбора, 0 - по числу ядер
+    unsigned threads = 0;
+    // Явные типы колонок по имени, остальные выводятся по первому блоку
+    std::map<std::string, std::string> types;
+    // Размер блока файла для одной задачи разбора
+    size_t chunkBytes = 8 << 20;
+    size_t maxDiagnostics = 100;
+};
+
+struct Diagnostic {
+    size_t line = 0;
+    std::string message;
+};
+
+struct Report {
+    size_t rows = 0;
+    size_t badLines = 0;
+    double seconds = 0;
+    std::vector<Diagnostic> diagnostics;
+
+    double rowsPerSecond() const { return seconds > 0 ? rows / seconds : 0; }
+};
+
+// Вызывается писателем после каждого блока: разобрано байт из общего размера файла
+using Progress = std::function<void(size_t done, size_t total)>;
+
+// Загрузка CSV в таблицу (создаётся, если её нет). Файл отображается в память и режется на блоки
+// по границам записей, блоки разбираются параллельно, вставляет один писатель через bulkLoad.
+// Пустое поле без кавычек - NULL, "" - пустая строка. После stop загрузка откатывается
+Report importCsv(base::Database& db, const std::string& path, const std::string& table, const Options& options, const Progress& progress,
+                 const std::atomic<bool>& stop);
+
+}  // namespace importer
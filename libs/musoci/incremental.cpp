@@ -0,0 +1,132 @@
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "../json/json.hpp"
+#include "incremental.hpp"
+#include "trace.hpp"
+
+namespace incremental {
+
+namespace {
+
+// Литерал в виде, общем для SQLite и PostgreSQL
+std::string literal(const std::string& value) {
+    std::string quoted = "'";
+    for (char c : value) {
+        quoted += c;
+        if (c == '\'')
+            quoted += c;
+    }
+    return quoted + "'";
+}
+
+// Колонка отметки выбирается последней сверх остальных (rowid в * не входит) и отрезается перед передачей дальше.
+// Запоминается последнее непустое значение; строки идут по её возрастанию
+class WatermarkSink : public base::RowSink {
+ public:
+    explicit WatermarkSink(base::RowSink& inner) : inner(inner) {}
+
+    void begin(const std::vector<types::Column>& columns) override {
+        inner.begin(std::vector<types::Column>(columns.begin(), columns.end() - 1));
+    }
+
+    void row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) override {
+        if (!nulls.back())
+            last.assign(values.back());
+        rowValues.assign(values.begin(), values.end() - 1);
+        rowNulls.assign(nulls.begin(), nulls.end() - 1);
+        inner.row(rowValues, rowNulls);
+    }
+
+    std::string last;
+
+ private:
+    base::RowSink& inner;
+    std::vector<std::string_view> rowValues;
+    std::vector<bool> rowNulls;
+};
+
+}  // namespace
+
+State::State(std::string path) : path(std::move(path)) {
+    std::ifstream in(this->path);
+    if (!in)
+        return;
+    nlohmann::json root = nlohmann::json::parse(in);
+    for (auto it = root.begin(); it != root.end(); ++it) {
+        watermarks[it.key()] = it.value().get<std::string>();
+    }
+}
+
+std::string State::get(const std::string& id) const {
+    auto it = watermarks.find(id);
+    return it != watermarks.end() ? it->second : "";
+}
+
+void State::set(const std::string& id, const std::string& watermark) {
+    watermarks[id] = watermark;
+}
+
+void State::save() const {
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary);
+        out << nlohmann::json(watermarks).dump(2);
+        if (!out)
+            throw std::runtime_error("Failed to write " + temporary);
+    }
+    std::filesystem::rename(temporary, path);
+}
+
+std::string State::id(const base::Database& db, const std::string& table, const Options& options) {
+    const char* modes[] = {"key", "column", "xmin"};
+    return db.connectionId() + "/" + table + "/" + modes[static_cast<int>(options.mode)] + (options.column.empty() ? "" : ":" + options.column);
+}
+
+Options parseWatermark(const std::string& spec) {
+    if (spec == "key")
+        return {Watermark::Key, ""};
+    if (spec == "xmin")
+        return {Watermark::Xmin, ""};
+    if (spec.rfind("column:", 0) == 0 && spec.size() > 7)
+        return {Watermark::Column, spec.substr(7)};
+    throw std::runtime_error("Unknown watermark: " + spec);
+}
+
+Report exportChanges(base::Database& db, const std::string& table, const Options& options, const std::string& since, base::RowSink& sink,
+                     const std::atomic<bool>& stop) {
+    TRACE_SPAN("incremental.export");
+    auto started = std::chrono::steady_clock::now();
+    Report report;
+    report.since = since;
+
+    if (options.mode == Watermark::Xmin) {
+        if (!base::isPostgres(db))
+            throw std::runtime_error("xmin watermark requires PostgreSQL");
+        // Отметка берётся до чтения: транзакции, ещё не завершённые к этому моменту, попадут в следующий запуск.
+        // xmin 32-битный, поэтому сравнивается возраст, а не само значение
+        report.next = db.query("SELECT (txid_snapshot_xmin(txid_current_snapshot()) % 4294967296)::text;").data.at(0).at(0);
+        std::string sql = "SELECT * FROM " + base::quoteTable(db, table);
+        if (!since.empty())
+            sql += " WHERE age(xmin) <= age(" + literal(since) + "::xid)";
+        report.rows = db.stream(sql, sink, stop);
+    } else {
+        std::string column = options.column;
+        if (column.empty() && options.mode == Watermark::Key)
+            column = db.describe(table).rowKey;
+        if (column.empty())
+            throw std::runtime_error("Table " + table + " has no watermark column");
+        std::string sql = "SELECT *, " + base::quoteName(column) + " FROM " + base::quoteTable(db, table);
+        if (!since.empty())
+            sql += " WHERE " + base::quoteName(column) + (options.mode == Watermark::Key ? " > " : " >= ") + literal(since);
+        WatermarkSink tracker(sink);
+        report.rows = db.stream(sql + " ORDER BY " + base::quoteName(column), tracker, stop);
+        report.next = tracker.last.empty() ? since : tracker.last;
+    }
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+}  // namespace incremental
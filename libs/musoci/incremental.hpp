@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+
+#include "base.hpp"
+
+namespace incremental {
+
+// По чему отбираются изменившиеся строки
+enum class Watermark {
+    // Монотонный ключ: только новые строки
+    Key,
+    // Колонка времени изменения (updated_at): новые и изменённые строки
+    Column,
+    // Системная колонка xmin PostgreSQL: новые и изменённые строки без отдельной колонки
+    Xmin,
+};
+
+struct Options {
+    Watermark mode = Watermark::Key;
+    // Колонка для Key (пусто - ключ таблицы) и Column
+    std::string column;
+};
+
+struct Report {
+    size_t rows = 0;
+    // Отметка, с которой шла выгрузка (пусто - первая, полная), и отметка для следующего запуска
+    std::string since;
+    std::string next;
+    double seconds = 0;
+};
+
+// Отметки по таблицам в локальном файле JSON
+class State {
+ public:
+    explicit State(std::string path);
+
+    std::string get(const std::string& id) const;
+    void set(const std::string& id, const std::string& watermark);
+    // Через временный файл, чтобы прерывание не испортило прежние отметки
+    void save() const;
+
+    // Отметки разных подключений, таблиц и способов отбора не смешиваются
+    static std::string id(const base::Database& db, const std::string& table, const Options& options);
+
+ private:
+    std::string path;
+    std::map<std::string, std::string> watermarks;
+};
+
+// Курсором передаёт в sink строки, изменившиеся после отметки since (пустая - вся таблица).
+// Отметку report.next нужно сохранять только после того, как вывод sink записан. Удаления не отслеживаются.
+// Колонка Column отбирается включительно, поэтому строки с отметкой на границе приходят повторно.
+// Для Key и Column объём работы пропорционален изменениям при индексе на колонке; xmin не индексируется,
+// таблица просматривается целиком, но передаются только изменения
+Report exportChanges(base::Database& db, const std::string& table, const Options& options, const std::string& since, base::RowSink& sink,
+                     const std::atomic<bool>& stop);
+
+// key, xmin или column:ИМЯ
+Options parseWatermark(const std::string& spec);
+
+}  // namespace incremental
@@ -0,0 +1,375 @@
+#include <algorithm>
+
+#include "../json/json.hpp"
+#include "metrics.hpp"
+#include "trace.hpp"
+
+namespace metrics {
+
+namespace {
+
+// Объём результата для учёта строк и байт
+void account(const types::TableData& data, uint64_t& rows, uint64_t& bytes) {
+    rows = data.data.size();
+    bytes = data.byteSize();
+}
+
+void account(const std::vector<types::TableSchema>& tables, uint64_t& rows, uint64_t&) {
+    rows = tables.size();
+}
+
+void account(const types::TableSchema& schema, uint64_t& rows, uint64_t&) {
+    rows = schema.columns.size();
+}
+
+void account(const std::vector<std::string>& values, uint64_t& rows, uint64_t& bytes) {
+    rows = values.size();
+    for (const auto& value : values) {
+        bytes += value.size();
+    }
+}
+
+void account(const std::map<std::string, std::string>& values, uint64_t& rows, uint64_t& bytes) {
+    rows = values.size();
+    for (const auto& [name, value] : values) {
+        bytes += name.size() + value.size();
+    }
+}
+
+void account(const std::string& value, uint64_t&, uint64_t& bytes) {
+    bytes = value.size();
+}
+
+void account(bool, uint64_t&, uint64_t&) {}
+
+void account(const types::BatchResult& result, uint64_t& rows, uint64_t&) {
+    rows = result.inserted;
+}
+
+void account(const types::RangeHash& hash, uint64_t& rows, uint64_t& bytes) {
+    rows = hash.rows;
+    bytes = hash.hash.size();
+}
+
+// Потоковое чтение возвращает только число строк
+void account(size_t count, uint64_t& rows, uint64_t&) {
+    rows = count;
+}
+
+bool failed(bool result) {
+    return !result;
+}
+
+bool failed(const types::BatchResult& result) {
+    return !result.errors.empty();
+}
+
+template <typename T>
+bool failed(const T&) {
+    return false;
+}
+
+// Загрузка учитывается целиком: от создания до finish, вместе со всеми строками
+class MeteredLoader : public base::BulkLoader {
+ public:
+    MeteredLoader(std::unique_ptr<base::BulkLoader> inner, std::shared_ptr<Registry> registry)
+        : inner(std::move(inner)), registry(std::move(registry)), started(std::chrono::steady_clock::now()) {}
+
+    ~MeteredLoader() override {
+        if (!finished)
+            registry->record("bulkLoad", elapsed(), rows, bytes, true);
+    }
+
+    void row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) override {
+        inner->row(values, nulls);
+        ++rows;
+        for (const auto& value : values) {
+            bytes += value.size();
+        }
+    }
+
+    size_t finish() override {
+        finished = true;
+        try {
+            size_t written = inner->finish();
+            registry->record("bulkLoad", elapsed(), written, bytes, false);
+            return written;
+        } catch (...) {
+            registry->record("bulkLoad", elapsed(), rows, bytes, true);
+            throw;
+        }
+    }
+
+ private:
+    std::unique_ptr<base::BulkLoader> inner;
+    std::shared_ptr<Registry> registry;
+    std::chrono::steady_clock::time_point started;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    bool finished = false;
+
+    uint64_t elapsed() const {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+    }
+};
+
+}  // namespace
+
+size_t Histogram::bucketOf(uint64_t value) {
+    if (value < SUB_BUCKETS)
+        return static_cast<size_t>(value);
+    int magnitude = 63 - __builtin_clzll(value);  // старший бит
+    int shift = magnitude - 4;                     // log2(SUB_BUCKETS)
+    size_t index = static_cast<size_t>(shift + 1) * SUB_BUCKETS + ((value >> shift) - SUB_BUCKETS);
+    return std::min(index, static_cast<size_t>(SUB_BUCKETS * MAGNITUDES - 1));
+}
+
+uint64_t Histogram::bucketValue(size_t index) {
+    if (index < SUB_BUCKETS)
+        return index;
+    int shift = static_cast<int>(index / SUB_BUCKETS) - 1;
+    uint64_t sub = index % SUB_BUCKETS + SUB_BUCKETS;
+    // Верхняя граница корзины, чтобы перцентили не занижались
+    return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::record(uint64_t value) {
+    ++buckets[bucketOf(value)];
+    ++total;
+    sum += value;
+    maxValue = std::max(maxValue, value);
+}
+
+uint64_t Histogram::percentile(double p) const {
+    if (total == 0)
+        return 0;
+    uint64_t rank = static_cast<uint64_t>(p / 100.0 * total + 0.5);
+    rank = std::max<uint64_t>(rank, 1);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank)
+            return std::min(bucketValue(i), maxValue);
+    }
+    return maxValue;
+}
+
+void Registry::record(const std::string& operation, uint64_t micros, uint64_t rows, uint64_t bytes, bool failed) {
+    std::lock_guard<std::mutex> lock(mutex);
+    OperationStats& stats = operations[operation];
+    stats.latency.record(micros);
+    ++stats.calls;
+    stats.rows += rows;
+    stats.bytes += bytes;
+    if (failed)
+        ++stats.errors;
+}
+
+std::map<std::string, OperationStats> Registry::snapshot() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return operations;
+}
+
+void Registry::reset() {
+    std::lock_guard<std::mutex> lock(mutex);
+    operations.clear();
+}
+
+std::string Registry::toJson(const std::string& label) const {
+    nlohmann::json root;
+    root["label"] = label;
+    root["timestamp"] = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+    nlohmann::json& ops = root["operations"] = nlohmann::json::object();
+    for (const auto& [name, stats] : snapshot()) {
+        ops[name] = {
+            {"calls", stats.calls},
+            {"errors", stats.errors},
+            {"rows", stats.rows},
+            {"bytes", stats.bytes},
+            {"latency_us",
+             {{"p50", stats.latency.percentile(50)},
+              {"p90", stats.latency.percentile(90)},
+              {"p99", stats.latency.percentile(99)},
+              {"max", stats.latency.max()},
+              {"mean", stats.latency.mean()}}},
+        };
+    }
+    return root.dump(2);
+}
+
+template <typename F>
+auto MeteredDatabase::measure(const char* operation, F&& call) -> decltype(call()) {
+    TRACE_SPAN(operation);
+    auto started = std::chrono::steady_clock::now();
+    auto elapsed = [&started] {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count());
+    };
+
+    try {
+        auto result = call();
+        uint64_t rows = 0, bytes = 0;
+        account(result, rows, bytes);
+        registry->record(operation, elapsed(), rows, bytes, failed(result));
+        return result;
+    } catch (...) {
+        registry->record(operation, elapsed(), 0, 0, true);
+        throw;
+    }
+}
+
+std::unique_ptr<base::Database> MeteredDatabase::clone() const {
+    auto copy = std::make_unique<MeteredDatabase>(inner->clone(), registry);
+    copy->setPreviewLimit(previewLimit);
+    return copy;
+}
+
+std::string MeteredDatabase::dataVersion() {
+    return measure("dataVersion", [&] { return inner->dataVersion(); });
+}
+
+std::map<std::string, std::string> MeteredDatabase::tableVersions() {
+    return measure("tableVersions", [&] { return inner->tableVersions(); });
+}
+
+std::string MeteredDatabase::catalogVersion() {
+    return measure("catalogVersion", [&] { return inner->catalogVersion(); });
+}
+
+bool MeteredDatabase::executeQuery(const std::string& sql) {
+    return measure("executeQuery", [&] { return inner->executeQuery(sql); });
+}
+
+types::TableData MeteredDatabase::query(const std::string& sql) {
+    return measure("query", [&] { return inner->query(sql); });
+}
+
+size_t MeteredDatabase::stream(const std::string& sql, base::RowSink& sink, const std::atomic<bool>& stop) {
+    return measure("stream", [&] { return inner->stream(sql, sink, stop); });
+}
+
+size_t MeteredDatabase::streamTable(const std::string& table, const std::vector<std::string>& columns, base::RowSink& sink,
+                                    const std::atomic<bool>& stop) {
+    return measure("streamTable", [&] { return inner->streamTable(table, columns, sink, stop); });
+}
+
+size_t MeteredDatabase::streamRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key,
+                                    const std::string& from, const std::string& to, base::RowSink& sink, const std::atomic<bool>& stop) {
+    return measure("streamRange", [&] { return inner->streamRange(table, columns, key, from, to, sink, stop); });
+}
+
+types::RangeHash MeteredDatabase::hashRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key,
+                                            const std::string& from, const std::string& to) {
+    return measure("hashRange", [&] { return inner->hashRange(table, columns, key, from, to); });
+}
+
+std::string MeteredDatabase::exportSnapshot() {
+    return measure("exportSnapshot", [&] { return inner->exportSnapshot(); });
+}
+
+void MeteredDatabase::useSnapshot(const std::string& id) {
+    inner->useSnapshot(id);
+}
+
+void MeteredDatabase::releaseSnapshot() {
+    inner->releaseSnapshot();
+}
+
+std::unique_ptr<base::ChangeFeed> MeteredDatabase::watch(const std::vector<std::string>& tables, bool installTriggers) {
+    return inner->watch(tables, installTriggers);
+}
+
+std::vector<std::string> MeteredDatabase::listTables() {
+    return measure("listTables", [&] { return inner->listTables(); });
+}
+
+std::vector<types::TableSchema> MeteredDatabase::getTables() {
+    return measure("getTables", [&] { return inner->getTables(); });
+}
+
+types::TableSchema MeteredDatabase::describe(const std::string& table) {
+    return measure("describe", [&] { return inner->describe(table); });
+}
+
+types::TableData MeteredDatabase::select(const std::string& table, int offset, int limit, const std::vector<std::string>& columns) {
+    return measure("select", [&] { return inner->select(table, offset, limit, columns); });
+}
+
+types::TableData MeteredDatabase::seek(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                       int limit, const std::vector<std::string>& columns, bool hashes) {
+    return measure("seek", [&] { return inner->seek(table, key, from, inclusive, offset, limit, columns, hashes); });
+}
+
+types::TableData MeteredDatabase::seekHashes(const std::string& table, const std::string& key, const std::string& from, bool inclusive,
+                                             int offset, int limit) {
+    return measure("seekHashes", [&] { return inner->seekHashes(table, key, from, inclusive, offset, limit); });
+}
+
+types::TableData MeteredDatabase::selectKeys(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                             const std::vector<std::string>& columns) {
+    return measure("selectKeys", [&] { return inner->selectKeys(table, key, keys, columns); });
+}
+
+std::vector<std::string> MeteredDatabase::pageAnchors(const std::string& table, const std::string& key, int step, const std::atomic<bool>& stop) {
+    return measure("pageAnchors", [&] { return inner->pageAnchors(table, key, step, stop); });
+}
+
+bool MeteredDatabase::editRow(const std::string& table, const std::pair<std::string, std::string>& where,
+                              const std::vector<std::pair<std::string, std::string>>& values) {
+    return measure("editRow", [&] { return inner->editRow(table, where, values); });
+}
+
+bool MeteredDatabase::addRow(const std::string& table, const std::vector<std::pair<std::string, std::string>>& values) {
+    return measure("addRow", [&] { return inner->addRow(table, values); });
+}
+
+types::BatchResult MeteredDatabase::addRows(const std::string& table, const types::ColumnBatch& batch, bool continueOnError) {
+    return measure("addRows", [&] { return inner->addRows(table, batch, continueOnError); });
+}
+
+std::unique_ptr<base::BulkLoader> MeteredDatabase::bulkLoad(const std::string& table, const std::vector<std::string>& columns,
+                                                            const base::LoadOptions& options) {
+    return std::make_unique<MeteredLoader>(inner->bulkLoad(table, columns, options), registry);
+}
+
+size_t MeteredDatabase::removeRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys) {
+    return measure("removeRows", [&] { return inner->removeRows(table, key, keys); });
+}
+
+size_t MeteredDatabase::updateRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                   const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls) {
+    return measure("updateRows", [&] { return inner->updateRows(table, key, keys, values, nulls); });
+}
+
+std::vector<std::string> MeteredDatabase::filterKeys(const std::string& table, const std::string& key, const std::string& where,
+                                                     const std::string& from, int limit) {
+    return measure("filterKeys", [&] { return inner->filterKeys(table, key, where, from, limit); });
+}
+
+bool MeteredDatabase::removeRow(const std::string& table, const std::pair<std::string, std::string>& where) {
+    return measure("removeRow", [&] { return inner->removeRow(table, where); });
+}
+
+types::TableData MeteredDatabase::search(const std::string& table, const std::string& column, const std::string& pattern, int limit) {
+    return measure("search", [&] { return inner->search(table, column, pattern, limit); });
+}
+
+bool MeteredDatabase::createTable(const types::TableSchema& schema) {
+    return measure("createTable", [&] { return inner->createTable(schema); });
+}
+
+bool MeteredDatabase::dropTable(const std::string& tableName) {
+    return measure("dropTable", [&] { return inner->dropTable(tableName); });
+}
+
+std::string MeteredDatabase::readValue(const std::string& table, const std::pair<std::string, std::string>& where, const types::Column& column,
+                                       size_t& offset, size_t length) {
+    return measure("readValue", [&] { return inner->readValue(table, where, column, offset, length); });
+}
+
+void MeteredDatabase::setPreviewLimit(size_t bytes) {
+    previewLimit = bytes;
+    inner->setPreviewLimit(bytes);
+}
+
+}  // namespace metrics
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include "base.hpp"
+
+namespace metrics {
+
+// Гистограмма задержек в микросекундах в духе HDR: логарифмические диапазоны,
+// внутри каждого - линейные корзины. Относительная погрешность не больше 1/SUB_BUCKETS.
+class Histogram {
+ public:
+    void record(uint64_t value);
+    uint64_t percentile(double p) const;
+
+    uint64_t count() const { return total; }
+    uint64_t max() const { return maxValue; }
+    double mean() const { return total == 0 ? 0 : static_cast<double>(sum) / total; }
+
+ private:
+    static const int SUB_BUCKETS = 16;
+    static const int MAGNITUDES = 48;
+
+    std::array<uint64_t, SUB_BUCKETS * MAGNITUDES> buckets{};
+    uint64_t total = 0;
+    uint64_t sum = 0;
+    uint64_t maxValue = 0;
+
+    static size_t bucketOf(uint64_t value);
+    static uint64_t bucketValue(size_t index);
+};
+
+struct OperationStats {
+    Histogram latency;
+    uint64_t calls = 0;
+    uint64_t rows = 0;
+    uint64_t bytes = 0;
+    uint64_t errors = 0;
+};
+
+class Registry {
+ public:
+    void record(const std::string& operation, uint64_t micros, uint64_t rows, uint64_t bytes, bool failed);
+    std::map<std::string, OperationStats> snapshot() const;
+    void reset();
+
+    // Дамп для сравнения сборок и бэкендов
+    std::string toJson(const std::string& label) const;
+
+ private:
+    mutable std::mutex mutex;
+    std::map<std::string, OperationStats> operations;
+};
+
+// Обёртка над подключением, замеряющая каждый вызов
+class MeteredDatabase : public base::Database {
+ public:
+    MeteredDatabase(std::unique_ptr<base::Database> inner, std::shared_ptr<Registry> registry)
+        : inner(std::move(inner)), registry(std::move(registry)) {}
+
+    std::unique_ptr<base::Database> clone() const override;
+    std::string connectionId() const override { return inner->connectionId(); }
+    std::string dataVersion() override;
+    std::map<std::string, std::string> tableVersions() override;
+    std::string catalogVersion() override;
+
+    bool executeQuery(const std::string& sql) override;
+    types::TableData query(const std::string& sql) override;
+    size_t stream(const std::string& sql, base::RowSink& sink, const std::atomic<bool>& stop) override;
+    size_t streamTable(const std::string& table, const std::vector<std::string>& columns, base::RowSink& sink,
+                       const std::atomic<bool>& stop) override;
+    size_t streamRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key, const std::string& from,
+                       const std::string& to, base::RowSink& sink, const std::atomic<bool>& stop) override;
+    types::RangeHash hashRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key, const std::string& from,
+                               const std::string& to) override;
+    std::string exportSnapshot() override;
+    void useSnapshot(const std::string& id) override;
+    void releaseSnapshot() override;
+    std::unique_ptr<base::ChangeFeed> watch(const std::vector<std::string>& tables, bool installTriggers) override;
+    std::vector<std::string> listTables() override;
+    std::vector<types::TableSchema> getTables() override;
+    types::TableSchema describe(const std::string& table) override;
+    types::TableData select(const std::string& table, int offset, int limit, const std::vector<std::string>& columns) override;
+    types::TableData seek(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset, int limit,
+                          const std::vector<std::string>& columns, bool hashes) override;
+    types::TableData seekHashes(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                int limit) override;
+    types::TableData selectKeys(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                const std::vector<std::string>& columns) override;
+    std::vector<std::string> pageAnchors(const std::string& table, const std::string& key, int step, const std::atomic<bool>& stop) override;
+    bool editRow(const std::string& table, const std::pair<std::string, std::string>& where,
+                 const std::vector<std::pair<std::string, std::string>>& values) override;
+    bool addRow(const std::string& table, const std::vector<std::pair<std::string, std::string>>& values) override;
+    types::BatchResult addRows(const std::string& table, const types::ColumnBatch& batch, bool continueOnError) override;
+    std::unique_ptr<base::BulkLoader> bulkLoad(const std::string& table, const std::vector<std::string>& columns,
+                                               const base::LoadOptions& options) override;
+    bool removeRow(const std::string& table, const std::pair<std::string, std::string>& where) override;
+    size_t removeRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys) override;
+    size_t updateRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                      const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls) override;
+    std::vector<std::string> filterKeys(const std::string& table, const std::string& key, const std::string& where, const std::string& from,
+                                        int limit) override;
+    types::TableData search(const std::string& table, const std::string& column, const std::string& pattern, int limit) override;
+    bool createTable(const types::TableSchema& schema) override;
+    bool dropTable(const std::string& tableName) override;
+    std::string readValue(const std::string& table, const std::pair<std::string, std::string>& where, const types::Column& column, size_t& offset,
+                          size_t length) override;
+    void setPreviewLimit(size_t bytes) override;
+
+ private:
+    std::unique_ptr<base::Database> inner;
+    std::shared_ptr<Registry> registry;
+
+    template <typename F>
+    auto measure(const char* operation, F&& call) -> decltype(call());
+};
+
+}  // namespace metrics
@@ -0,0 +1,293 @@
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "paging.hpp"
+
+namespace paging {
+
+void AnchorIndex::append(const std::string& anchor) {
+    offsets.push_back(static_cast<uint32_t>(keys.size()));
+    keys += anchor;
+}
+
+std::string AnchorIndex::at(size_t index) const {
+    size_t begin = offsets[index];
+    size_t end = index + 1 < offsets.size() ? offsets[index + 1] : keys.size();
+    return keys.substr(begin, end - begin);
+}
+
+bool AnchorIndex::locate(long long offset, std::string& anchor, int& rest) const {
+    if (offsets.empty() || offset < 0)
+        return false;
+
+    size_t index = static_cast<size_t>(offset / step);
+    if (index >= offsets.size())
+        index = offsets.size() - 1;
+
+    anchor = at(index);
+    rest = static_cast<int>(offset - static_cast<long long>(index) * step);
+    return true;
+}
+
+bool AnchorIndex::save(const std::string& path) const {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+
+    uint32_t count = static_cast<uint32_t>(offsets.size());
+    uint32_t length = static_cast<uint32_t>(keys.size());
+    out << "aleto-anchors 2\n" << table << "\n" << key << "\n" << step << "\n" << version << "\n";
+    out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    out.write(reinterpret_cast<const char*>(&length), sizeof(length));
+    out.write(reinterpret_cast<const char*>(offsets.data()), count * sizeof(uint32_t));
+    out.write(keys.data(), length);
+    return static_cast<bool>(out);
+}
+
+bool AnchorIndex::load(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+        return false;
+
+    std::string magic, fileTable, fileKey, fileStep, fileVersion;
+    if (!std::getline(in, magic) || magic != "aleto-anchors 2")
+        return false;
+    std::getline(in, fileTable);
+    std::getline(in, fileKey);
+    std::getline(in, fileStep);
+    std::getline(in, fileVersion);
+    if (fileTable != table || fileKey != key || fileStep != std::to_string(step))
+        return false;
+
+    uint32_t count = 0, length = 0;
+    in.read(reinterpret_cast<char*>(&count), sizeof(count));
+    in.read(reinterpret_cast<char*>(&length), sizeof(length));
+    std::vector<uint32_t> fileOffsets(count);
+    std::string fileKeys(length, '\0');
+    in.read(reinterpret_cast<char*>(fileOffsets.data()), count * sizeof(uint32_t));
+    in.read(fileKeys.data(), length);
+    if (!in)
+        return false;
+
+    offsets = std::move(fileOffsets);
+    keys = std::move(fileKeys);
+    version = std::move(fileVersion);
+    return true;
+}
+
+AnchorService::AnchorService(std::unique_ptr<base::Database> db, std::string cacheDir) : db(std::move(db)), cacheDir(std::move(cacheDir)) {
+    if (!this->cacheDir.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(this->cacheDir, ec);
+    }
+    worker = std::thread(&AnchorService::run, this);
+}
+
+AnchorService::~AnchorService() {
+    stop = true;
+    wakeup.notify_all();
+    if (worker.joinable())
+        worker.join();
+}
+
+void AnchorService::request(const std::string& table, const std::string& key, int step) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (ready.count({table, key}))
+        return;
+    for (const auto& p : pending) {
+        if (p.index.table == table && p.index.key == key)
+            return;
+    }
+
+    pending.push_back({AnchorIndex{table, key, step}, !cacheDir.empty(), generations[table]});
+    wakeup.notify_one();
+}
+
+// Версия таблицы по статистике сервера может отставать от только что сделанного изменения, поэтому после сброса
+// файл с диска не используется, даже если версия совпала
+void AnchorService::invalidate(const std::string& table) {
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t generation = ++generations[table];
+
+    std::vector<AnchorIndex> rebuilt;
+    for (auto it = ready.begin(); it != ready.end();) {
+        if (it->first.first == table) {
+            rebuilt.push_back({table, it->second.key, it->second.step});
+            it = ready.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto& p : pending) {
+        if (p.index.table == table) {
+            p.cached = false;
+            p.generation = generation;
+        }
+    }
+    for (auto& index : rebuilt) {
+        pending.push_back({std::move(index), false, generation});
+    }
+    wakeup.notify_one();
+}
+
+bool AnchorService::locate(const std::string& table, const std::string& key, long long offset, std::string& anchor, int& rest) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ready.find({table, key});
+    return it != ready.end() && it->second.locate(offset, anchor, rest);
+}
+
+long long AnchorService::approxRows(const std::string& table, const std::string& key) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = ready.find({table, key});
+    return it == ready.end() ? 0 : it->second.approxRows();
+}
+
+std::string AnchorService::cachePath(const AnchorIndex& index) const {
+    std::ostringstream name;
+    name << std::hex << std::hash<std::string>{}(db->connectionId() + "\n" + index.table + "\n" + index.key) << "_" << std::dec << index.step
+         << ".anchors";
+    return (std::filesystem::path(cacheDir) / name.str()).string();
+}
+
+std::string AnchorService::tableVersion(const std::string& table) {
+    auto versions = db->tableVersions();
+    auto it = versions.find(table);
+    return it == versions.end() ? "" : it->second;
+}
+
+// Файл с диска годится только при известной и совпадающей версии таблицы: без неё (SQLite, представления)
+// нельзя узнать, менялась ли таблица с прошлого запуска
+bool AnchorService::loadCached(AnchorIndex& index) {
+    AnchorIndex cached{index.table, index.key, index.step};
+    if (!cached.load(cachePath(cached)) || cached.version.empty() || cached.version != index.version)
+        return false;
+    index = std::move(cached);
+    return true;
+}
+
+// Таблицу изменили за время построения: индекс отбрасывается и строится заново. Вызывается под mutex
+bool AnchorService::outdated(const Request& job) {
+    uint64_t generation = generations[job.index.table];
+    if (generation == job.generation)
+        return false;
+    for (const auto& p : pending) {
+        if (p.index.table == job.index.table && p.index.key == job.index.key)
+            return true;
+    }
+    pending.push_back({AnchorIndex{job.index.table, job.index.key, job.index.step}, false, generation});
+    return true;
+}
+
+void AnchorService::run() {
+    while (true) {
+        Request job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeup.wait(lock, [this] { return stop || !pending.empty(); });
+            if (stop)
+                return;
+            job = std::move(pending.front());
+            pending.pop_front();
+        }
+        AnchorIndex& index = job.index;
+
+        // Версия читается до построения: изменение во время построения даст лишнее перестроение в следующий раз
+        bool loaded = false;
+        try {
+            if (!cacheDir.empty())
+                index.version = tableVersion(index.table);
+            loaded = job.cached && loadCached(index);
+            if (!loaded) {
+                for (const auto& anchor : db->pageAnchors(index.table, index.key, index.step, stop)) {
+                    index.append(anchor);
+                }
+            }
+        } catch (const std::exception&) {
+            // Таблица без пригодного ключа остаётся на OFFSET
+            continue;
+        }
+        if (stop)
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (outdated(job))
+                continue;
+        }
+        if (!cacheDir.empty() && !loaded)
+            index.save(cachePath(index));
+        std::string table = index.table;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (outdated(job))
+                continue;
+            ready[{index.table, index.key}] = std::move(index);
+        }
+        if (onReady)
+            onReady(table);
+    }
+}
+
+types::TableData fetchPage(base::Database& db, const AnchorService* anchors, const types::TableSchema& schema, int offset, int limit,
+                           const std::vector<std::string>& columns, bool hashes) {
+    const std::string& key = schema.rowKey;
+    if (key.empty())
+        return db.select(schema.title, offset, limit, columns);
+
+    std::string anchor;
+    int rest = offset;
+    if (anchors && anchors->locate(schema.title, key, offset, anchor, rest))
+        return db.seek(schema.title, key, anchor, true, rest, limit, columns, hashes);
+    return db.seek(schema.title, key, "", true, offset, limit, columns, hashes);
+}
+
+types::TableData fetchHashes(base::Database& db, const AnchorService* anchors, const types::TableSchema& schema, int offset, int limit) {
+    const std::string& key = schema.rowKey;
+    if (key.empty())
+        return {};
+
+    std::string anchor;
+    int rest = offset;
+    if (anchors && anchors->locate(schema.title, key, offset, anchor, rest))
+        return db.seekHashes(schema.title, key, anchor, true, rest, limit);
+    return db.seekHashes(schema.title, key, "", true, offset, limit);
+}
+
+namespace {
+
+// Вес нового замера в скользящем среднем
+const double SMOOTHING = 0.3;
+
+}  // namespace
+
+int PageSizer::rowsFor(const std::string& table) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = stats.find(table);
+    if (it == stats.end() || it->second.msPerRow <= 0)
+        return initialRows;
+
+    const Stats& s = it->second;
+    double rows = std::max(latencyBudgetMs - s.overheadMs, latencyBudgetMs / 2) / s.msPerRow;
+    if (s.bytesPerRow > 0)
+        rows = std::min(rows, byteBudget / s.bytesPerRow);
+    // Предел применяется до приведения: при почти нулевом времени на строку double не помещается в int
+    return static_cast<int>(std::clamp(rows, static_cast<double>(minRows), static_cast<double>(maxRows)));
+}
+
+void PageSizer::record(const std::string& table, size_t rows, size_t bytes, double ms) {
+    if (rows == 0)
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    Stats& s = stats[table];
+    // Минимальное время загрузки принимается за постоянную задержку сети и сервера
+    s.overheadMs = s.overheadMs < 0 ? ms : std::min(s.overheadMs, ms);
+    double perRow = std::max(ms - s.overheadMs, ms / 2) / rows;
+    double width = static_cast<double>(bytes) / rows;
+    s.msPerRow = s.msPerRow <= 0 ? perRow : s.msPerRow + SMOOTHING * (perRow - s.msPerRow);
+    s.bytesPerRow = s.bytesPerRow <= 0 ? width : s.bytesPerRow + SMOOTHING * (width - s.bytesPerRow);
+}
+
+}  // namespace paging
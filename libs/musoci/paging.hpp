@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "base.hpp"
+
+namespace paging {
+
+// Разреженный индекс страниц: ключ каждой step-й строки таблицы в порядке key.
+// Ключи хранятся одним буфером, чтобы десятки тысяч якорей не стоили отдельных аллокаций.
+class AnchorIndex {
+ public:
+    std::string table;
+    std::string key;
+    int step = 0;
+    // Версия таблицы (tableVersions) на момент построения, пусто - неизвестна
+    std::string version;
+
+    AnchorIndex() = default;
+
+    AnchorIndex(std::string table, std::string key, int step) : table(std::move(table)), key(std::move(key)), step(step) {}
+
+    bool empty() const { return offsets.empty(); }
+    size_t size() const { return offsets.size(); }
+    long long approxRows() const { return static_cast<long long>(offsets.size()) * step; }
+
+    void append(const std::string& anchor);
+    std::string at(size_t index) const;
+
+    // Ближайший снизу якорь для смещения и остаток смещения от него
+    bool locate(long long offset, std::string& anchor, int& rest) const;
+
+    bool save(const std::string& path) const;
+    bool load(const std::string& path);
+
+ private:
+    std::string keys;
+    std::vector<uint32_t> offsets;
+};
+
+// Фоновое построение индексов на отдельном подключении
+class AnchorService {
+ public:
+    // Вызывается из рабочего потока, когда индекс таблицы построен
+    std::function<void(const std::string& table)> onReady;
+
+    AnchorService(std::unique_ptr<base::Database> db, std::string cacheDir = "");
+    ~AnchorService();
+
+    void request(const std::string& table, const std::string& key, int step);
+    // Таблица изменена: индексы таблицы сбрасываются и строятся заново без файла с диска
+    void invalidate(const std::string& table);
+    bool locate(const std::string& table, const std::string& key, long long offset, std::string& anchor, int& rest) const;
+    long long approxRows(const std::string& table, const std::string& key) const;
+
+ private:
+    std::unique_ptr<base::Database> db;
+    std::string cacheDir;
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeup;
+    struct Request {
+        AnchorIndex index;
+        // Можно взять индекс с диска, если версия таблицы совпадает с сохранённой
+        bool cached = false;
+        uint64_t generation = 0;
+    };
+
+    std::deque<Request> pending;
+    std::map<std::pair<std::string, std::string>, AnchorIndex> ready;
+    // Счётчик сбросов по таблицам: индекс, построенный до сброса, отбрасывается
+    std::map<std::string, uint64_t> generations;
+    std::atomic<bool> stop{false};
+    std::thread worker;
+
+    std::string cachePath(const AnchorIndex& index) const;
+    std::string tableVersion(const std::string& table);
+    bool loadCached(AnchorIndex& index);
+    bool outdated(const Request& job);
+    void run();
+};
+
+// Страница таблицы с единым для всех клиентов выбором пути: через ближайший якорь,
+// seek по ключу или OFFSET для таблиц без ключа. hashes - хеши строк тем же запросом (только для таблиц с ключом)
+types::TableData fetchPage(base::Database& db, const AnchorService* anchors, const types::TableSchema& schema, int offset, int limit,
+                           const std::vector<std::string>& columns, bool hashes = false);
+
+// Ключи и хеши строк той же страницы, что возвращает fetchPage. Для таблиц без ключа пусто
+types::TableData fetchHashes(base::Database& db, const AnchorService* anchors, const types::TableSchema& schema, int offset, int limit);
+
+// Размер страницы по таблицам, подобранный под бюджеты задержки и объёма.
+// Время загрузки моделируется как постоянная задержка плюс стоимость строки.
+class PageSizer {
+ public:
+    PageSizer(double latencyBudgetMs, size_t byteBudget, int minRows, int maxRows, int initialRows)
+        : latencyBudgetMs(latencyBudgetMs), byteBudget(byteBudget), minRows(minRows), maxRows(maxRows), initialRows(initialRows) {}
+
+    int rowsFor(const std::string& table) const;
+    void record(const std::string& table, size_t rows, size_t bytes, double ms);
+
+ private:
+    struct Stats {
+        double overheadMs = -1;
+        double msPerRow = 0;
+        double bytesPerRow = 0;
+    };
+
+    double latencyBudgetMs;
+    size_t byteBudget;
+    int minRows;
+    int maxRows;
+    int initialRows;
+
+    mutable std::mutex mutex;
+    std::map<std::string, Stats> stats;
+};
+
+}  // namespace paging
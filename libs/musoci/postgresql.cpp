@@ -1,16 +1,401 @@
+#include <libpq-fe.h>
+#include <poll.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <map>
+#include <set>
 #include <sstream>
 
 #include "postgresql.hpp"
+#include "trace.hpp"
 
 namespace postgresql {
 
+namespace {
+
+// Строк за один FETCH при потоковом чтении
+const int STREAM_FETCH = 10000;
+
+// Строк в одном многострочном INSERT ... VALUES
+const size_t INSERT_ROWS = 1000;
+
+// Ключей в одном IN-списке
+const size_t KEYS_PER_STATEMENT = 10000;
+
+// Название таблицы по n.nspname и c.relname и условие на схемы пользователя (без системных, TOAST и временных)
+const char* TABLE_TITLE = "CASE WHEN n.nspname = 'public' AND position('.' in c.relname) = 0 THEN c.relname ELSE n.nspname || '.' || c.relname END";
+const char* USER_SCHEMAS = "n.nspname NOT LIKE 'pg\\_%' AND n.nspname <> 'information_schema'";
+// Определение таблицы для версий: файл данных (меняется при TRUNCATE и перезаписи) и xmin строк каталога (меняется при DDL)
+const char* TABLE_DEFINITION =
+    "c.relfilenode::text || ':' || c.xmin::text || ':' || (SELECT max(a.xmin::text::bigint) FROM pg_attribute a WHERE a.attrelid = c.oid)::text";
+
+// Строки результата дописываются в rows; NULL показывается текстом NULL, а сам факт NULL отмечается в nulls,
+// чтобы строку "NULL" можно было отличить от отсутствующего значения
+void appendRows(const pqxx::result& res, std::vector<std::vector<std::string>>& rows, std::set<std::pair<int, int>>& nulls) {
+    rows.reserve(rows.size() + res.size());
+    for (const auto& row : res) {
+        std::vector<std::string> r;
+        r.reserve(row.size());
+        for (const auto& field : row) {
+            if (field.is_null())
+                nulls.emplace(static_cast<int>(rows.size()), static_cast<int>(r.size()));
+            r.push_back(field.is_null() ? "NULL" : field.c_str());
+        }
+        rows.push_back(std::move(r));
+    }
+}
+
+// Число символов UTF-8 (соединение работает в client_encoding UTF8)
+size_t characters(const std::string& text) {
+    size_t count = 0;
+    for (unsigned char c : text) {
+        count += (c & 0xC0) != 0x80;
+    }
+    return count;
+}
+
+// Имена встроенных числовых типов по OID, остальные типы не различаются
+std::string typeName(pqxx::oid type) {
+    switch (type) {
+        case 16:
+            return "boolean";
+        case 20:
+            return "bigint";
+        case 21:
+            return "smallint";
+        case 23:
+            return "integer";
+        case 700:
+            return "real";
+        case 701:
+            return "double precision";
+        case 1700:
+            return "numeric";
+        default:
+            return "";
+    }
+}
+
+// Описания колонок в порядке проекции
+std::vector<types::Column> projectColumns(const std::vector<types::Column>& all, const std::vector<std::string>& columns) {
+    if (columns.empty())
+        return all;
+    std::vector<types::Column> result;
+    for (const auto& name : columns) {
+        auto it = std::find_if(all.begin(), all.end(), [&name](const types::Column& c) { return c.name == name; });
+        result.push_back(it != all.end() ? *it : types::Column(name, true, false, ""));
+    }
+    return result;
+}
+
+// Ключ в сравнениях и ORDER BY. Текст сравнивается побайтово (COLLATE "C"), как BINARY в SQLite: с другой локалью
+// базы одна и та же строка попадала бы у двух сторон в разные диапазоны
+std::string orderKey(const std::string& quoted, const std::vector<types::Column>& columns, const std::string& key) {
+    auto it = std::find_if(columns.begin(), columns.end(), [&key](const types::Column& c) { return c.name == key; });
+    bool text = it != columns.end() && (it->type == "text" || it->type == "character varying" || it->type == "character");
+    return text ? quoted + " COLLATE \"C\"" : quoted;
+}
+
+// Блок чтения файла и шаг уведомлений о прогрессе COPY
+const size_t COPY_CHUNK = 1 << 20;
+
+// Отдельное подключение libpq: потоки pqxx разбирают строки и не умеют двоичный COPY
+class CopyConnection {
+ public:
+    explicit CopyConnection(const std::string& params) : conn(PQconnectdb(params.c_str())) {
+        if (PQstatus(conn) != CONNECTION_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQfinish(conn);
+            throw std::runtime_error("Failed to connect for COPY: " + error);
+        }
+    }
+
+    ~CopyConnection() { PQfinish(conn); }
+
+    PGconn* get() const { return conn; }
+
+    void start(const std::string& command, ExecStatusType expected) {
+        PGresult* res = PQexec(conn, command.c_str());
+        bool started = PQresultStatus(res) == expected;
+        PQclear(res);
+        if (!started)
+            throw std::runtime_error("Failed to start COPY: " + std::string(PQerrorMessage(conn)));
+    }
+
+    void cancel() {
+        PGcancel* handle = PQgetCancel(conn);
+        char error[256];
+        PQcancel(handle, error, sizeof(error));
+        PQfreeCancel(handle);
+    }
+
+    // Итог команды: число строк или исключение с текстом ошибки сервера
+    size_t finish() {
+        size_t rows = 0;
+        std::string error;
+        while (PGresult* res = PQgetResult(conn)) {
+            if (PQresultStatus(res) == PGRES_COMMAND_OK) {
+                const char* tuples = PQcmdTuples(res);
+                rows = *tuples ? std::stoull(tuples) : 0;
+            } else if (error.empty()) {
+                error = PQresultErrorMessage(res);
+            }
+            PQclear(res);
+        }
+        if (!error.empty())
+            throw std::runtime_error("COPY failed: " + error);
+        return rows;
+    }
+
+ private:
+    PGconn* conn;
+};
+
+// Строки в текстовом формате COPY копятся в буфере и уходят на сервер блоками
+class CopyLoader : public base::BulkLoader {
+ public:
+    CopyLoader(const std::string& conninfo, const std::string& command) : copy(conninfo) {
+        copy.start(command, PGRES_COPY_IN);
+        buffer.reserve(COPY_CHUNK + COPY_CHUNK / 4);
+    }
+
+    ~CopyLoader() override {
+        if (!finished) {
+            PQputCopyEnd(copy.get(), "aleto: load aborted");
+            try {
+                copy.finish();
+            } catch (const std::exception&) {
+            }
+        }
+    }
+
+    void row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) override {
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i != 0)
+                buffer += '\t';
+            if (nulls[i]) {
+                buffer += "\\N";
+                continue;
+            }
+            for (char c : values[i]) {
+                switch (c) {
+                    case '\\':
+                        buffer += "\\\\";
+                        break;
+                    case '\t':
+                        buffer += "\\t";
+                        break;
+                    case '\n':
+                        buffer += "\\n";
+                        break;
+                    case '\r':
+                        buffer += "\\r";
+                        break;
+                    default:
+                        buffer += c;
+                }
+            }
+        }
+        buffer += '\n';
+        if (buffer.size() >= COPY_CHUNK)
+            flush();
+    }
+
+    // Ошибки данных приходят от сервера только здесь и отменяют всю загрузку
+    size_t finish() override {
+        flush();
+        finished = true;
+        if (PQputCopyEnd(copy.get(), nullptr) != 1)
+            throw std::runtime_error("COPY failed: " + std::string(PQerrorMessage(copy.get())));
+        return copy.finish();
+    }
+
+ private:
+    CopyConnection copy;
+    std::string buffer;
+    bool finished = false;
+
+    void flush() {
+        if (!buffer.empty() && PQputCopyData(copy.get(), buffer.data(), static_cast<int>(buffer.size())) != 1)
+            throw std::runtime_error("COPY failed: " + std::string(PQerrorMessage(copy.get())));
+        buffer.clear();
+    }
+};
+
+// Канал уведомлений таблицы; имена каналов ограничены 63 байтами, как и в триггере
+std::string channelName(const std::string& table) {
+    return ("aleto_" + table).substr(0, 63);
+}
+
+// Триггер на уровне операторов: одно уведомление на INSERT/UPDATE/DELETE/TRUNCATE, повторы в транзакции сервер сливает
+const char* NOTIFY_FUNCTION =
+    "CREATE OR REPLACE FUNCTION aleto_notify() RETURNS trigger LANGUAGE plpgsql AS $$ "
+    "BEGIN PERFORM pg_notify(left('aleto_' || CASE WHEN TG_TABLE_SCHEMA = 'public' AND position('.' in TG_TABLE_NAME) = 0 "
+    "THEN TG_TABLE_NAME ELSE TG_TABLE_SCHEMA || '.' || TG_TABLE_NAME END, 63), TG_OP); RETURN NULL; END $$;";
+
+// LISTEN на отдельном подключении libpq: ожидание через poll сокета, без занятого pqxx-подключения
+class PgChangeFeed : public base::ChangeFeed {
+ public:
+    PgChangeFeed(const std::string& params, const std::vector<std::string>& tables, bool installTriggers) : conn(PQconnectdb(params.c_str())) {
+        if (PQstatus(conn) != CONNECTION_OK) {
+            std::string error = PQerrorMessage(conn);
+            PQfinish(conn);
+            throw std::runtime_error("Failed to connect for LISTEN: " + error);
+        }
+        std::string sql = installTriggers ? std::string("BEGIN; ") + NOTIFY_FUNCTION : "";
+        for (const auto& table : tables) {
+            std::string channel = channelName(table);
+            channels[channel].push_back(table);
+            sql += "LISTEN " + escape(channel) + "; ";
+            auto [schema, relation] = base::splitTable(table);
+            if (installTriggers && hasStatementTriggers(schema, relation)) {
+                std::string name = escape(schema) + "." + escape(relation);
+                sql += "DROP TRIGGER IF EXISTS aleto_notify ON " + name + "; CREATE TRIGGER aleto_notify AFTER INSERT OR UPDATE OR DELETE OR TRUNCATE ON " +
+                       name + " FOR EACH STATEMENT EXECUTE PROCEDURE aleto_notify(); ";
+            }
+        }
+        if (installTriggers)
+            sql += "COMMIT;";
+        PGresult* res = PQexec(conn, sql.c_str());
+        bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+        if (!ok) {
+            std::string error = PQerrorMessage(conn);
+            PQfinish(conn);
+            throw std::runtime_error("Failed to listen for changes: " + error);
+        }
+    }
+
+    ~PgChangeFeed() override { PQfinish(conn); }
+
+    std::vector<std::string> wait(std::chrono::milliseconds timeout) override {
+        std::set<std::string> changed;
+        collect(changed);
+        if (changed.empty()) {
+            pollfd socket{PQsocket(conn), POLLIN, 0};
+            if (::poll(&socket, 1, static_cast<int>(timeout.count())) < 0 && errno != EINTR)
+                throw std::runtime_error("Failed to wait for notifications");
+            if (!PQconsumeInput(conn))
+                throw std::runtime_error("Lost LISTEN connection: " + std::string(PQerrorMessage(conn)));
+            collect(changed);
+        }
+        return std::vector<std::string>(changed.begin(), changed.end());
+    }
+
+ private:
+    PGconn* conn;
+    // Усечённые имена каналов могут совпасть у нескольких таблиц
+    std::map<std::string, std::vector<std::string>> channels;
+
+    std::string escape(const std::string& name) const {
+        char* escaped = PQescapeIdentifier(conn, name.c_str(), name.size());
+        if (!escaped)
+            throw std::runtime_error("Failed to quote " + name);
+        std::string result = escaped;
+        PQfreemem(escaped);
+        return result;
+    }
+
+    // Триггеры на операторы бывают только у таблиц: представления и материализованные представления прервали бы весь пакет
+    bool hasStatementTriggers(const std::string& schema, const std::string& relation) {
+        const char* params[] = {schema.c_str(), relation.c_str()};
+        PGresult* res = PQexecParams(conn,
+                                     "SELECT 1 FROM pg_class c JOIN pg_namespace n ON n.oid = c.relnamespace "
+                                     "WHERE n.nspname = $1 AND c.relname = $2 AND c.relkind IN ('r', 'p')",
+                                     2, nullptr, params, nullptr, nullptr, 0);
+        bool found = PQresultStatus(res) == PGRES_TUPLES_OK && PQntuples(res) == 1;
+        PQclear(res);
+        return found;
+    }
+
+    void collect(std::set<std::string>& changed) {
+        while (PGnotify* notify = PQnotifies(conn)) {
+            auto it = channels.find(notify->relname);
+            if (it != channels.end())
+                changed.insert(it->second.begin(), it->second.end());
+            PQfreemem(notify);
+        }
+    }
+};
+
+}  // namespace
+
 PostgreSqlDB::PostgreSqlDB(const std::string& host, int port, const std::string& user, const std::string& password, const std::string& database)
-    : conn(std::make_unique<pqxx::connection>("host=" + host + " port=" + std::to_string(port) + " dbname=" + database + " user=" + user +
-                                              " password=" + password)) {
+    : host(host),
+      port(port),
+      user(user),
+      password(password),
+      database(database),
+      conn(std::make_unique<pqxx::connection>(conninfo())) {
 }
 
 PostgreSqlDB::~PostgreSqlDB() = default;
 
+std::unique_ptr<base::Database> PostgreSqlDB::clone() const {
+    return std::make_unique<PostgreSqlDB>(host, port, user, password, database);
+}
+
+std::string PostgreSqlDB::conninfo() const {
+    return "host=" + host + " port=" + std::to_string(port) + " dbname=" + database + " user=" + user + " password=" + password +
+           " client_encoding=UTF8";
+}
+
+std::string PostgreSqlDB::connectionId() const {
+    return "postgresql://" + user + "@" + host + ":" + std::to_string(port) + "/" + database;
+}
+
+// Позиция WAL сдвигается при любой фиксации с записью, включая DDL, но и от работы других баз кластера и служебных
+// процессов. Нежурналируемые и временные таблицы в WAL не пишутся, для них берутся счётчики статистики (с задержкой)
+std::string PostgreSqlDB::dataVersion() {
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec(
+        "SELECT (CASE WHEN pg_is_in_recovery() THEN pg_last_wal_replay_lsn() ELSE pg_current_wal_insert_lsn() END)::text "
+        "|| ':' || coalesce((SELECT sum(s.n_tup_ins + s.n_tup_upd + s.n_tup_del) FROM pg_stat_user_tables s "
+        "JOIN pg_class c ON c.oid = s.relid WHERE c.relpersistence <> 'p'), 0)::text");
+    txn.commit();
+    if (res[0][0].is_null())
+        throw std::runtime_error("Failed to read data version");
+    return res[0][0].c_str();
+}
+
+// Версия таблицы - файл данных (меняется при TRUNCATE и перезаписи), xmin строк каталога (меняется при DDL) и счётчики
+// изменённых строк из статистики. Счётчики обновляются с задержкой до секунды и обнуляются при сбросе статистики
+std::map<std::string, std::string> PostgreSqlDB::tableVersions() {
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec(
+        "SELECT " + std::string(TABLE_TITLE) + ", c.relkind IN ('r', 'm'), " + TABLE_DEFINITION + ", " +
+        "coalesce(s.n_tup_ins::text || ':' || s.n_tup_upd::text || ':' || s.n_tup_del::text, '') "
+        "FROM pg_class c JOIN pg_namespace n ON n.oid = c.relnamespace LEFT JOIN pg_stat_user_tables s ON s.relid = c.oid "
+        "WHERE c.relkind IN ('r', 'p', 'v', 'm', 'f') AND " +
+        std::string(USER_SCHEMAS));
+    txn.commit();
+
+    std::map<std::string, std::string> versions;
+    for (const auto& row : res) {
+        versions[row[0].c_str()] = row[1].as<bool>() ? std::string(row[2].c_str()) + ":" + row[3].c_str() : "";
+    }
+    return versions;
+}
+
+// Отпечаток названий и определений всех таблиц: строки каталога меняют xmin при любом DDL
+std::string PostgreSqlDB::catalogVersion() {
+    pqxx::work txn(*conn);
+    pqxx::result res = txn.exec("SELECT " + std::string(TABLE_TITLE) + ", " + TABLE_DEFINITION +
+                                " FROM pg_class c JOIN pg_namespace n ON n.oid = c.relnamespace "
+                                "WHERE c.relkind IN ('r', 'p', 'v', 'm', 'f') AND " +
+                                std::string(USER_SCHEMAS) + " ORDER BY 1");
+    txn.commit();
+
+    std::string catalog;
+    for (const auto& row : res) {
+        catalog += std::string(row[0].c_str()) + "=" + row[1].c_str() + "\n";
+    }
+    std::ostringstream hash;
+    hash << std::hex << std::hash<std::string>{}(catalog) << ":" << std::dec << res.size();
+    return hash.str();
+}
+
 bool PostgreSqlDB::executeQuery(const std::string& sql) {
     pqxx::work txn(*conn);
     txn.exec(sql);
@@ -18,85 +403,377 @@ bool PostgreSqlDB::executeQuery(const std::string& sql) {
     return true;
 }
 
-std::vector<types::TableSchema> PostgreSqlDB::getTables() {
-    std::vector<types::TableSchema> result;
+types::TableData PostgreSqlDB::query(const std::string& sql) {
+    TRACE_SPAN("pg.query");
+    pqxx::work txn(*conn);
+    pqxx::result res;
+    {
+        TRACE_SPAN("pg.exec");
+        res = txn.exec(sql);
+    }
+    txn.commit();
+
+    TRACE_SPAN("pg.convert");
+    types::TableData result;
+    for (int i = 0; i < res.columns(); ++i) {
+        result.columns.emplace_back(res.column_name(i), true, false, "");
+    }
+    appendRows(res, result.data, result.nulls);
+    result.count = static_cast<int>(result.data.size());
+    return result;
+}
+
+size_t PostgreSqlDB::stream(const std::string& sql, base::RowSink& sink, const std::atomic<bool>& stop) {
+    TRACE_SPAN("pg.stream");
     pqxx::work txn(*conn);
-    auto res = txn.exec("SELECT table_name FROM information_schema.tables WHERE table_schema = 'public';");
+    if (!snapshot.empty()) {
+        txn.exec("SET TRANSACTION ISOLATION LEVEL REPEATABLE READ;");
+        txn.exec("SET TRANSACTION SNAPSHOT " + txn.quote(snapshot) + ";");
+    }
+    txn.exec("DECLARE aleto_stream NO SCROLL CURSOR FOR " + sql);
 
-    for (const auto& row : res) {
-        std::string table = row[0].as<std::string>();
-        std::vector<types::Column> columns;
-
-        auto colRes = txn.exec(
-            "SELECT column_name, is_nullable, data_type "
-            "FROM information_schema.columns "
-            "WHERE table_name = " +
-            txn.quote(table) + ";");
-
-        for (const auto& col : colRes) {
-            std::string name = col[0].as<std::string>();
-            bool nullable = col[1].as<std::string>() == "YES";
-            std::string type = col[2].as<std::string>();
-            bool primary_key = false;
-
-            auto pk = txn.exec(
-                "SELECT kcu.column_name "
-                "FROM information_schema.table_constraints tc "
-                "JOIN information_schema.key_column_usage kcu "
-                "ON tc.constraint_name = kcu.constraint_name "
-                "WHERE tc.table_name = " +
-                txn.quote(table) + " AND tc.constraint_type = 'PRIMARY KEY';");
-
-            for (const auto& pkcol : pk) {
-                if (pkcol[0].as<std::string>() == name) {
-                    primary_key = true;
-                    break;
-                }
+    size_t count = 0;
+    bool started = false;
+    std::vector<std::string_view> values;
+    std::vector<bool> nulls;
+    while (!stop) {
+        pqxx::result res;
+        {
+            TRACE_SPAN("pg.fetch");
+            res = txn.exec("FETCH " + std::to_string(STREAM_FETCH) + " FROM aleto_stream;");
+        }
+        if (!started) {
+            std::vector<types::Column> columns;
+            for (int i = 0; i < res.columns(); ++i) {
+                columns.emplace_back(res.column_name(i), true, false, typeName(res.column_type(i)));
             }
+            sink.begin(columns);
+            values.resize(columns.size());
+            nulls.resize(columns.size());
+            started = true;
+        }
+        if (res.empty())
+            break;
 
-            columns.emplace_back(name, nullable, primary_key, type);
+        for (const auto& row : res) {
+            for (int i = 0; i < values.size(); ++i) {
+                nulls[i] = row[i].is_null();
+                values[i] = std::string_view(row[i].c_str(), row[i].size());
+            }
+            sink.row(values, nulls);
+            ++count;
         }
+    }
+
+    txn.commit();
+    return count;
+}
 
-        result.emplace_back(table, columns);
+size_t PostgreSqlDB::streamTable(const std::string& table, const std::vector<std::string>& columns, base::RowSink& sink,
+                                 const std::atomic<bool>& stop) {
+    std::string list;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        list += (i == 0 ? "" : ", ") + conn->quote_name(columns[i]);
     }
+    return stream("SELECT " + (list.empty() ? std::string("*") : list) + " FROM " + base::quoteTable(table, true), sink, stop);
+}
+
+size_t PostgreSqlDB::streamRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key,
+                                 const std::string& from, const std::string& to, base::RowSink& sink, const std::atomic<bool>& stop) {
+    std::string list;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        list += (i == 0 ? "" : ", ") + conn->quote_name(columns[i]);
+    }
+    std::string k = orderKey(conn->quote_name(key), describe(table).columns, key);
+    std::string sql = "SELECT " + (list.empty() ? std::string("*") : list) + " FROM " + base::quoteTable(table, true);
+    if (!from.empty())
+        sql += " WHERE " + k + " >= " + conn->quote(from);
+    if (!to.empty())
+        sql += (from.empty() ? " WHERE " : " AND ") + k + " < " + conn->quote(to);
+    return stream(sql + " ORDER BY " + k, sink, stop);
+}
+
+// Первые 8 байт md5 текста строки как bigint, сумма - numeric без переполнения
+types::RangeHash PostgreSqlDB::hashRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key,
+                                         const std::string& from, const std::string& to) {
+    TRACE_SPAN("pg.hashRange");
+    std::vector<types::Column> all = describe(table).columns;
+    std::vector<types::Column> described = projectColumns(all, columns);
+    pqxx::work txn(*conn);
+
+    std::string row;
+    for (const auto& column : described) {
+        std::string name = txn.quote_name(column.name);
+        std::string text = column.type == "boolean" ? "CASE WHEN " + name + " THEN '1' ELSE '0' END" : name + "::text";
+        row += (row.empty() ? "" : " || chr(31) || ") + std::string("coalesce(") + text + ", '\\N')";
+    }
+    std::string k = orderKey(txn.quote_name(key), all, key);
+    std::string sql = "SELECT count(*), sum(('x' || substr(md5(" + row + "), 1, 16))::bit(64)::bigint)::text FROM " + base::quoteTable(table, true);
+    if (!from.empty())
+        sql += " WHERE " + k + " >= " + txn.quote(from);
+    if (!to.empty())
+        sql += (from.empty() ? " WHERE " : " AND ") + k + " < " + txn.quote(to);
+    auto res = txn.exec(sql + ";");
+    txn.commit();
 
+    types::RangeHash result;
+    result.rows = res[0][0].as<size_t>();
+    result.hash = res[0][1].is_null() ? "" : res[0][1].c_str();
     return result;
 }
 
-types::TableData PostgreSqlDB::select(const std::string& table, int offset, int limit) {
-    auto schema = getTables();
+// Снимок живёт, пока открыта экспортировавшая его транзакция
+std::string PostgreSqlDB::exportSnapshot() {
+    exported.reset();
+    exported = std::make_unique<pqxx::work>(*conn);
+    exported->exec("SET TRANSACTION ISOLATION LEVEL REPEATABLE READ;");
+    return exported->exec("SELECT pg_export_snapshot();")[0][0].c_str();
+}
+
+void PostgreSqlDB::useSnapshot(const std::string& id) {
+    snapshot = id;
+}
+
+void PostgreSqlDB::releaseSnapshot() {
+    exported.reset();
+}
+
+std::unique_ptr<base::ChangeFeed> PostgreSqlDB::watch(const std::vector<std::string>& tables, bool installTriggers) {
+    return std::make_unique<PgChangeFeed>(conninfo(), tables, installTriggers);
+}
+
+// Одним запросом к каталогу, без колонок: десятки тысяч таблиц перечисляются за один проход
+std::vector<std::string> PostgreSqlDB::listTables() {
+    TRACE_SPAN("pg.listTables");
     pqxx::work txn(*conn);
-    std::vector<types::Column> columns;
+    auto res = txn.exec("SELECT " + std::string(TABLE_TITLE) +
+                        " FROM pg_class c JOIN pg_namespace n ON n.oid = c.relnamespace "
+                        "WHERE c.relkind IN ('r', 'p', 'v', 'm', 'f') AND " +
+                        USER_SCHEMAS + " ORDER BY n.nspname <> 'public', n.nspname, c.relname;");
+    txn.commit();
 
-    for (const auto& t : schema) {
-        if (t.title == table) {
-            columns = t.columns;
-            break;
+    std::vector<std::string> tables;
+    tables.reserve(res.size());
+    for (const auto& row : res) {
+        tables.push_back(row[0].c_str());
+    }
+    return tables;
+}
+
+std::vector<types::TableSchema> PostgreSqlDB::getTables() {
+    std::vector<types::TableSchema> result;
+    for (const auto& table : listTables()) {
+        result.push_back(describe(table));
+    }
+    return result;
+}
+
+// Большие значения урезаются до previewLimit, их полные длины идут отдельными колонками в конце
+std::string PostgreSqlDB::selectList(pqxx::transaction_base& txn, const std::vector<types::Column>& described, std::vector<int>& large) const {
+    if (described.empty())
+        return "*";
+
+    std::string list, lengths;
+    for (size_t i = 0; i < described.size(); ++i) {
+        std::string name = txn.quote_name(described[i].name);
+        if (i != 0)
+            list += ", ";
+        if (previewLimit == 0 || !isLargeType(described[i].type)) {
+            list += name;
+            continue;
         }
+        large.push_back(static_cast<int>(i));
+        if (described[i].type == "bytea") {
+            list += "substring(" + name + " FROM 1 FOR " + std::to_string(previewLimit) + ") AS " + name;
+            lengths += ", octet_length(" + name + ")";
+        } else {
+            list += "left(" + name + "::text, " + std::to_string(previewLimit) + ") AS " + name;
+            lengths += ", length(" + name + "::text)";
+        }
+    }
+    return list + lengths;
+}
+
+types::TableSchema PostgreSqlDB::describe(const std::string& table) {
+    TRACE_SPAN("pg.describe");
+    types::TableSchema schema{table, {}};
+    auto [schemaName, tableName] = base::splitTable(table);
+    pqxx::work txn(*conn);
+
+    // Для массивов и пользовательских типов information_schema даёт только ARRAY и USER-DEFINED,
+    // их настоящие имена (integer[], схема.enum) берутся из format_type
+    auto res = txn.exec(
+        "SELECT c.column_name, c.is_nullable, "
+        "CASE WHEN c.data_type IN ('ARRAY', 'USER-DEFINED') THEN "
+        "(SELECT format_type(a.atttypid, a.atttypmod) FROM pg_attribute a "
+        "WHERE a.attrelid = (quote_ident(c.table_schema) || '.' || quote_ident(c.table_name))::regclass AND a.attname = c.column_name) "
+        "ELSE c.data_type END, "
+        "EXISTS (SELECT 1 FROM information_schema.table_constraints tc "
+        "JOIN information_schema.key_column_usage kcu "
+        "ON tc.constraint_name = kcu.constraint_name AND tc.table_schema = kcu.table_schema "
+        "WHERE tc.table_name = c.table_name AND tc.table_schema = c.table_schema "
+        "AND tc.constraint_type = 'PRIMARY KEY' AND kcu.column_name = c.column_name) "
+        "FROM information_schema.columns c "
+        "WHERE c.table_schema = " +
+        txn.quote(schemaName) + " AND c.table_name = " + txn.quote(tableName) + " ORDER BY c.ordinal_position;");
+
+    std::vector<std::string> keys;
+    for (const auto& col : res) {
+        std::string name = col[0].as<std::string>();
+        bool nullable = col[1].as<std::string>() == "YES";
+        bool primary_key = col[3].as<bool>();
+        if (primary_key)
+            keys.push_back(name);
+        schema.columns.emplace_back(name, nullable, primary_key, col[2].as<std::string>());
     }
 
+    if (keys.size() == 1)
+        schema.rowKey = keys[0];
+    return schema;
+}
+
+types::TableData PostgreSqlDB::select(const std::string& table, int offset, int limit, const std::vector<std::string>& columns) {
+    TRACE_SPAN("pg.select");
+    std::vector<types::Column> described = projectColumns(describe(table).columns, columns);
+    pqxx::work txn(*conn);
+
+    std::vector<int> large;
     std::stringstream ss;
-    ss << "SELECT * FROM " << txn.quote_name(table) << " OFFSET " << offset << " LIMIT " << limit << ";";
+    ss << "SELECT " << selectList(txn, described, large) << " FROM " << base::quoteTable(table, true) << " OFFSET " << offset << " LIMIT " << limit
+       << ";";
 
-    auto res = txn.exec(ss.str());
+    pqxx::result res;
+    {
+        TRACE_SPAN("pg.exec");
+        res = txn.exec(ss.str());
+    }
+    TRACE_SPAN("pg.convert");
+    std::vector<std::vector<std::string>> rows;
+    std::set<std::pair<int, int>> nulls;
+    appendRows(res, rows, nulls);
+
+    types::TableData result(table, described, rows, offset / limit, res.size());
+    result.nulls = std::move(nulls);
+    applyPreview(result, large);
+    return result;
+}
+
+types::TableData PostgreSqlDB::seek(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                    int limit, const std::vector<std::string>& columns, bool hashes) {
+    TRACE_SPAN("pg.seek");
+    std::vector<types::Column> all = describe(table).columns;
+    std::vector<types::Column> described = projectColumns(all, columns);
+    pqxx::work txn(*conn);
+    std::string k = orderKey(txn.quote_name(key), all, key);
+
+    std::vector<int> large;
+    std::stringstream ss;
+    // Хеш идёт последней колонкой, после длин усечённых значений
+    ss << "SELECT " << selectList(txn, described, large) << (hashes ? ", md5(aleto_row::text)" : "") << " FROM " << base::quoteTable(table, true)
+       << " AS aleto_row";
+    if (!from.empty())
+        ss << " WHERE " << k << (inclusive ? " >= " : " > ") << txn.quote(from);
+    ss << " ORDER BY " << k << " OFFSET " << offset << " LIMIT " << limit << ";";
+
+    pqxx::result res;
+    {
+        TRACE_SPAN("pg.exec");
+        res = txn.exec(ss.str());
+    }
+    TRACE_SPAN("pg.convert");
     std::vector<std::vector<std::string>> rows;
+    std::set<std::pair<int, int>> nulls;
+    appendRows(res, rows, nulls);
+
+    types::TableData result(table, described, rows, 0, res.size());
+    result.nulls = std::move(nulls);
+    if (hashes)
+        takeHashes(result);
+    applyPreview(result, large);
+    return result;
+}
 
+// Хеш - md5 текстового представления всей строки
+types::TableData PostgreSqlDB::seekHashes(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                          int limit) {
+    TRACE_SPAN("pg.seekHashes");
+    std::vector<types::Column> all = describe(table).columns;
+    pqxx::work txn(*conn);
+
+    // Порядок тот же, что у seek, иначе хеши не совпадут со страницами
+    std::string k = orderKey(txn.quote_name(key), all, key);
+    std::stringstream ss;
+    ss << "SELECT " << txn.quote_name(key) << "::text, md5(aleto_row::text) FROM " << base::quoteTable(table, true) << " AS aleto_row";
+    if (!from.empty())
+        ss << " WHERE " << k << (inclusive ? " >= " : " > ") << txn.quote(from);
+    ss << " ORDER BY " << k << " OFFSET " << offset << " LIMIT " << limit << ";";
+    auto res = txn.exec(ss.str());
+    txn.commit();
+
+    std::vector<std::vector<std::string>> rows;
+    rows.reserve(res.size());
     for (const auto& row : res) {
-        std::vector<std::string> r;
-        for (const auto& field : row) {
-            r.push_back(field.is_null() ? "NULL" : field.c_str());
+        rows.push_back({row[0].c_str(), row[1].c_str()});
+    }
+    return types::TableData(table, {types::Column(key, false, true, "text"), types::Column("hash", false, false, "text")}, rows, 0, res.size());
+}
+
+types::TableData PostgreSqlDB::selectKeys(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                          const std::vector<std::string>& columns) {
+    TRACE_SPAN("pg.selectKeys");
+    std::vector<types::Column> described = projectColumns(describe(table).columns, columns);
+    pqxx::work txn(*conn);
+
+    std::vector<int> large;
+    std::string head =
+        "SELECT " + selectList(txn, described, large) + " FROM " + base::quoteTable(table, true) + " WHERE " + txn.quote_name(key) + " IN (";
+    std::vector<std::vector<std::string>> rows;
+    std::set<std::pair<int, int>> nulls;
+    for (size_t first = 0; first < keys.size(); first += KEYS_PER_STATEMENT) {
+        size_t last = std::min(keys.size(), first + KEYS_PER_STATEMENT);
+        std::string list;
+        for (size_t i = first; i < last; ++i) {
+            list += (i == first ? "" : ", ") + txn.quote(keys[i]);
+        }
+        appendRows(txn.exec(head + list + ");"), rows, nulls);
+    }
+    txn.commit();
+
+    types::TableData result(table, described, rows, 0, rows.size());
+    result.nulls = std::move(nulls);
+    applyPreview(result, large);
+    return result;
+}
+
+std::vector<std::string> PostgreSqlDB::pageAnchors(const std::string& table, const std::string& key, int step, const std::atomic<bool>& stop) {
+    std::vector<std::string> anchors;
+    std::vector<types::Column> all = describe(table).columns;
+    pqxx::work txn(*conn);
+
+    // Нумерация идёт на сервере (index-only scan по ключу), клиенту передаются только якоря
+    std::string k = txn.quote_name(key);
+    std::string order = orderKey(k, all, key);
+    txn.exec("DECLARE aleto_anchors NO SCROLL CURSOR FOR SELECT " + k + "::text FROM (SELECT " + k + ", row_number() OVER (ORDER BY " + order +
+             ") AS rn FROM " + base::quoteTable(table, true) + ") s WHERE (rn - 1) % " + std::to_string(step) + " = 0 ORDER BY " + order + ";");
+
+    while (!stop) {
+        auto res = txn.exec("FETCH 1000 FROM aleto_anchors;");
+        if (res.empty())
+            break;
+        for (const auto& row : res) {
+            anchors.push_back(row[0].c_str());
         }
-        rows.push_back(std::move(r));
     }
 
-    return types::TableData(table, columns, rows, offset / limit, res.size());
+    txn.commit();
+    return anchors;
 }
 
 bool PostgreSqlDB::editRow(const std::string& table, const std::pair<std::string, std::string>& where,
                            const std::vector<std::pair<std::string, std::string>>& values) {
     pqxx::work txn(*conn);
     std::stringstream ss;
-    ss << "UPDATE " << txn.quote_name(table) << " SET ";
+    ss << "UPDATE " << base::quoteTable(table, true) << " SET ";
     for (size_t i = 0; i < values.size(); ++i) {
         ss << txn.quote_name(values[i].first) << " = " << txn.quote(values[i].second);
         if (i < values.size() - 1)
@@ -120,55 +797,161 @@ bool PostgreSqlDB::addRow(const std::string& table, const std::vector<std::pair<
         }
     }
 
-    std::string sql = "INSERT INTO " + txn.quote_name(table) + " (" + cols.str() + ") VALUES (" + vals.str() + ");";
+    std::string sql = "INSERT INTO " + base::quoteTable(table, true) + " (" + cols.str() + ") VALUES (" + vals.str() + ");";
 
     txn.exec(sql);
     txn.commit();
     return true;
 }
 
+// Блоки по INSERT_ROWS строк в точках сохранения. Если блок не прошёл, он повторяется по строке,
+// чтобы найти ошибочные строки и при continueOnError вставить остальные
+types::BatchResult PostgreSqlDB::addRows(const std::string& table, const types::ColumnBatch& batch, bool continueOnError) {
+    TRACE_SPAN("pg.addRows");
+    types::BatchResult result;
+    pqxx::work txn(*conn);
+
+    std::string prefix = "INSERT INTO " + base::quoteTable(table, true) + " (";
+    for (size_t c = 0; c < batch.columns.size(); ++c) {
+        prefix += (c == 0 ? "" : ", ") + txn.quote_name(batch.columns[c]);
+    }
+    prefix += ") VALUES ";
+    auto tuple = [&batch, &txn](size_t r) {
+        std::string values = "(";
+        for (size_t c = 0; c < batch.columns.size(); ++c) {
+            values += (c == 0 ? "" : ", ") + (batch.nulls[c][r] ? std::string("NULL") : txn.quote(batch.values[c][r]));
+        }
+        return values + ")";
+    };
+
+    size_t rows = batch.rows();
+    for (size_t first = 0; first < rows; first += INSERT_ROWS) {
+        size_t last = std::min(rows, first + INSERT_ROWS);
+        std::string sql = prefix;
+        for (size_t r = first; r < last; ++r) {
+            sql += (r == first ? "" : ", ") + tuple(r);
+        }
+        try {
+            pqxx::subtransaction block(txn);
+            block.exec(sql);
+            block.commit();
+            result.inserted += last - first;
+            continue;
+        } catch (const std::exception&) {
+        }
+
+        for (size_t r = first; r < last; ++r) {
+            try {
+                pqxx::subtransaction single(txn);
+                single.exec(prefix + tuple(r));
+                single.commit();
+                ++result.inserted;
+            } catch (const std::exception& e) {
+                result.errors.emplace_back(r, e.what());
+                if (!continueOnError) {
+                    txn.abort();
+                    result.inserted = 0;
+                    return result;
+                }
+            }
+        }
+    }
+    txn.commit();
+    return result;
+}
+
+size_t PostgreSqlDB::removeRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys) {
+    TRACE_SPAN("pg.removeRows");
+    pqxx::work txn(*conn);
+    return changeRows(txn, "DELETE FROM " + base::quoteTable(table, true), key, keys);
+}
+
+size_t PostgreSqlDB::updateRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls) {
+    TRACE_SPAN("pg.updateRows");
+    pqxx::work txn(*conn);
+    std::string head = "UPDATE " + base::quoteTable(table, true) + " SET ";
+    for (size_t i = 0; i < values.size(); ++i) {
+        bool null = !nulls.empty() && nulls[i];
+        head += (i == 0 ? "" : ", ") + txn.quote_name(values[i].first) + " = " + (null ? std::string("NULL") : txn.quote(values[i].second));
+    }
+    return changeRows(txn, head, key, keys);
+}
+
+// Литералы ключей приводятся к типу колонки сервером, поэтому IN-список идёт по индексу
+size_t PostgreSqlDB::changeRows(pqxx::work& txn, const std::string& head, const std::string& key, const std::vector<std::string>& keys) {
+    size_t changed = 0;
+    for (size_t first = 0; first < keys.size(); first += KEYS_PER_STATEMENT) {
+        size_t last = std::min(keys.size(), first + KEYS_PER_STATEMENT);
+        std::string list;
+        for (size_t i = first; i < last; ++i) {
+            list += (i == first ? "" : ", ") + txn.quote(keys[i]);
+        }
+        changed += txn.exec(head + " WHERE " + txn.quote_name(key) + " IN (" + list + ");").affected_rows();
+    }
+    txn.commit();
+    return changed;
+}
+
+std::vector<std::string> PostgreSqlDB::filterKeys(const std::string& table, const std::string& key, const std::string& where,
+                                                  const std::string& from, int limit) {
+    TRACE_SPAN("pg.filterKeys");
+    pqxx::work txn(*conn);
+    std::string k = txn.quote_name(key);
+    std::string sql = "SELECT " + k + "::text FROM " + base::quoteTable(table, true);
+    if (!where.empty())
+        sql += " WHERE (" + where + ")";
+    if (!from.empty())
+        sql += (where.empty() ? " WHERE " : " AND ") + k + " > " + txn.quote(from);
+    auto res = txn.exec(sql + " ORDER BY " + k + " LIMIT " + std::to_string(limit) + ";");
+    txn.commit();
+
+    std::vector<std::string> keys;
+    keys.reserve(res.size());
+    for (const auto& row : res) {
+        keys.push_back(row[0].c_str());
+    }
+    return keys;
+}
+
 bool PostgreSqlDB::removeRow(const std::string& table, const std::pair<std::string, std::string>& where) {
     pqxx::work txn(*conn);
 
-    std::string sql = "DELETE FROM " + txn.quote_name(table) + " WHERE " + txn.quote_name(where.first) + " = " + txn.quote(where.second);
+    std::string sql = "DELETE FROM " + base::quoteTable(table, true) + " WHERE " + txn.quote_name(where.first) + " = " + txn.quote(where.second);
 
     txn.exec(sql);
     txn.commit();
     return true;
 }
 
+std::unique_ptr<base::BulkLoader> PostgreSqlDB::bulkLoad(const std::string& table, const std::vector<std::string>& columns,
+                                                         const base::LoadOptions& options) {
+    // bytea в текстовом COPY и так принимает запись \x...
+    (void)options;
+    return std::make_unique<CopyLoader>(conninfo(), copyCommand(table, columns, CopyFormat::Text, false));
+}
+
 types::TableData PostgreSqlDB::search(const std::string& table, const std::string& column, const std::string& pattern, int limit) {
-    auto schemas = getTables();
-    std::vector<types::Column> columns;
+    std::vector<types::Column> columns = describe(table).columns;
 
     pqxx::work txn(*conn);
-    std::string sql = "SELECT * FROM " + txn.quote_name(table) + " WHERE CAST(" + txn.quote_name(column) + " AS TEXT) ILIKE " +
+    std::string sql = "SELECT * FROM " + base::quoteTable(table, true) + " WHERE CAST(" + txn.quote_name(column) + " AS TEXT) ILIKE " +
                       txn.quote('%' + pattern + '%') + " LIMIT " + std::to_string(limit) + ";";
     auto res = txn.exec(sql);
 
-    for (const auto& s : schemas) {
-        if (s.title == table) {
-            columns = s.columns;
-            break;
-        }
-    }
-
     std::vector<std::vector<std::string>> rows;
-    for (const auto& row : res) {
-        std::vector<std::string> r;
-        for (const auto& field : row) {
-            r.push_back(field.is_null() ? "NULL" : field.c_str());
-        }
-        rows.push_back(std::move(r));
-    }
+    std::set<std::pair<int, int>> nulls;
+    appendRows(res, rows, nulls);
 
-    return types::TableData(table, columns, rows, 0, res.size());
+    types::TableData result(table, columns, rows, 0, res.size());
+    result.nulls = std::move(nulls);
+    return result;
 }
 
 bool PostgreSqlDB::createTable(const types::TableSchema& schema) {
     pqxx::work txn(*conn);
     std::stringstream ss;
-    ss << "CREATE TABLE " << txn.quote_name(schema.title) << " (";
+    ss << "CREATE TABLE " << base::quoteTable(schema.title, true) << " (";
     for (size_t i = 0; i < schema.columns.size(); ++i) {
         const auto& col = schema.columns[i];
         ss << txn.quote_name(col.name) << " " << col.type;
@@ -187,9 +970,133 @@ bool PostgreSqlDB::createTable(const types::TableSchema& schema) {
 
 bool PostgreSqlDB::dropTable(const std::string& tableName) {
     pqxx::work txn(*conn);
-    txn.exec("DROP TABLE IF EXISTS " + txn.quote_name(tableName) + ";");
+    txn.exec("DROP TABLE IF EXISTS " + base::quoteTable(tableName, true) + ";");
     txn.commit();
     return true;
 }
 
+std::string PostgreSqlDB::readValue(const std::string& table, const std::pair<std::string, std::string>& where, const types::Column& column,
+                                    size_t& offset, size_t length) {
+    bool binary = column.type == "bytea";
+    pqxx::work txn(*conn);
+    std::string range = " FROM " + std::to_string(offset + 1) + " FOR " + std::to_string(length) + ")";
+    std::string name = txn.quote_name(column.name);
+    std::string value = binary ? "encode(substring(" + name + range + ", 'hex')" : "substring(" + name + "::text" + range;
+    auto res = txn.exec("SELECT " + value + " FROM " + base::quoteTable(table, true) + " WHERE " + txn.quote_name(where.first) + " = " +
+                        txn.quote(where.second) + ";");
+    txn.commit();
+
+    if (res.empty() || res[0][0].is_null())
+        return "";
+    std::string chunk = res[0][0].c_str();
+    if (chunk.empty())
+        return chunk;
+    // substring считает байты bytea и символы текста; bytea отдаётся в том же hex-формате, что и в select
+    if (!binary) {
+        offset += characters(chunk);
+        return chunk;
+    }
+    bool first = offset == 0;
+    offset += chunk.size() / 2;
+    return first ? "\\x" + chunk : chunk;
+}
+
+std::string PostgreSqlDB::copyCommand(const std::string& table, const std::vector<std::string>& columns, CopyFormat format, bool out) const {
+    std::string command = "COPY " + base::quoteTable(table, true);
+    for (size_t i = 0; i < columns.size(); ++i) {
+        command += (i == 0 ? " (" : ", ") + conn->quote_name(columns[i]);
+    }
+    if (!columns.empty())
+        command += ")";
+    command += out ? " TO STDOUT" : " FROM STDIN";
+    if (format == CopyFormat::Csv)
+        command += " WITH (FORMAT csv, HEADER true)";
+    else if (format == CopyFormat::Binary)
+        command += " WITH (FORMAT binary)";
+    return command;
+}
+
+size_t PostgreSqlDB::copyOut(const std::string& table, const std::vector<std::string>& columns, CopyFormat format, std::FILE* out,
+                             const CopyProgress& progress, const std::atomic<bool>& stop) {
+    TRACE_SPAN("pg.copyOut");
+    CopyConnection copy(conninfo());
+    copy.start(copyCommand(table, columns, format, true), PGRES_COPY_OUT);
+
+    size_t bytes = 0, reported = 0;
+    bool cancelled = false, failed = false;
+    char* buffer = nullptr;
+    int length;
+    // Строки приходят по одной, запись в файл буферизуется stdio
+    while ((length = PQgetCopyData(copy.get(), &buffer, 0)) > 0) {
+        if (!failed && std::fwrite(buffer, 1, length, out) != static_cast<size_t>(length))
+            failed = true;
+        PQfreemem(buffer);
+        bytes += length;
+        if (progress && bytes - reported >= COPY_CHUNK) {
+            progress(bytes);
+            reported = bytes;
+        }
+        if ((stop || failed) && !cancelled) {
+            copy.cancel();
+            cancelled = true;
+        }
+    }
+    if (failed)
+        throw std::runtime_error("Failed to write COPY output");
+    if (cancelled) {
+        try {
+            copy.finish();
+        } catch (const std::exception&) {
+        }
+        return 0;
+    }
+    if (length == -2)
+        throw std::runtime_error("COPY failed: " + std::string(PQerrorMessage(copy.get())));
+
+    size_t rows = copy.finish();
+    if (progress)
+        progress(bytes);
+    return rows;
+}
+
+size_t PostgreSqlDB::copyIn(const std::string& table, const std::vector<std::string>& columns, CopyFormat format, std::FILE* in,
+                            const CopyProgress& progress, const std::atomic<bool>& stop) {
+    TRACE_SPAN("pg.copyIn");
+    CopyConnection copy(conninfo());
+    copy.start(copyCommand(table, columns, format, false), PGRES_COPY_IN);
+
+    std::vector<char> buffer(COPY_CHUNK);
+    size_t bytes = 0;
+    const char* abort = nullptr;
+    while (!stop) {
+        size_t length = std::fread(buffer.data(), 1, buffer.size(), in);
+        if (length == 0) {
+            if (std::ferror(in))
+                abort = "aleto: failed to read input";
+            break;
+        }
+        if (PQputCopyData(copy.get(), buffer.data(), static_cast<int>(length)) != 1)
+            throw std::runtime_error("COPY failed: " + std::string(PQerrorMessage(copy.get())));
+        bytes += length;
+        if (progress)
+            progress(bytes);
+    }
+    if (stop)
+        abort = "aleto: cancelled";
+
+    // Сообщение об ошибке в PQputCopyEnd откатывает всю загрузку на сервере
+    if (PQputCopyEnd(copy.get(), abort) != 1)
+        throw std::runtime_error("COPY failed: " + std::string(PQerrorMessage(copy.get())));
+    if (abort != nullptr) {
+        try {
+            copy.finish();
+        } catch (const std::exception&) {
+        }
+        if (stop)
+            return 0;
+        throw std::runtime_error("Failed to read COPY input");
+    }
+    return copy.finish();
+}
+
 }  // namespace postgresql
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdio>
+#include <functional>
 #include <memory>
 #include <pqxx/pqxx>
 
@@ -7,24 +9,87 @@
 
 namespace postgresql {
 
+// Text - формат COPY по умолчанию (табуляция, \N для NULL)
+enum class CopyFormat { Text, Csv, Binary };
+
+// Вызывается по мере передачи COPY с числом переданных байт
+using CopyProgress = std::function<void(size_t bytes)>;
+
 class PostgreSqlDB : public base::Database {
  public:
     explicit PostgreSqlDB(const std::string& host, int port, const std::string& user, const std::string& password, const std::string& database);
     ~PostgreSqlDB() override;
 
+    std::unique_ptr<base::Database> clone() const override;
+    std::string connectionId() const override;
+    std::string dataVersion() override;
+    std::map<std::string, std::string> tableVersions() override;
+    std::string catalogVersion() override;
+
     bool executeQuery(const std::string& sql) override;
+    types::TableData query(const std::string& sql) override;
+    size_t stream(const std::string& sql, base::RowSink& sink, const std::atomic<bool>& stop) override;
+    size_t streamTable(const std::string& table, const std::vector<std::string>& columns, base::RowSink& sink,
+                       const std::atomic<bool>& stop) override;
+    size_t streamRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key, const std::string& from,
+                       const std::string& to, base::RowSink& sink, const std::atomic<bool>& stop) override;
+    types::RangeHash hashRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key, const std::string& from,
+                               const std::string& to) override;
+    std::string exportSnapshot() override;
+    void useSnapshot(const std::string& id) override;
+    void releaseSnapshot() override;
+    std::unique_ptr<base::ChangeFeed> watch(const std::vector<std::string>& tables, bool installTriggers) override;
+    std::vector<std::string> listTables() override;
     std::vector<types::TableSchema> getTables() override;
-    types::TableData select(const std::string& table, int offset, int limit) override;
+    types::TableSchema describe(const std::string& table) override;
+    types::TableData select(const std::string& table, int offset, int limit, const std::vector<std::string>& columns) override;
+    types::TableData seek(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                          int limit, const std::vector<std::string>& columns, bool hashes) override;
+    types::TableData seekHashes(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                int limit) override;
+    types::TableData selectKeys(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                const std::vector<std::string>& columns) override;
+    std::vector<std::string> pageAnchors(const std::string& table, const std::string& key, int step, const std::atomic<bool>& stop) override;
     bool editRow(const std::string& table, const std::pair<std::string, std::string>& where,
                  const std::vector<std::pair<std::string, std::string>>& values) override;
     bool addRow(const std::string& table, const std::vector<std::pair<std::string, std::string>>& values) override;
+    types::BatchResult addRows(const std::string& table, const types::ColumnBatch& batch, bool continueOnError) override;
+    std::unique_ptr<base::BulkLoader> bulkLoad(const std::string& table, const std::vector<std::string>& columns,
+                                               const base::LoadOptions& options) override;
     bool removeRow(const std::string& table, const std::pair<std::string, std::string>& where) override;
+    size_t removeRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys) override;
+    size_t updateRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                      const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls) override;
+    std::vector<std::string> filterKeys(const std::string& table, const std::string& key, const std::string& where, const std::string& from,
+                                        int limit) override;
     types::TableData search(const std::string& table, const std::string& column, const std::string& pattern, int limit) override;
     bool createTable(const types::TableSchema& schema) override;
     bool dropTable(const std::string& tableName) override;
+    std::string readValue(const std::string& table, const std::pair<std::string, std::string>& where, const types::Column& column, size_t& offset,
+                          size_t length) override;
+
+    // Массовая выгрузка и загрузка через COPY на отдельном подключении libpq, возвращают число строк.
+    // CSV идёт с заголовком. После stop передача прерывается, выгрузка возвращает 0, загрузка откатывается
+    size_t copyOut(const std::string& table, const std::vector<std::string>& columns, CopyFormat format, std::FILE* out,
+                   const CopyProgress& progress, const std::atomic<bool>& stop);
+    size_t copyIn(const std::string& table, const std::vector<std::string>& columns, CopyFormat format, std::FILE* in,
+                  const CopyProgress& progress, const std::atomic<bool>& stop);
 
  private:
+    std::string host;
+    int port;
+    std::string user;
+    std::string password;
+    std::string database;
     std::unique_ptr<pqxx::connection> conn;
+    // Транзакция, держащая экспортированный снимок, и снимок, импортируемый потоковым чтением
+    std::unique_ptr<pqxx::work> exported;
+    std::string snapshot;
+
+    std::string conninfo() const;
+    size_t changeRows(pqxx::work& txn, const std::string& head, const std::string& key, const std::vector<std::string>& keys);
+    std::string copyCommand(const std::string& table, const std::vector<std::string>& columns, CopyFormat format, bool out) const;
+    std::string selectList(pqxx::transaction_base& txn, const std::vector<types::Column>& described, std::vector<int>& large) const;
 };
 
 }  // namespace postgresql
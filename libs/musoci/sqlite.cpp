@@ -1,23 +1,532 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <thread>
 #include <sstream>
 #include <stdexcept>
 #include <string>
 #include <vector>
 
 #include "sqlite.hpp"
+#include "trace.hpp"
 
 namespace sqlite {
 
+namespace {
+
+void readColumns(sqlite3_stmt* stmt, types::TableData& result) {
+    int colCount = sqlite3_column_count(stmt);
+    for (int i = 0; i < colCount; ++i) {
+        const char* type = sqlite3_column_decltype(stmt, i);
+        result.columns.push_back(types::Column(sqlite3_column_name(stmt, i), true, false, type ? type : ""));
+    }
+}
+
+void readRows(sqlite3_stmt* stmt, types::TableData& result) {
+    TRACE_SPAN("sqlite.readRows");
+    int colCount = sqlite3_column_count(stmt);
+    int rc;
+    {
+        // Первый шаг включает пропуск строк OFFSET и сортировку
+        TRACE_SPAN("sqlite.firstStep");
+        rc = sqlite3_step(stmt);
+    }
+    for (; rc == SQLITE_ROW; rc = sqlite3_step(stmt)) {
+        std::vector<std::string> row;
+        row.reserve(colCount);
+        for (int i = 0; i < colCount; ++i) {
+            if (sqlite3_column_type(stmt, i) == SQLITE_NULL)
+                result.nulls.emplace(static_cast<int>(result.data.size()), i);
+            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+            row.emplace_back(text ? text : "");
+        }
+        result.data.push_back(std::move(row));
+    }
+    result.count = static_cast<int>(result.data.size());
+}
+
+std::string projection(const std::vector<std::string>& columns) {
+    if (columns.empty())
+        return "*";
+    std::string list;
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (i != 0)
+            list += ", ";
+        list += base::quoteName(columns[i]);
+    }
+    return list;
+}
+
+// Строковый литерал SQL
+std::string literal(const std::string& value) {
+    std::string quoted = "'";
+    for (char c : value) {
+        quoted += c;
+        if (c == '\'')
+            quoted += c;
+    }
+    return quoted + "'";
+}
+
+const size_t STATEMENT_CACHE = 64;
+
+// Наибольшее число ключей в одном IN-списке
+const size_t KEYS_PER_STATEMENT = 10000;
+
+// Ключей в одном IN-списке с учётом предела переменных соединения (999 до SQLite 3.32, дальше 32766 или
+// значение сборки); bound - переменные, занятые до списка ключей
+size_t keysPerStatement(sqlite3* db, size_t bound) {
+    size_t variables = static_cast<size_t>(sqlite3_limit(db, SQLITE_LIMIT_VARIABLE_NUMBER, -1));
+    return variables > bound ? std::min(KEYS_PER_STATEMENT, variables - bound) : 1;
+}
+
+std::string placeholders(size_t count) {
+    std::string list;
+    for (size_t i = 0; i < count; ++i) {
+        list += i == 0 ? "?" : ", ?";
+    }
+    return list;
+}
+
+// Значение вида \xABCD (так stream выдаёт BLOB) в байты, false - если это не шестнадцатеричная запись
+bool decodeHex(std::string_view value, std::string& bytes) {
+    if (value.size() < 2 || value[0] != '\\' || value[1] != 'x' || value.size() % 2 != 0)
+        return false;
+    auto digit = [](char c) { return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1; };
+    bytes.clear();
+    for (size_t i = 2; i < value.size(); i += 2) {
+        int high = digit(value[i]), low = digit(value[i + 1]);
+        if (high < 0 || low < 0)
+            return false;
+        bytes += static_cast<char>(high << 4 | low);
+    }
+    return true;
+}
+
+// aleto_hash(...): FNV-1a по типам и значениям аргументов в виде 16 шестнадцатеричных цифр.
+// Тип и длина входят в хеш, чтобы NULL, '' и соседние значения с перенесённой границей различались
+void rowHash(sqlite3_context* context, int argc, sqlite3_value** argv) {
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash](const unsigned char* bytes, size_t size) {
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+    };
+    for (int i = 0; i < argc; ++i) {
+        unsigned char type = static_cast<unsigned char>(sqlite3_value_type(argv[i]));
+        const void* data = type == SQLITE_BLOB ? sqlite3_value_blob(argv[i]) : sqlite3_value_text(argv[i]);
+        uint32_t size = static_cast<uint32_t>(sqlite3_value_bytes(argv[i]));
+        mix(&type, 1);
+        mix(reinterpret_cast<const unsigned char*>(&size), sizeof(size));
+        mix(static_cast<const unsigned char*>(data), data ? size : 0);
+    }
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+    sqlite3_result_text(context, hex, 16, SQLITE_TRANSIENT);
+}
+
+// MD5 (RFC 1321) - тот же хеш строки, что md5() в PostgreSQL
+void md5(const unsigned char* data, size_t size, unsigned char digest[16]) {
+    static const uint32_t K[64] = {
+        0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1,
+        0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453,
+        0xd8a1e681, 0xe7d3fbc8, 0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a, 0xfffa3942,
+        0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+        0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665, 0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d,
+        0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391};
+    static const int R[64] = {7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20, 5, 9,  14, 20,
+                              4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21};
+
+    std::string message(reinterpret_cast<const char*>(data), size);
+    message += static_cast<char>(0x80);
+    while (message.size() % 64 != 56) {
+        message += '\0';
+    }
+    uint64_t bits = static_cast<uint64_t>(size) * 8;
+    for (int i = 0; i < 8; ++i) {
+        message += static_cast<char>(bits >> (8 * i));
+    }
+
+    uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    for (size_t block = 0; block < message.size(); block += 64) {
+        uint32_t w[16];
+        for (int i = 0; i < 16; ++i) {
+            const auto* p = reinterpret_cast<const unsigned char*>(message.data() + block + i * 4);
+            w[i] = p[0] | p[1] << 8 | p[2] << 16 | static_cast<uint32_t>(p[3]) << 24;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+            uint32_t rotated = a + f + K[i] + w[g];
+            a = d;
+            d = c;
+            c = b;
+            b += rotated << R[i] | rotated >> (32 - R[i]);
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+    }
+    for (int i = 0; i < 16; ++i) {
+        digest[i] = static_cast<unsigned char>(h[i / 4] >> (8 * (i % 4)));
+    }
+}
+
+// aleto_md5_bigint(text): первые 8 байт MD5 как знаковое целое, как ('x' || substr(md5(text), 1, 16))::bit(64)::bigint
+void md5Bigint(sqlite3_context* context, int, sqlite3_value** argv) {
+    unsigned char digest[16];
+    md5(sqlite3_value_text(argv[0]), static_cast<size_t>(sqlite3_value_bytes(argv[0])), digest);
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value = value << 8 | digest[i];
+    }
+    sqlite3_result_int64(context, static_cast<sqlite3_int64>(value));
+}
+
+// aleto_sum(x): точная сумма целых без переполнения десятичным текстом, как sum(bigint) в PostgreSQL.
+// Сумма - 128-битное число в дополнительном коде из двух половин с переносом, без __int128
+struct ExactSum {
+    uint64_t low = 0;
+    uint64_t high = 0;
+};
+
+// Память агрегата выровнена только на 8 байт и не обязана быть объектом, поэтому сумма копируется, а не читается по указателю
+void exactSumStep(sqlite3_context* context, int, sqlite3_value** argv) {
+    void* state = sqlite3_aggregate_context(context, sizeof(ExactSum));
+    if (!state || sqlite3_value_type(argv[0]) == SQLITE_NULL)
+        return;
+    ExactSum sum;
+    std::memcpy(&sum, state, sizeof(sum));
+    int64_t value = sqlite3_value_int64(argv[0]);
+    uint64_t low = sum.low + static_cast<uint64_t>(value);
+    sum.high += (value < 0 ? ~uint64_t{0} : 0) + (low < sum.low ? 1 : 0);
+    sum.low = low;
+    std::memcpy(state, &sum, sizeof(sum));
+}
+
+void exactSumFinal(sqlite3_context* context) {
+    void* state = sqlite3_aggregate_context(context, 0);
+    if (!state) {
+        sqlite3_result_null(context);
+        return;
+    }
+    ExactSum sum;
+    std::memcpy(&sum, state, sizeof(sum));
+    bool negative = (sum.high >> 63) != 0;
+    if (negative) {
+        sum.low = ~sum.low + 1;
+        sum.high = ~sum.high + (sum.low == 0 ? 1 : 0);
+    }
+    // Деление модуля на 10 по 32-битным частям, от старшей к младшей
+    uint32_t parts[4] = {static_cast<uint32_t>(sum.high >> 32), static_cast<uint32_t>(sum.high), static_cast<uint32_t>(sum.low >> 32),
+                         static_cast<uint32_t>(sum.low)};
+    std::string text;
+    bool more = true;
+    while (more) {
+        uint64_t rest = 0;
+        more = false;
+        for (auto& part : parts) {
+            uint64_t current = (rest << 32) | part;
+            part = static_cast<uint32_t>(current / 10);
+            rest = current % 10;
+            more = more || part != 0;
+        }
+        text += static_cast<char>('0' + rest);
+    }
+    if (negative)
+        text += '-';
+    std::reverse(text.begin(), text.end());
+    sqlite3_result_text(context, text.c_str(), static_cast<int>(text.size()), SQLITE_TRANSIENT);
+}
+
+void registerFunctions(sqlite3* db) {
+    sqlite3_create_function(db, "aleto_hash", -1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr, rowHash, nullptr, nullptr);
+    sqlite3_create_function(db, "aleto_md5_bigint", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, nullptr, md5Bigint, nullptr, nullptr);
+    sqlite3_create_function(db, "aleto_sum", 1, SQLITE_UTF8, nullptr, nullptr, exactSumStep, exactSumFinal);
+}
+
+// Период опроса PRAGMA data_version
+const std::chrono::milliseconds DATA_VERSION_POLL{100};
+
+// Счётчики фиксаций по таблицам для изменений, сделанных подключениями этого процесса: файл -> таблица -> счётчик
+std::mutex commitsMutex;
+std::map<std::string, std::map<std::string, uint64_t>> commits;
+
+std::map<std::string, uint64_t> commitCounters(const std::string& path) {
+    std::lock_guard<std::mutex> lock(commitsMutex);
+    auto it = commits.find(path);
+    return it != commits.end() ? it->second : std::map<std::string, uint64_t>{};
+}
+
+// data_version меняется, когда базу зафиксировало другое подключение. Какие таблицы изменились, известно только
+// для подключений этого процесса; изменение извне помечает изменёнными все наблюдаемые таблицы
+class SQLiteChangeFeed : public base::ChangeFeed {
+ public:
+    SQLiteChangeFeed(std::string path, const std::vector<std::string>& tables) : path(std::move(path)), tables(tables) {
+        if (sqlite3_open_v2(this->path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+            std::string error = sqlite3_errmsg(db);
+            sqlite3_close(db);
+            throw std::runtime_error("Failed to open database for watching: " + error);
+        }
+        if (sqlite3_prepare_v2(db, "PRAGMA data_version;", -1, &stmt, nullptr) != SQLITE_OK) {
+            std::string error = sqlite3_errmsg(db);
+            sqlite3_close(db);
+            throw std::runtime_error("Failed to watch database: " + error);
+        }
+        version = dataVersion();
+        counters = commitCounters(this->path);
+    }
+
+    ~SQLiteChangeFeed() override {
+        sqlite3_finalize(stmt);
+        sqlite3_close(db);
+    }
+
+    std::vector<std::string> wait(std::chrono::milliseconds timeout) override {
+        auto until = std::chrono::steady_clock::now() + timeout;
+        while (true) {
+            long long current = dataVersion();
+            if (current != version) {
+                version = current;
+                return changedTables();
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (now >= until)
+                return {};
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(DATA_VERSION_POLL, until - now));
+        }
+    }
+
+ private:
+    std::string path;
+    std::vector<std::string> tables;
+    sqlite3* db = nullptr;
+    sqlite3_stmt* stmt = nullptr;
+    long long version = 0;
+    std::map<std::string, uint64_t> counters;
+
+    // Запрос сбрасывается сразу, иначе открытая транзакция чтения мешала бы писателям
+    long long dataVersion() {
+        bool read = sqlite3_step(stmt) == SQLITE_ROW;
+        long long value = read ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_reset(stmt);
+        if (!read)
+            throw std::runtime_error("Failed to read data_version: " + std::string(sqlite3_errmsg(db)));
+        return value;
+    }
+
+    std::vector<std::string> changedTables() {
+        std::map<std::string, uint64_t> current = commitCounters(path);
+        std::vector<std::string> changed;
+        for (const auto& table : tables) {
+            auto it = current.find(table);
+            if (it != current.end() && counters[table] != it->second)
+                changed.push_back(table);
+        }
+        counters = std::move(current);
+        return changed.empty() ? tables : changed;
+    }
+};
+
+// Все строки в одной транзакции через один подготовленный INSERT
+class SQLiteLoader : public base::BulkLoader {
+ public:
+    SQLiteLoader(sqlite3* db, const std::string& table, const std::vector<std::string>& columns, bool hexBlobs) : db(db) {
+        // С hexBlobs колонки BLOB принимают шестнадцатеричную запись, в которой значения отдаёт другая база при переносе
+        if (hexBlobs) {
+            std::string probe = "SELECT " + projection(columns) + " FROM " + base::quoteName(table) + " LIMIT 0;";
+            if (sqlite3_prepare_v2(db, probe.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+                throw std::runtime_error("Failed to prepare insert: " + std::string(sqlite3_errmsg(db)));
+            for (int i = 0; i < sqlite3_column_count(stmt); ++i) {
+                const char* type = sqlite3_column_decltype(stmt, i);
+                std::string upper = type ? type : "";
+                std::transform(upper.begin(), upper.end(), upper.begin(), [](unsigned char c) { return std::toupper(c); });
+                blobs.push_back(upper.find("BLOB") != std::string::npos);
+            }
+            sqlite3_finalize(stmt);
+            stmt = nullptr;
+        }
+
+        std::string sql = "INSERT INTO " + base::quoteName(table) + " (" + projection(columns) + ") VALUES (" + placeholders(columns.size()) + ");";
+        if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+            throw std::runtime_error("Failed to prepare insert: " + std::string(sqlite3_errmsg(db)));
+        char* errMsg = nullptr;
+        if (sqlite3_exec(db, "BEGIN;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+            std::string error = errMsg ? errMsg : "";
+            sqlite3_free(errMsg);
+            sqlite3_finalize(stmt);
+            throw std::runtime_error("Failed to begin transaction: " + error);
+        }
+    }
+
+    ~SQLiteLoader() override {
+        if (stmt)
+            sqlite3_finalize(stmt);
+        if (open)
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
+
+    // Ошибка строки отменяет только эту строку, транзакция продолжается
+    void row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) override {
+        for (size_t i = 0; i < values.size(); ++i) {
+            int index = static_cast<int>(i + 1);
+            if (nulls[i])
+                sqlite3_bind_null(stmt, index);
+            else if (i < blobs.size() && blobs[i] && decodeHex(values[i], bytes))
+                sqlite3_bind_blob(stmt, index, bytes.data(), static_cast<int>(bytes.size()), SQLITE_TRANSIENT);
+            else
+                sqlite3_bind_text(stmt, index, values[i].data(), static_cast<int>(values[i].size()), SQLITE_STATIC);
+        }
+        int rc = sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+        if (rc != SQLITE_DONE)
+            throw std::runtime_error(sqlite3_errmsg(db));
+        ++count;
+    }
+
+    size_t finish() override {
+        sqlite3_finalize(stmt);
+        stmt = nullptr;
+        char* errMsg = nullptr;
+        if (sqlite3_exec(db, "COMMIT;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+            std::string error = errMsg ? errMsg : "";
+            sqlite3_free(errMsg);
+            throw std::runtime_error("Failed to commit: " + error);
+        }
+        open = false;
+        return count;
+    }
+
+ private:
+    sqlite3* db;
+    sqlite3_stmt* stmt = nullptr;
+    std::vector<bool> blobs;
+    std::string bytes;
+    bool open = true;
+    size_t count = 0;
+};
+
+}  // namespace
+
 SQLiteDB::SQLiteDB(const std::string& path) : dbPath(path) {
     if (sqlite3_open(dbPath.c_str(), &db) != SQLITE_OK) {
         throw std::runtime_error("Failed to open database: " + std::string(sqlite3_errmsg(db)));
         db = nullptr;
     }
+    // Изменённые таблицы копятся без блокировок и публикуются для наблюдателей один раз на фиксацию
+    sqlite3_update_hook(
+        db,
+        [](void* self, int, const char*, const char* table, sqlite3_int64) {
+            auto& touched = static_cast<SQLiteDB*>(self)->touched;
+            if (touched.find(std::string_view(table)) == touched.end())
+                touched.emplace(table);
+        },
+        this);
+    sqlite3_commit_hook(
+        db,
+        [](void* self) {
+            auto* owner = static_cast<SQLiteDB*>(self);
+            if (!owner->touched.empty()) {
+                std::lock_guard<std::mutex> lock(commitsMutex);
+                auto& counters = commits[owner->dbPath];
+                for (const auto& table : owner->touched) {
+                    ++counters[table];
+                }
+                owner->touched.clear();
+            }
+            return 0;
+        },
+        this);
+    sqlite3_rollback_hook(db, [](void* self) { static_cast<SQLiteDB*>(self)->touched.clear(); }, this);
+    registerFunctions(db);
 }
 
 SQLiteDB::~SQLiteDB() {
+    finalizeStatements();
     if (db)
         sqlite3_close(db);
+    releaseSnapshot();
+}
+
+void SQLiteDB::finalizeStatements() {
+    for (const auto& [_, stmt] : statements) {
+        sqlite3_finalize(stmt);
+    }
+    statements.clear();
+}
+
+sqlite3_stmt* SQLiteDB::cached(const std::string& sql) {
+    auto it = statements.find(sql);
+    if (it != statements.end()) {
+        sqlite3_reset(it->second);
+        return it->second;
+    }
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+        throw std::runtime_error("Failed to prepare statement: " + std::string(sqlite3_errmsg(db)));
+    // Запросы с разными наборами колонок не должны копиться без предела
+    if (statements.size() >= STATEMENT_CACHE)
+        finalizeStatements();
+    return statements[sql] = stmt;
+}
+
+std::unique_ptr<base::Database> SQLiteDB::clone() const {
+    return std::make_unique<SQLiteDB>(dbPath);
+}
+
+std::string SQLiteDB::connectionId() const {
+    return "sqlite:" + dbPath;
+}
+
+// data_version меняется при фиксациях других подключений, total_changes - при изменениях строк этим подключением,
+// schema_version - при изменении схемы любым подключением
+std::string SQLiteDB::dataVersion() {
+    std::string version;
+    for (const char* pragma : {"PRAGMA data_version;", "PRAGMA schema_version;"}) {
+        sqlite3_stmt* stmt = cached(pragma);
+        bool read = sqlite3_step(stmt) == SQLITE_ROW;
+        long long value = read ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_reset(stmt);
+        if (!read)
+            throw std::runtime_error("Failed to read data version: " + std::string(sqlite3_errmsg(db)));
+        version += std::to_string(value) + ":";
+    }
+    return version + std::to_string(sqlite3_total_changes64(db));
+}
+
+// Версий данных отдельных таблиц SQLite не ведёт: локальный файл и так читается быстрее, чем проверялись бы сохранённые страницы
+std::map<std::string, std::string> SQLiteDB::tableVersions() {
+    return {};
+}
+
+// schema_version из заголовка файла, она сравнима между подключениями и запусками
+std::string SQLiteDB::catalogVersion() {
+    sqlite3_stmt* stmt = cached("PRAGMA schema_version;");
+    bool read = sqlite3_step(stmt) == SQLITE_ROW;
+    long long value = read ? sqlite3_column_int64(stmt, 0) : 0;
+    sqlite3_reset(stmt);
+    if (!read)
+        throw std::runtime_error("Failed to read schema version: " + std::string(sqlite3_errmsg(db)));
+    return std::to_string(value);
 }
 
 bool SQLiteDB::executeQuery(const std::string& sql) {
@@ -30,6 +539,190 @@ bool SQLiteDB::executeQuery(const std::string& sql) {
     return true;
 }
 
+types::TableData SQLiteDB::query(const std::string& sql) {
+    TRACE_SPAN("sqlite.query");
+    types::TableData result;
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare query: " + std::string(sqlite3_errmsg(db)));
+    }
+
+    readColumns(stmt, result);
+    readRows(stmt, result);
+    int rc = sqlite3_finalize(stmt);
+    if (rc != SQLITE_OK) {
+        throw std::runtime_error("Failed to execute query: " + std::string(sqlite3_errmsg(db)));
+    }
+    return result;
+}
+
+size_t SQLiteDB::stream(const std::string& sql, base::RowSink& sink, const std::atomic<bool>& stop) {
+    TRACE_SPAN("sqlite.stream");
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare query: " + std::string(sqlite3_errmsg(db)));
+    }
+
+    types::TableData header;
+    readColumns(stmt, header);
+    sink.begin(header.columns);
+
+    // Значения передаются без копирования, BLOB - в шестнадцатеричном виде как bytea в PostgreSQL
+    int colCount = sqlite3_column_count(stmt);
+    std::vector<std::string_view> values(colCount);
+    std::vector<bool> nulls(colCount);
+    std::vector<std::string> hex(colCount);
+    static const char digits[] = "0123456789abcdef";
+
+    size_t count = 0;
+    int rc = SQLITE_DONE;
+    while (!stop && (rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        for (int i = 0; i < colCount; ++i) {
+            int type = sqlite3_column_type(stmt, i);
+            nulls[i] = type == SQLITE_NULL;
+            if (type == SQLITE_BLOB) {
+                auto bytes = static_cast<const unsigned char*>(sqlite3_column_blob(stmt, i));
+                int size = sqlite3_column_bytes(stmt, i);
+                hex[i].assign("\\x");
+                for (int k = 0; k < size; ++k) {
+                    hex[i] += digits[bytes[k] >> 4];
+                    hex[i] += digits[bytes[k] & 0xF];
+                }
+                values[i] = hex[i];
+            } else if (type != SQLITE_NULL) {
+                auto text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
+                values[i] = std::string_view(text, sqlite3_column_bytes(stmt, i));
+            } else {
+                values[i] = {};
+            }
+        }
+        sink.row(values, nulls);
+        ++count;
+    }
+
+    sqlite3_finalize(stmt);
+    if (!stop && rc != SQLITE_DONE) {
+        throw std::runtime_error("Failed to execute query: " + std::string(sqlite3_errmsg(db)));
+    }
+    return count;
+}
+
+size_t SQLiteDB::streamTable(const std::string& table, const std::vector<std::string>& columns, base::RowSink& sink,
+                             const std::atomic<bool>& stop) {
+    return stream("SELECT " + projection(columns) + " FROM " + base::quoteName(table) + ";", sink, stop);
+}
+
+size_t SQLiteDB::streamRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key, const std::string& from,
+                             const std::string& to, base::RowSink& sink, const std::atomic<bool>& stop) {
+    std::string k = base::quoteName(key);
+    std::string sql = "SELECT " + projection(columns) + " FROM " + base::quoteName(table);
+    if (!from.empty())
+        sql += " WHERE " + k + " >= " + literal(from);
+    if (!to.empty())
+        sql += (from.empty() ? " WHERE " : " AND ") + k + " < " + literal(to);
+    return stream(sql + " ORDER BY " + k + ";", sink, stop);
+}
+
+types::RangeHash SQLiteDB::hashRange(const std::string& table, const std::vector<std::string>& columns, const std::string& key,
+                                     const std::string& from, const std::string& to) {
+    TRACE_SPAN("sqlite.hashRange");
+    std::string row;
+    for (const auto& name : columns) {
+        std::string column = base::quoteName(name);
+        row += (row.empty() ? "" : " || char(31) || ") + std::string("coalesce(CASE typeof(") + column + ") WHEN 'blob' THEN '\\x' || lower(hex(" +
+               column + ")) ELSE CAST(" + column + " AS TEXT) END, '\\N')";
+    }
+    std::string k = base::quoteName(key);
+    std::string sql = "SELECT count(*), aleto_sum(aleto_md5_bigint(" + row + ")) FROM " + base::quoteName(table);
+    if (!from.empty())
+        sql += " WHERE " + k + " >= ?";
+    if (!to.empty())
+        sql += (from.empty() ? " WHERE " : " AND ") + k + " < ?";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, (sql + ";").c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to hash rows of table " + table + ": " + std::string(sqlite3_errmsg(db)));
+    }
+    int index = 1;
+    if (!from.empty())
+        sqlite3_bind_text(stmt, index++, from.c_str(), -1, SQLITE_STATIC);
+    if (!to.empty())
+        sqlite3_bind_text(stmt, index++, to.c_str(), -1, SQLITE_STATIC);
+
+    types::RangeHash result;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        result.rows = static_cast<size_t>(sqlite3_column_int64(stmt, 0));
+        const char* hash = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));
+        result.hash = hash ? hash : "";
+    }
+    sqlite3_finalize(stmt);
+    return result;
+}
+
+// Снимок - копия базы через backup API: копирование идёт под одной блокировкой чтения и потому согласовано
+std::string SQLiteDB::exportSnapshot() {
+    TRACE_SPAN("sqlite.exportSnapshot");
+    releaseSnapshot();
+    std::string path = dbPath + ".snapshot-" + std::to_string(reinterpret_cast<uintptr_t>(this));
+    sqlite3* copy = nullptr;
+    if (sqlite3_open(path.c_str(), &copy) != SQLITE_OK) {
+        std::string error = sqlite3_errmsg(copy);
+        sqlite3_close(copy);
+        throw std::runtime_error("Failed to create snapshot: " + error);
+    }
+    sqlite3_backup* backup = sqlite3_backup_init(copy, "main", db, "main");
+    int rc = backup ? sqlite3_backup_step(backup, -1) : SQLITE_ERROR;
+    sqlite3_backup_finish(backup);
+    std::string error = rc == SQLITE_DONE ? "" : sqlite3_errmsg(copy);
+    sqlite3_close(copy);
+    if (rc != SQLITE_DONE) {
+        std::remove(path.c_str());
+        throw std::runtime_error("Failed to create snapshot: " + error);
+    }
+    snapshotPath = path;
+    return snapshotPath;
+}
+
+// Подключение переоткрывается на копии только для чтения
+void SQLiteDB::useSnapshot(const std::string& id) {
+    sqlite3* copy = nullptr;
+    if (sqlite3_open_v2(id.c_str(), &copy, SQLITE_OPEN_READONLY, nullptr) != SQLITE_OK) {
+        std::string error = sqlite3_errmsg(copy);
+        sqlite3_close(copy);
+        throw std::runtime_error("Failed to open snapshot: " + error);
+    }
+    finalizeStatements();
+    sqlite3_close(db);
+    db = copy;
+    registerFunctions(db);
+}
+
+void SQLiteDB::releaseSnapshot() {
+    if (!snapshotPath.empty())
+        std::remove(snapshotPath.c_str());
+    snapshotPath.clear();
+}
+
+// Триггеры не нужны: изменения видны по data_version
+std::unique_ptr<base::ChangeFeed> SQLiteDB::watch(const std::vector<std::string>& tables, bool) {
+    return std::make_unique<SQLiteChangeFeed>(dbPath, tables);
+}
+
+std::vector<std::string> SQLiteDB::listTables() {
+    std::vector<std::string> tables;
+    sqlite3_stmt* stmt;
+    const char* sql = "SELECT name FROM sqlite_master WHERE type='table' AND name NOT LIKE 'sqlite_%' ORDER BY name;";
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to prepare statement for table list");
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        tables.emplace_back(reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+    return tables;
+}
+
 std::vector<types::TableSchema> SQLiteDB::getTables() {
     std::vector<types::TableSchema> tables;
     sqlite3_stmt* stmt;
@@ -45,7 +738,7 @@ std::vector<types::TableSchema> SQLiteDB::getTables() {
         types::TableSchema table{tableName, {}};
 
         // Загружаем колонки этой таблицы
-        std::string pragma = "PRAGMA table_info('" + tableName + "');";
+        std::string pragma = "PRAGMA table_info(" + literal(tableName) + ");";
         sqlite3_stmt* colStmt;
         if (sqlite3_prepare_v2(db, pragma.c_str(), -1, &colStmt, nullptr) != SQLITE_OK) {
             throw std::runtime_error("Failed to get columns for table: " + tableName);
@@ -66,47 +759,237 @@ std::vector<types::TableSchema> SQLiteDB::getTables() {
     return tables;
 }
 
-types::TableData SQLiteDB::select(const std::string& table, int offset, int limit) {
+// Большие значения урезаются до previewLimit, их полные длины идут отдельными колонками в конце
+std::string SQLiteDB::selectList(const std::string& table, const std::vector<std::string>& columns, std::vector<int>& large) {
+    TRACE_SPAN("sqlite.selectList");
+    if (previewLimit == 0)
+        return projection(columns);
+
+    std::vector<types::Column> all = describe(table).columns;
+    std::vector<std::string> names = columns;
+    if (names.empty()) {
+        for (const auto& column : all) {
+            names.push_back(column.name);
+        }
+    }
+
+    std::string list, lengths;
+    for (size_t i = 0; i < names.size(); ++i) {
+        const std::string& name = names[i];
+        auto it = std::find_if(all.begin(), all.end(), [&name](const types::Column& c) { return c.name == name; });
+        std::string quoted = base::quoteName(name);
+        if (i != 0)
+            list += ", ";
+        if (it == all.end() || !isLargeType(it->type)) {
+            list += quoted;
+            continue;
+        }
+        large.push_back(static_cast<int>(i));
+        list += "substr(" + quoted + ", 1, " + std::to_string(previewLimit) + ") AS " + quoted;
+        lengths += ", length(" + quoted + ")";
+    }
+    return list + lengths;
+}
+
+types::TableSchema SQLiteDB::describe(const std::string& table) {
+    types::TableSchema schema{table, {}};
+
+    std::string pragma = "PRAGMA table_info(" + literal(table) + ");";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, pragma.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to get columns for table: " + table);
+    }
+
+    std::vector<std::string> keys;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        types::Column col;
+        col.name = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 1));  // name
+        col.type = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 2));  // type
+        col.nullable = sqlite3_column_int(stmt, 3) == 0;                         // notnull
+        col.primary_key = sqlite3_column_int(stmt, 5) > 0;                       // pk
+        if (col.primary_key)
+            keys.push_back(col.name);
+        schema.columns.push_back(col);
+    }
+    sqlite3_finalize(stmt);
+
+    // Без явного первичного ключа навигация идёт по rowid
+    if (keys.size() == 1)
+        schema.rowKey = keys[0];
+    else if (keys.empty())
+        schema.rowKey = "rowid";
+    return schema;
+}
+
+types::TableData SQLiteDB::select(const std::string& table, int offset, int limit, const std::vector<std::string>& columns) {
+    TRACE_SPAN("sqlite.select");
     types::TableData result;
     result.title = table;
 
     std::ostringstream query;
-    query << "SELECT * FROM " << table << " LIMIT " << limit << " OFFSET " << offset << ";";
+    std::vector<int> large;
+    query << "SELECT " << selectList(table, columns, large) << " FROM " << base::quoteName(table) << " LIMIT " << limit << " OFFSET " << offset
+          << ";";
     sqlite3_stmt* stmt;
 
-    if (sqlite3_prepare_v2(db, query.str().c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    int rc;
+    {
+        TRACE_SPAN("sqlite.prepare");
+        rc = sqlite3_prepare_v2(db, query.str().c_str(), -1, &stmt, nullptr);
+    }
+    if (rc != SQLITE_OK) {
         return result;
     }
 
-    int colCount = sqlite3_column_count(stmt);
-    for (int i = 0; i < colCount; ++i) {
-        result.columns.push_back(types::Column(sqlite3_column_name(stmt, i), true, false, sqlite3_column_decltype(stmt, i)));
-    }
+    readColumns(stmt, result);
+    readRows(stmt, result);
+    sqlite3_finalize(stmt);
 
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        std::vector<std::string> row;
-        for (int i = 0; i < colCount; ++i) {
-            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
-            row.emplace_back(text ? text : "");
+    result.columns.resize(result.columns.size() - large.size());
+    applyPreview(result, large);
+    return result;
+}
+
+types::TableData SQLiteDB::seek(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                int limit, const std::vector<std::string>& columns, bool hashes) {
+    TRACE_SPAN("sqlite.seek");
+    types::TableData result;
+    result.title = table;
+
+    std::ostringstream query;
+    std::vector<int> large;
+    query << "SELECT " << selectList(table, columns, large);
+    // Хеш идёт последней колонкой, после длин усечённых значений, и считается по всем колонкам, как в seekHashes
+    if (hashes) {
+        std::vector<std::string> all;
+        for (const auto& column : describe(table).columns) {
+            all.push_back(column.name);
         }
-        result.data.push_back(std::move(row));
+        query << ", aleto_hash(" << projection(all) << ")";
     }
+    std::string k = base::quoteName(key);
+    query << " FROM " << base::quoteName(table);
+    if (!from.empty())
+        query << " WHERE " << k << (inclusive ? " >= ?" : " > ?");
+    query << " ORDER BY " << k << " LIMIT " << limit << " OFFSET " << offset << ";";
 
-    result.count = static_cast<int>(result.data.size());
+    sqlite3_stmt* stmt;
+    int rc;
+    {
+        TRACE_SPAN("sqlite.prepare");
+        rc = sqlite3_prepare_v2(db, query.str().c_str(), -1, &stmt, nullptr);
+    }
+    if (rc != SQLITE_OK) {
+        throw std::runtime_error("Failed to seek in table " + table + ": " + std::string(sqlite3_errmsg(db)));
+    }
+    if (!from.empty())
+        sqlite3_bind_text(stmt, 1, from.c_str(), -1, SQLITE_STATIC);
+
+    readColumns(stmt, result);
+    readRows(stmt, result);
+    sqlite3_finalize(stmt);
+
+    result.columns.resize(result.columns.size() - large.size() - (hashes ? 1 : 0));
+    if (hashes)
+        takeHashes(result);
+    applyPreview(result, large);
+    return result;
+}
+
+types::TableData SQLiteDB::seekHashes(const std::string& table, const std::string& key, const std::string& from, bool inclusive, int offset,
+                                      int limit) {
+    TRACE_SPAN("sqlite.seekHashes");
+    types::TableData result;
+    result.title = table;
+
+    std::vector<std::string> columns;
+    for (const auto& column : describe(table).columns) {
+        columns.push_back(column.name);
+    }
+    std::string k = base::quoteName(key);
+    std::ostringstream query;
+    query << "SELECT " << k << ", aleto_hash(" << projection(columns) << ") FROM " << base::quoteName(table);
+    if (!from.empty())
+        query << " WHERE " << k << (inclusive ? " >= ?" : " > ?");
+    query << " ORDER BY " << k << " LIMIT " << limit << " OFFSET " << offset << ";";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, query.str().c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to hash rows of table " + table + ": " + std::string(sqlite3_errmsg(db)));
+    }
+    if (!from.empty())
+        sqlite3_bind_text(stmt, 1, from.c_str(), -1, SQLITE_STATIC);
+
+    readColumns(stmt, result);
+    readRows(stmt, result);
     sqlite3_finalize(stmt);
     return result;
 }
 
+types::TableData SQLiteDB::selectKeys(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                                      const std::vector<std::string>& columns) {
+    TRACE_SPAN("sqlite.selectKeys");
+    types::TableData result;
+    result.title = table;
+    if (keys.empty())
+        return result;
+
+    std::vector<int> large;
+    std::string head = "SELECT " + selectList(table, columns, large) + " FROM " + base::quoteName(table) + " WHERE " + base::quoteName(key) + " IN (";
+    size_t step = keysPerStatement(db, 0);
+    for (size_t first = 0; first < keys.size(); first += step) {
+        size_t count = std::min(step, keys.size() - first);
+        sqlite3_stmt* stmt;
+        if (sqlite3_prepare_v2(db, (head + placeholders(count) + ");").c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+            throw std::runtime_error("Failed to select rows of table " + table + ": " + std::string(sqlite3_errmsg(db)));
+        }
+        for (size_t i = 0; i < count; ++i) {
+            sqlite3_bind_text(stmt, static_cast<int>(i + 1), keys[first + i].c_str(), -1, SQLITE_STATIC);
+        }
+        if (result.columns.empty())
+            readColumns(stmt, result);
+        readRows(stmt, result);
+        sqlite3_finalize(stmt);
+    }
+
+    result.columns.resize(result.columns.size() - large.size());
+    applyPreview(result, large);
+    return result;
+}
+
+std::vector<std::string> SQLiteDB::pageAnchors(const std::string& table, const std::string& key, int step, const std::atomic<bool>& stop) {
+    std::vector<std::string> anchors;
+
+    // Выборка одного ключа позволяет sqlite пройти только по индексу
+    std::string k = base::quoteName(key);
+    std::string sql = "SELECT " + k + " FROM " + base::quoteName(table) + " ORDER BY " + k + ";";
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to walk keys of table " + table + ": " + std::string(sqlite3_errmsg(db)));
+    }
+
+    long long row = 0;
+    while (!stop && sqlite3_step(stmt) == SQLITE_ROW) {
+        if (row++ % step != 0)
+            continue;
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        anchors.emplace_back(text ? text : "");
+    }
+
+    sqlite3_finalize(stmt);
+    return anchors;
+}
+
 bool SQLiteDB::editRow(const std::string& table, const std::pair<std::string, std::string>& where,
                        const std::vector<std::pair<std::string, std::string>>& values) {
     std::ostringstream query;
-    query << "UPDATE " << table << " SET ";
+    query << "UPDATE " << base::quoteName(table) << " SET ";
     for (size_t i = 0; i < values.size(); ++i) {
-        query << values[i].first << " = ?";
+        query << base::quoteName(values[i].first) << " = ?";
         if (i + 1 < values.size())
             query << ", ";
     }
-    query << " WHERE " << where.first << " = ?;";
+    query << " WHERE " << base::quoteName(where.first) << " = ?;";
 
     sqlite3_stmt* stmt;
     if (sqlite3_prepare_v2(db, query.str().c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
@@ -125,7 +1008,7 @@ bool SQLiteDB::editRow(const std::string& table, const std::pair<std::string, st
 }
 
 bool SQLiteDB::removeRow(const std::string& table, const std::pair<std::string, std::string>& where) {
-    std::string sql = "DELETE FROM " + table + " WHERE " + where.first + " = ?";
+    std::string sql = "DELETE FROM " + base::quoteName(table) + " WHERE " + base::quoteName(where.first) + " = ?";
 
     sqlite3_stmt* stmt = nullptr;
     if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
@@ -142,11 +1025,88 @@ bool SQLiteDB::removeRow(const std::string& table, const std::pair<std::string,
     return success;
 }
 
+size_t SQLiteDB::removeRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys) {
+    TRACE_SPAN("sqlite.removeRows");
+    return changeRows("DELETE FROM " + base::quoteName(table), {}, key, keys);
+}
+
+size_t SQLiteDB::updateRows(const std::string& table, const std::string& key, const std::vector<std::string>& keys,
+                            const std::vector<std::pair<std::string, std::string>>& values, const std::vector<bool>& nulls) {
+    TRACE_SPAN("sqlite.updateRows");
+    std::string head = "UPDATE " + base::quoteName(table) + " SET ";
+    // NULL пишется в текст запроса, привязываются только остальные значения
+    std::vector<std::pair<std::string, std::string>> bound;
+    for (size_t i = 0; i < values.size(); ++i) {
+        bool null = !nulls.empty() && nulls[i];
+        head += (i == 0 ? "" : ", ") + base::quoteName(values[i].first) + (null ? " = NULL" : " = ?");
+        if (!null)
+            bound.push_back(values[i]);
+    }
+    return changeRows(head, bound, key, keys);
+}
+
+// head с привязанными values выполняется для ключей блоками по keysPerStatement в одной точке сохранения:
+// вне транзакции она работает как транзакция, а внутри открытой вызывающим кодом не завершает её
+size_t SQLiteDB::changeRows(const std::string& head, const std::vector<std::pair<std::string, std::string>>& values, const std::string& key,
+                            const std::vector<std::string>& keys) {
+    size_t changed = 0;
+    executeQuery("SAVEPOINT aleto_rows;");
+    size_t step = keysPerStatement(db, values.size());
+    for (size_t first = 0; first < keys.size(); first += step) {
+        size_t count = std::min(step, keys.size() - first);
+        sqlite3_stmt* stmt = cached(head + " WHERE " + base::quoteName(key) + " IN (" + placeholders(count) + ");");
+        int index = 1;
+        for (const auto& value : values) {
+            sqlite3_bind_text(stmt, index++, value.second.c_str(), -1, SQLITE_STATIC);
+        }
+        for (size_t i = first; i < first + count; ++i) {
+            sqlite3_bind_text(stmt, index++, keys[i].c_str(), -1, SQLITE_STATIC);
+        }
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            std::string error = sqlite3_errmsg(db);
+            sqlite3_reset(stmt);
+            sqlite3_exec(db, "ROLLBACK TO aleto_rows; RELEASE aleto_rows;", nullptr, nullptr, nullptr);
+            throw std::runtime_error("Failed to change rows: " + error);
+        }
+        sqlite3_reset(stmt);
+        changed += sqlite3_changes(db);
+    }
+    executeQuery("RELEASE aleto_rows;");
+    return changed;
+}
+
+std::vector<std::string> SQLiteDB::filterKeys(const std::string& table, const std::string& key, const std::string& where, const std::string& from,
+                                              int limit) {
+    TRACE_SPAN("sqlite.filterKeys");
+    std::string k = base::quoteName(key);
+    std::string sql = "SELECT " + k + " FROM " + base::quoteName(table);
+    if (!where.empty())
+        sql += " WHERE (" + where + ")";
+    if (!from.empty())
+        sql += (where.empty() ? " WHERE " : " AND ") + k + " > ?";
+    sql += " ORDER BY " + k + " LIMIT " + std::to_string(limit) + ";";
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to filter table " + table + ": " + std::string(sqlite3_errmsg(db)));
+    }
+    if (!from.empty())
+        sqlite3_bind_text(stmt, 1, from.c_str(), -1, SQLITE_STATIC);
+
+    std::vector<std::string> keys;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
+        keys.emplace_back(text ? text : "");
+    }
+    sqlite3_finalize(stmt);
+    return keys;
+}
+
 bool SQLiteDB::addRow(const std::string& table, const std::vector<std::pair<std::string, std::string>>& values) {
     std::ostringstream query;
-    query << "INSERT INTO " << table << " (";
+    query << "INSERT INTO " << base::quoteName(table) << " (";
     for (size_t i = 0; i < values.size(); ++i) {
-        query << values[i].first;
+        query << base::quoteName(values[i].first);
         if (i + 1 < values.size())
             query << ", ";
     }
@@ -159,24 +1119,68 @@ bool SQLiteDB::addRow(const std::string& table, const std::vector<std::pair<std:
     query << ");";
 
     sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(db, query.str().c_str(), -1, &stmt, nullptr) != SQLITE_OK)
+    try {
+        stmt = cached(query.str());
+    } catch (const std::runtime_error&) {
         return false;
+    }
 
     for (size_t i = 0; i < values.size(); ++i) {
         sqlite3_bind_text(stmt, static_cast<int>(i + 1), values[i].second.c_str(), -1, SQLITE_STATIC);
     }
 
     bool success = sqlite3_step(stmt) == SQLITE_DONE;
-    sqlite3_finalize(stmt);
+    sqlite3_reset(stmt);
     return success;
 }
 
+types::BatchResult SQLiteDB::addRows(const std::string& table, const types::ColumnBatch& batch, bool continueOnError) {
+    TRACE_SPAN("sqlite.addRows");
+    types::BatchResult result;
+    sqlite3_stmt* stmt =
+        cached("INSERT INTO " + base::quoteName(table) + " (" + projection(batch.columns) + ") VALUES (" + placeholders(batch.columns.size()) + ");");
+
+    // Ошибочная вставка отменяет только свою строку, транзакция при этом продолжается.
+    // Точка сохранения вместо BEGIN, чтобы вызов работал и внутри уже открытой транзакции
+    executeQuery("SAVEPOINT aleto_rows;");
+    size_t rows = batch.rows();
+    for (size_t r = 0; r < rows; ++r) {
+        for (size_t c = 0; c < batch.columns.size(); ++c) {
+            int index = static_cast<int>(c + 1);
+            const std::string& value = batch.values[c][r];
+            if (batch.nulls[c][r])
+                sqlite3_bind_null(stmt, index);
+            else
+                sqlite3_bind_text(stmt, index, value.data(), static_cast<int>(value.size()), SQLITE_STATIC);
+        }
+        if (sqlite3_step(stmt) == SQLITE_DONE) {
+            sqlite3_reset(stmt);
+            ++result.inserted;
+            continue;
+        }
+        result.errors.emplace_back(r, sqlite3_errmsg(db));
+        sqlite3_reset(stmt);
+        if (!continueOnError) {
+            sqlite3_exec(db, "ROLLBACK TO aleto_rows; RELEASE aleto_rows;", nullptr, nullptr, nullptr);
+            result.inserted = 0;
+            return result;
+        }
+    }
+    executeQuery("RELEASE aleto_rows;");
+    return result;
+}
+
+std::unique_ptr<base::BulkLoader> SQLiteDB::bulkLoad(const std::string& table, const std::vector<std::string>& columns,
+                                                     const base::LoadOptions& options) {
+    return std::make_unique<SQLiteLoader>(db, table, columns, options.hexBlobs);
+}
+
 types::TableData SQLiteDB::search(const std::string& table, const std::string& column, const std::string& pattern, int limit) {
     types::TableData result;
     result.title = table;
 
     std::ostringstream query;
-    query << "SELECT * FROM " << table << " WHERE " << column << " LIKE ? LIMIT " << limit << ";";
+    query << "SELECT * FROM " << base::quoteName(table) << " WHERE " << base::quoteName(column) << " LIKE ? LIMIT " << limit << ";";
     sqlite3_stmt* stmt;
 
     if (sqlite3_prepare_v2(db, query.str().c_str(), -1, &stmt, nullptr) != SQLITE_OK)
@@ -185,27 +1189,18 @@ types::TableData SQLiteDB::search(const std::string& table, const std::string& c
     std::string wildcard = "%" + pattern + "%";
     sqlite3_bind_text(stmt, 1, wildcard.c_str(), -1, SQLITE_STATIC);
 
-    int colCount = sqlite3_column_count(stmt);
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        std::vector<std::string> row;
-        for (int i = 0; i < colCount; ++i) {
-            const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, i));
-            row.emplace_back(text ? text : "");
-        }
-        result.data.push_back(std::move(row));
-    }
-
-    result.count = static_cast<int>(result.data.size());
+    readColumns(stmt, result);
+    readRows(stmt, result);
     sqlite3_finalize(stmt);
     return result;
 }
 
 bool SQLiteDB::createTable(const types::TableSchema& schema) {
     std::ostringstream query;
-    query << "CREATE TABLE IF NOT EXISTS " << schema.title << " (";
+    query << "CREATE TABLE IF NOT EXISTS " << base::quoteName(schema.title) << " (";
     for (size_t i = 0; i < schema.columns.size(); ++i) {
         const auto& col = schema.columns[i];
-        query << col.name << " " << col.type;
+        query << base::quoteName(col.name) << " " << col.type;
         if (!col.nullable)
             query << " NOT NULL";
         if (col.primary_key)
@@ -218,7 +1213,59 @@ bool SQLiteDB::createTable(const types::TableSchema& schema) {
 }
 
 bool SQLiteDB::dropTable(const std::string& tableName) {
-    return executeQuery("DROP TABLE IF EXISTS " + tableName + ";");
+    return executeQuery("DROP TABLE IF EXISTS " + base::quoteName(tableName) + ";");
+}
+
+std::string SQLiteDB::readValue(const std::string& table, const std::pair<std::string, std::string>& where, const types::Column& column,
+                                size_t& offset, size_t length) {
+    // Строка находится по ключу, rowid нужен только для инкрементального чтения: у таблиц WITHOUT ROWID его нет
+    sqlite3_stmt* stmt;
+    std::string sql = "SELECT rowid FROM " + base::quoteName(table) + " WHERE " + base::quoteName(where.first) + " = ?;";
+    bool rowidTable = sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK;
+    if (rowidTable) {
+        sqlite3_bind_text(stmt, 1, where.second.c_str(), -1, SQLITE_STATIC);
+        bool found = sqlite3_step(stmt) == SQLITE_ROW;
+        sqlite3_int64 rowid = found ? sqlite3_column_int64(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        if (!found)
+            throw std::runtime_error("Row not found in table " + table);
+
+        // Инкрементальное чтение без копирования всего значения
+        sqlite3_blob* blob = nullptr;
+        if (sqlite3_blob_open(db, "main", table.c_str(), column.name.c_str(), rowid, 0, &blob) == SQLITE_OK) {
+            size_t size = static_cast<size_t>(sqlite3_blob_bytes(blob));
+            std::string chunk;
+            if (offset < size) {
+                chunk.resize(std::min(length, size - offset));
+                if (sqlite3_blob_read(blob, chunk.data(), static_cast<int>(chunk.size()), static_cast<int>(offset)) != SQLITE_OK)
+                    chunk.clear();
+            }
+            sqlite3_blob_close(blob);
+            offset += chunk.size();
+            return chunk;
+        }
+    }
+
+    // Числа и таблицы WITHOUT ROWID: substr от значения, приведённого к BLOB, считает байты, как и sqlite3_blob_read
+    sql = "SELECT substr(CAST(" + base::quoteName(column.name) + " AS BLOB), ?, ?) FROM " + base::quoteName(table) + " WHERE " +
+          base::quoteName(where.first) + " = ?;";
+    if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+        throw std::runtime_error("Failed to read value from table " + table + ": " + std::string(sqlite3_errmsg(db)));
+    }
+    sqlite3_bind_int64(stmt, 1, static_cast<sqlite3_int64>(offset) + 1);
+    sqlite3_bind_int64(stmt, 2, static_cast<sqlite3_int64>(length));
+    sqlite3_bind_text(stmt, 3, where.second.c_str(), -1, SQLITE_STATIC);
+    bool found = sqlite3_step(stmt) == SQLITE_ROW;
+    std::string chunk;
+    if (found) {
+        const char* data = reinterpret_cast<const char*>(sqlite3_column_blob(stmt, 0));
+        chunk.assign(data ? data : "", static_cast<size_t>(sqlite3_column_bytes(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+    if (!found)
+        throw std::runtime_error("Row not found in table " + table);
+    offset += chunk.size();
+    return chunk;
 }
 
 }  // namespace sqlite
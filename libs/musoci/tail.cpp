@@ -0,0 +1,54 @@
+#include <algorithm>
+
+#include "tail.hpp"
+#include "trace.hpp"
+
+namespace tail {
+
+// Ключ запрашивается первой колонкой, по нему запоминается позиция
+Follower::Follower(base::Database& db, std::string table, std::string key, std::vector<std::string> columns, Options options)
+    : db(db), table(std::move(table)), key(std::move(key)), options(options), batchRows(options.minBatch) {
+    if (columns.empty()) {
+        for (const auto& column : db.describe(this->table).columns) {
+            columns.push_back(column.name);
+        }
+    }
+    this->columns.push_back(this->key);
+    for (auto& column : columns) {
+        if (column != this->key)
+            this->columns.push_back(std::move(column));
+    }
+}
+
+void Follower::start(int backlog) {
+    TRACE_SPAN("tail.start");
+    types::TableData first = db.query("SELECT " + base::quoteName(key) + " FROM " + base::quoteTable(db, table) + " ORDER BY " +
+                                      base::quoteName(key) + " DESC LIMIT 1 OFFSET " + std::to_string(std::max(backlog, 1) - 1) + ";");
+    // Строк меньше backlog - с начала таблицы
+    last = first.data.empty() || first.data[0].empty() ? "" : first.data[0][0];
+    inclusive = true;
+    full = false;
+}
+
+types::TableData Follower::poll() {
+    TRACE_SPAN("tail.poll");
+    types::TableData data = db.seek(table, key, last, inclusive, 0, batchRows, columns, false);
+    size_t rows = data.data.size();
+    if (rows != 0) {
+        last = data.data.back()[0];
+        inclusive = false;
+    }
+
+    full = rows == static_cast<size_t>(batchRows);
+    if (full)
+        batchRows = std::min(batchRows * 2, options.maxBatch);
+    else if (rows < static_cast<size_t>(batchRows) / 4)
+        batchRows = std::max(batchRows / 2, options.minBatch);
+    return data;
+}
+
+std::chrono::milliseconds Follower::delay() const {
+    return full ? std::chrono::milliseconds(0) : options.interval;
+}
+
+}  // namespace tail
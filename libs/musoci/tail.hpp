@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+
+#include "base.hpp"
+
+namespace tail {
+
+struct Options {
+    // Пределы размера порции и пауза между опросами, когда новых строк меньше порции
+    int minBatch = 100;
+    int maxBatch = 10000;
+    std::chrono::milliseconds interval{200};
+};
+
+// Слежение за растущей таблицей: порции WHERE key > последний прочитанный ключ по индексу ключа.
+// Подходит для таблиц с возрастающим ключом (события, журналы); строки, вставленные с ключом меньше прочитанного, не видны
+class Follower {
+ public:
+    Follower(base::Database& db, std::string table, std::string key, std::vector<std::string> columns, Options options = {});
+
+    // Начинает с последних backlog строк таблицы
+    void start(int backlog);
+    // Следующая порция новых строк, первая колонка - ключ. Пока порции приходят полными, размер порции удваивается (догоняет всплеск),
+    // на почти пустых уменьшается вдвое
+    types::TableData poll();
+    // Пауза перед следующим опросом: ноль, если последняя порция была полной
+    std::chrono::milliseconds delay() const;
+
+    int batch() const { return batchRows; }
+    const std::string& lastKey() const { return last; }
+
+ private:
+    base::Database& db;
+    std::string table;
+    std::string key;
+    std::vector<std::string> columns;
+    Options options;
+    int batchRows;
+    bool full = false;
+    std::string last;
+    // Первый опрос включает строку, с которой начали
+    bool inclusive = false;
+};
+
+}  // namespace tail
@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace trace {
+
+namespace {
+
+// Число событий в кольцевом буфере каждого потока
+const size_t RING_SIZE = 1 << 16;
+
+const auto origin = std::chrono::steady_clock::now();
+
+struct Ring {
+    std::vector<Event> events = std::vector<Event>(RING_SIZE);
+    size_t next = 0;  // пишет только поток-владелец
+    uint64_t tid = 0;
+    std::mutex mutex;  // захватывается владельцем только на запись, без конкуренции
+};
+
+// Событие завершившегося потока вместе с его номером
+struct Finished {
+    Event event;
+    uint64_t tid = 0;
+};
+
+std::mutex ringsMutex;
+// Реестр не владеет буферами: буфер освобождается вместе с потоком, а его события сливаются в finished
+std::vector<std::weak_ptr<Ring>> rings;
+// События завершившихся потоков, не больше RING_SIZE последних, чтобы короткие фоновые потоки не копили память
+std::vector<Finished> finished;
+size_t finishedNext = 0;
+
+void drain(Ring& ring) {
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    std::lock_guard<std::mutex> ringLock(ring.mutex);
+    size_t count = std::min(ring.next, RING_SIZE);
+    for (size_t i = ring.next - count; i < ring.next; ++i) {
+        Finished item{ring.events[i % RING_SIZE], ring.tid};
+        if (finished.size() < RING_SIZE)
+            finished.push_back(item);
+        else
+            finished[finishedNext % RING_SIZE] = item;
+        ++finishedNext;
+    }
+}
+
+struct Owner {
+    std::shared_ptr<Ring> ring = std::make_shared<Ring>();
+
+    Owner() {
+        ring->tid = std::hash<std::thread::id>{}(std::this_thread::get_id()) & 0xffffff;
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.erase(std::remove_if(rings.begin(), rings.end(), [](const std::weak_ptr<Ring>& r) { return r.expired(); }), rings.end());
+        rings.push_back(ring);
+    }
+
+    ~Owner() { drain(*ring); }
+};
+
+Ring& localRing() {
+    thread_local Owner owner;
+    return *owner.ring;
+}
+
+void writeEscaped(std::ofstream& out, const char* text) {
+    for (const char* c = text; *c; ++c) {
+        if (*c == '"' || *c == '\\')
+            out << '\\';
+        out << *c;
+    }
+}
+
+}  // namespace
+
+uint64_t now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin).count());
+}
+
+void record(const char* name, uint64_t start, uint64_t duration) {
+    Ring& ring = localRing();
+    std::lock_guard<std::mutex> lock(ring.mutex);
+    ring.events[ring.next % RING_SIZE] = Event{name, start, duration};
+    ++ring.next;
+}
+
+bool dump(const std::string& path) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out)
+        return false;
+
+    std::vector<std::shared_ptr<Ring>> snapshot;
+    std::vector<Finished> events;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (const auto& weak : rings) {
+            if (auto ring = weak.lock())
+                snapshot.push_back(ring);
+        }
+        events = finished;
+    }
+
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    auto write = [&](const Event& event, uint64_t tid) {
+        out << (first ? "" : ",") << "\n{\"name\":\"";
+        writeEscaped(out, event.name);
+        out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << "}";
+        first = false;
+    };
+    for (const auto& item : events) {
+        write(item.event, item.tid);
+    }
+    for (const auto& ring : snapshot) {
+        std::lock_guard<std::mutex> lock(ring->mutex);
+        size_t count = std::min(ring->next, RING_SIZE);
+        for (size_t i = ring->next - count; i < ring->next; ++i) {
+            write(ring->events[i % RING_SIZE], ring->tid);
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return static_cast<bool>(out);
+}
+
+}  // namespace trace
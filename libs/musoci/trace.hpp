@@ -0,0 +1,48 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Трассировка отрезков времени в формате Chrome trace event (открывается в Perfetto).
+// Включается опцией ALETO_TRACING, без неё макросы ничего не генерируют.
+
+namespace trace {
+
+struct Event {
+    const char* name = nullptr;
+    uint64_t start = 0;  // мкс от запуска
+    uint64_t duration = 0;
+};
+
+uint64_t now();
+void record(const char* name, uint64_t start, uint64_t duration);
+
+// Сохраняет события всех потоков в JSON
+bool dump(const std::string& path);
+
+class Span {
+ public:
+    explicit Span(const char* name) : name(name), start(now()) {}
+    ~Span() { record(name, start, now() - start); }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+ private:
+    const char* name;
+    uint64_t start;
+};
+
+}  // namespace trace
+
+#define ALETO_TRACE_CONCAT_(a, b) a##b
+#define ALETO_TRACE_CONCAT(a, b) ALETO_TRACE_CONCAT_(a, b)
+
+#ifdef ALETO_TRACING
+#define TRACE_SPAN(name) ::trace::Span ALETO_TRACE_CONCAT(traceSpan, __LINE__)(name)
+#else
+#define TRACE_SPAN(name) \
+    do {                 \
+    } while (false)
+#endif
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include "trace.hpp"
+#include "transfer.hpp"
+
+namespace transfer {
+
+namespace {
+
+// Блок строк: значения подряд в data, конец каждого значения в ends
+struct Chunk {
+    std::string data;
+    std::vector<size_t> ends;
+    std::vector<bool> nulls;
+
+    size_t values() const { return ends.size(); }
+    std::string_view value(size_t i) const {
+        size_t begin = i == 0 ? 0 : ends[i - 1];
+        return std::string_view(data).substr(begin, ends[i] - begin);
+    }
+    void append(std::string_view value, bool null) {
+        data.append(value);
+        ends.push_back(data.size());
+        nulls.push_back(null);
+    }
+};
+
+// Очередь между стадиями. push ждёт места, pop - данных; close - источник закончил, abort - прервать обе стороны
+class ChunkQueue {
+ public:
+    explicit ChunkQueue(size_t capacity) : capacity(std::max<size_t>(1, capacity)) {}
+
+    bool push(Chunk chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return aborted || chunks.size() < capacity; });
+        if (aborted)
+            return false;
+        chunks.push_back(std::move(chunk));
+        changed.notify_all();
+        return true;
+    }
+
+    bool pop(Chunk& chunk) {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [this] { return aborted || closed || !chunks.empty(); });
+        if (aborted || chunks.empty())
+            return false;
+        chunk = std::move(chunks.front());
+        chunks.pop_front();
+        changed.notify_all();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        changed.notify_all();
+    }
+
+    void abort() {
+        std::lock_guard<std::mutex> lock(mutex);
+        aborted = true;
+        changed.notify_all();
+    }
+
+ private:
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Chunk> chunks;
+    size_t capacity;
+    bool closed = false;
+    bool aborted = false;
+};
+
+// Читатель: строки курсора складываются в блоки по chunkRows
+class ChunkSink : public base::RowSink {
+ public:
+    ChunkSink(ChunkQueue& queue, size_t rows, std::atomic<bool>& cancel) : queue(queue), rows(std::max<size_t>(1, rows)), cancel(cancel) {}
+
+    void begin(const std::vector<types::Column>&) override {}
+
+    void row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) override {
+        for (size_t i = 0; i < values.size(); ++i) {
+            current.append(values[i], nulls[i]);
+        }
+        if (++count == rows)
+            flush();
+    }
+
+    void flush() {
+        if (count != 0 && !queue.push(std::move(current)))
+            cancel = true;
+        current = Chunk{};
+        count = 0;
+    }
+
+ private:
+    ChunkQueue& queue;
+    size_t rows;
+    std::atomic<bool>& cancel;
+    Chunk current;
+    size_t count = 0;
+};
+
+enum class Conversion { None, BooleanToInteger };
+
+std::string upper(std::string type) {
+    std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return std::toupper(c); });
+    return type;
+}
+
+bool contains(const std::string& type, std::initializer_list<const char*> parts) {
+    return std::any_of(parts.begin(), parts.end(), [&type](const char* part) { return type.find(part) != std::string::npos; });
+}
+
+// Тип SQLite по правилам его родства (affinity) в тип PostgreSQL
+std::string fromSqlite(const std::string& type) {
+    std::string name = upper(type);
+    if (contains(name, {"INT"}))
+        return "BIGINT";
+    if (contains(name, {"CHAR", "CLOB", "TEXT"}) || name.empty())
+        return "TEXT";
+    if (contains(name, {"BLOB"}))
+        return "BYTEA";
+    if (contains(name, {"REAL", "FLOA", "DOUB"}))
+        return "DOUBLE PRECISION";
+    if (contains(name, {"BOOL"}))
+        return "BOOLEAN";
+    if (contains(name, {"NUMERIC", "DECIMAL"}))
+        return "NUMERIC";
+    // Даты и прочее SQLite хранит как угодно, текст принимает любые значения
+    return "TEXT";
+}
+
+// Тип information_schema PostgreSQL в тип SQLite
+std::string fromPostgres(const std::string& type) {
+    if (type == "smallint" || type == "integer" || type == "bigint" || type == "boolean")
+        return "INTEGER";
+    if (type == "real" || type == "double precision")
+        return "REAL";
+    if (type == "numeric")
+        return "NUMERIC";
+    if (type == "bytea")
+        return "BLOB";
+    return "TEXT";
+}
+
+// Преобразование значений для приёмника (логические t/f PostgreSQL в 1/0 для SQLite)
+void convert(const Chunk& in, const std::vector<Conversion>& conversions, Chunk& out) {
+    out.data.reserve(in.data.size());
+    out.ends.reserve(in.values());
+    out.nulls.reserve(in.values());
+    for (size_t i = 0; i < in.values(); ++i) {
+        std::string_view value = in.value(i);
+        if (!in.nulls[i] && conversions[i % conversions.size()] == Conversion::BooleanToInteger)
+            value = value == "t" ? "1" : value == "f" ? "0" : value;
+        out.append(value, in.nulls[i]);
+    }
+}
+
+}  // namespace
+
+std::string targetName(const std::string& table, bool fromPg, bool toPg) {
+    std::string name = table;
+    size_t dot = name.find('.');
+    if (fromPg && !toPg && dot != std::string::npos)
+        name[dot] = '_';
+    return name;
+}
+
+types::TableSchema targetSchema(const types::TableSchema& schema, bool fromPg, bool toPg) {
+    types::TableSchema result{schema.title, schema.columns};
+    for (auto& column : result.columns) {
+        // Между PostgreSQL типы переносятся как есть, пользовательские типы должны быть в приёмнике
+        if (fromPg && toPg)
+            continue;
+        if (fromPg)
+            column.type = fromPostgres(column.type);
+        else if (toPg)
+            column.type = fromSqlite(column.type);
+    }
+    // createTable ставит PRIMARY KEY у колонки, составной ключ так не выразить - таблица создаётся без него
+    if (std::count_if(result.columns.begin(), result.columns.end(), [](const types::Column& c) { return c.primary_key; }) > 1) {
+        for (auto& column : result.columns) {
+            column.primary_key = false;
+        }
+    }
+    return result;
+}
+
+Report copyTable(base::Database& source, base::Database& target, const std::string& table, const std::string& targetTable, const Options& options,
+                 const Progress& progress, const std::atomic<bool>& stop) {
+    TRACE_SPAN("transfer.copyTable");
+    auto started = std::chrono::steady_clock::now();
+    if (&source == &target)
+        throw std::runtime_error("Source and target must be different connections");
+
+    types::TableSchema schema = source.describe(table);
+    if (schema.columns.empty())
+        throw std::runtime_error("Table " + table + " not found");
+    bool fromPg = base::isPostgres(source), toPg = base::isPostgres(target);
+
+    if (options.replace)
+        target.dropTable(targetTable);
+    if (target.describe(targetTable).columns.empty()) {
+        types::TableSchema created = targetSchema(schema, fromPg, toPg);
+        created.title = targetTable;
+        if (!target.createTable(created))
+            throw std::runtime_error("Failed to create table " + targetTable);
+    }
+
+    std::vector<std::string> names;
+    std::vector<Conversion> conversions;
+    for (const auto& column : schema.columns) {
+        names.push_back(column.name);
+        conversions.push_back(fromPg && !toPg && column.type == "boolean" ? Conversion::BooleanToInteger : Conversion::None);
+    }
+    // Источник отдаёт bytea и BLOB в записи \x..., приёмник SQLite декодирует её обратно в байты
+    std::unique_ptr<base::BulkLoader> loader = target.bulkLoad(targetTable, names, base::LoadOptions{true});
+
+    ChunkQueue read(options.queueChunks), converted(options.queueChunks);
+    std::atomic<bool> cancel{false};
+    std::exception_ptr readError, convertError;
+    auto fail = [&] {
+        cancel = true;
+        read.abort();
+        converted.abort();
+    };
+
+    std::thread reader([&] {
+        TRACE_SPAN("transfer.read");
+        try {
+            ChunkSink sink(read, options.chunkRows, cancel);
+            // Внешний stop проверяет писатель, курсор источника останавливается по cancel
+            source.streamTable(table, names, sink, cancel);
+            sink.flush();
+            read.close();
+        } catch (...) {
+            readError = std::current_exception();
+            fail();
+        }
+    });
+    std::thread converter([&] {
+        TRACE_SPAN("transfer.convert");
+        try {
+            Chunk chunk;
+            while (read.pop(chunk)) {
+                Chunk out;
+                convert(chunk, conversions, out);
+                if (!converted.push(std::move(out)))
+                    break;
+            }
+            converted.close();
+        } catch (...) {
+            convertError = std::current_exception();
+            fail();
+        }
+    });
+
+    Report report;
+    std::exception_ptr writeError;
+    try {
+        TRACE_SPAN("transfer.write");
+        std::vector<std::string_view> values(names.size());
+        std::vector<bool> nulls(names.size());
+        Chunk chunk;
+        size_t rows = 0;
+        while (!stop && converted.pop(chunk)) {
+            for (size_t first = 0; first < chunk.values(); first += names.size()) {
+                for (size_t c = 0; c < names.size(); ++c) {
+                    values[c] = chunk.value(first + c);
+                    nulls[c] = chunk.nulls[first + c];
+                }
+                loader->row(values, nulls);
+                ++rows;
+            }
+            if (progress)
+                progress(rows);
+        }
+        if (stop)
+            fail();
+    } catch (...) {
+        writeError = std::current_exception();
+        fail();
+    }
+    reader.join();
+    converter.join();
+
+    for (const auto& error : {writeError, readError, convertError}) {
+        if (error)
+            std::rethrow_exception(error);
+    }
+    if (stop)
+        return report;
+    report.rows = loader->finish();
+    report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return report;
+}
+
+}  // namespace transfer
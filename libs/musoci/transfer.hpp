@@ -0,0 +1,41 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+
+#include "base.hpp"
+
+namespace transfer {
+
+struct Options {
+    // Строк в одном блоке конвейера и блоков в каждой очереди между стадиями
+    size_t chunkRows = 1000;
+    size_t queueChunks = 4;
+    // Удалить существующую целевую таблицу перед копированием
+    bool replace = false;
+};
+
+struct Report {
+    size_t rows = 0;
+    double seconds = 0;
+
+    double rowsPerSecond() const { return seconds > 0 ? rows / seconds : 0; }
+};
+
+// Вызывается писателем после каждого блока: записано строк
+using Progress = std::function<void(size_t rows)>;
+
+// Схема таблицы в диалекте приёмника: типы отображаются по семействам (целые, вещественные, логические, двоичные, текст)
+types::TableSchema targetSchema(const types::TableSchema& schema, bool fromPostgres, bool toPostgres);
+
+// Название таблицы в приёмнике, если оно не задано: в SQLite схем нет, поэтому «схема.таблица» становится «схема_таблица»
+std::string targetName(const std::string& table, bool fromPostgres, bool toPostgres);
+
+// Копирование таблицы между подключениями (SQLite и PostgreSQL в любом направлении). Приёмник создаётся через createTable,
+// если его нет. Курсор источника, преобразование значений и bulkLoad приёмника работают в своих потоках и связаны
+// очередями ограниченной длины, поэтому память не зависит от размера таблицы. source и target - разные подключения.
+// После stop или ошибки загрузка откатывается
+Report copyTable(base::Database& source, base::Database& target, const std::string& table, const std::string& targetTable, const Options& options,
+                 const Progress& progress, const std::atomic<bool>& stop);
+
+}  // namespace transfer
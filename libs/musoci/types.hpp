@@ -1,6 +1,8 @@
 #pragma once
 
 #include <iostream>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -39,6 +41,8 @@ class TableSchema : public IData {
  public:
     std::string title;
     std::vector<Column> columns;
+    // Колонка для навигации по ключу (пусто, если её нет)
+    std::string rowKey;
 
     TableSchema() = default;
 
@@ -57,6 +61,12 @@ class TableSchema : public IData {
 class TableData : public TableSchema {
  public:
     std::vector<std::vector<std::string>> data;
+    // Полные длины усечённых значений по (строка, колонка)
+    std::map<std::pair<int, int>, size_t> truncated;
+    // (строка, колонка) значений NULL: текст NULL-ячейки зависит от базы и может совпасть с обычной строкой
+    std::set<std::pair<int, int>> nulls;
+    // Хеши строк по порядку data, если они запрошены у seek
+    std::vector<std::string> hashes;
     int page = 0;
     int count = 0;
 
@@ -64,6 +74,65 @@ class TableData : public TableSchema {
 
     TableData(std::string title, std::vector<Column> columns, std::vector<std::vector<std::string>> data, int page, int count)
         : TableSchema(std::move(title), std::move(columns)), data(std::move(data)), page(page), count(count) {}
+
+    // Объём значений страницы в байтах
+    size_t byteSize() const {
+        size_t bytes = 0;
+        for (const auto& row : data) {
+            for (const auto& value : row) {
+                bytes += value.size();
+            }
+        }
+        return bytes;
+    }
+};
+
+// Пакет строк по колонкам: values[колонка][строка], nulls того же размера
+class ColumnBatch {
+ public:
+    std::vector<std::string> columns;
+    std::vector<std::vector<std::string>> values;
+    std::vector<std::vector<bool>> nulls;
+
+    ColumnBatch() = default;
+
+    explicit ColumnBatch(std::vector<std::string> columns)
+        : columns(std::move(columns)), values(this->columns.size()), nulls(this->columns.size()) {}
+
+    size_t rows() const { return values.empty() ? 0 : values[0].size(); }
+
+    void reserve(size_t rows) {
+        for (size_t c = 0; c < columns.size(); ++c) {
+            values[c].reserve(rows);
+            nulls[c].reserve(rows);
+        }
+    }
+
+    // Значения строки в порядке columns; rowNulls пуст, если NULL в строке нет
+    void append(const std::vector<std::string>& row, const std::vector<bool>& rowNulls = {}) {
+        for (size_t c = 0; c < columns.size(); ++c) {
+            bool null = c >= row.size() || (!rowNulls.empty() && rowNulls[c]);
+            values[c].push_back(null ? std::string() : row[c]);
+            nulls[c].push_back(null);
+        }
+    }
+};
+
+// Сводка диапазона ключей: число строк и сумма хешей строк, не зависящая от их порядка
+class RangeHash {
+ public:
+    size_t rows = 0;
+    std::string hash;
+
+    bool operator==(const RangeHash& other) const { return rows == other.rows && hash == other.hash; }
+    bool operator!=(const RangeHash& other) const { return !(*this == other); }
+};
+
+class BatchResult {
+ public:
+    size_t inserted = 0;
+    // Номер строки в пакете и текст ошибки
+    std::vector<std::pair<size_t, std::string>> errors;
 };
 
 }  // namespace types
@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+#include "trace.hpp"
+#include "writer.hpp"
+
+namespace writer {
+
+namespace {
+
+bool isNumericType(std::string type) {
+    std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return std::toupper(c); });
+    for (const char* numeric : {"INT", "REAL", "FLOA", "DOUB", "NUMERIC", "DECIMAL"}) {
+        if (type.find(numeric) != std::string::npos)
+            return true;
+    }
+    return false;
+}
+
+// Число в записи JSON (NaN, Infinity и пустые значения идут строками)
+bool isJsonNumber(std::string_view value) {
+    size_t i = 0;
+    if (i < value.size() && value[i] == '-')
+        ++i;
+    size_t digits = i;
+    while (i < value.size() && std::isdigit(static_cast<unsigned char>(value[i])))
+        ++i;
+    if (i == digits)
+        return false;
+    if (i < value.size() && value[i] == '.') {
+        size_t fraction = ++i;
+        while (i < value.size() && std::isdigit(static_cast<unsigned char>(value[i])))
+            ++i;
+        if (i == fraction)
+            return false;
+    }
+    if (i < value.size() && (value[i] == 'e' || value[i] == 'E')) {
+        ++i;
+        if (i < value.size() && (value[i] == '+' || value[i] == '-'))
+            ++i;
+        size_t exponent = i;
+        while (i < value.size() && std::isdigit(static_cast<unsigned char>(value[i])))
+            ++i;
+        if (i == exponent)
+            return false;
+    }
+    return i == value.size();
+}
+
+bool needsCsvQuotes(std::string_view value) {
+    for (char c : value) {
+        if (c == ',' || c == '"' || c == '\n' || c == '\r')
+            return true;
+    }
+    return false;
+}
+
+bool needsJsonEscape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+void appendCsv(std::string& out, std::string_view value) {
+    if (!needsCsvQuotes(value)) {
+        out.append(value);
+        return;
+    }
+    out += '"';
+    size_t start = 0;
+    for (size_t quote = value.find('"'); quote != std::string_view::npos; quote = value.find('"', start)) {
+        out.append(value.substr(start, quote + 1 - start));
+        out += '"';
+        start = quote + 1;
+    }
+    out.append(value.substr(start));
+    out += '"';
+}
+
+// Участки без спецсимволов копируются целиком
+void appendJson(std::string& out, std::string_view value) {
+    static const char hex[] = "0123456789abcdef";
+    out += '"';
+    size_t start = 0;
+    for (size_t i = 0; i < value.size(); ++i) {
+        unsigned char c = value[i];
+        if (!needsJsonEscape(c))
+            continue;
+        out.append(value.substr(start, i - start));
+        start = i + 1;
+        switch (c) {
+            case '"':
+                out.append("\\\"");
+                break;
+            case '\\':
+                out.append("\\\\");
+                break;
+            case '\n':
+                out.append("\\n");
+                break;
+            case '\r':
+                out.append("\\r");
+                break;
+            case '\t':
+                out.append("\\t");
+                break;
+            default:
+                out.append("\\u00");
+                out += hex[c >> 4];
+                out += hex[c & 0xF];
+        }
+    }
+    out.append(value.substr(start));
+    out += '"';
+}
+
+// Строковый литерал SQL
+void appendSql(std::string& out, std::string_view value) {
+    out += '\'';
+    size_t start = 0;
+    for (size_t quote = value.find('\''); quote != std::string_view::npos; quote = value.find('\'', start)) {
+        out.append(value.substr(start, quote + 1 - start));
+        out += '\'';
+        start = quote + 1;
+    }
+    out.append(value.substr(start));
+    out += '\'';
+}
+
+}  // namespace
+
+Format parseFormat(const std::string& name) {
+    if (name == "csv")
+        return Format::Csv;
+    if (name == "jsonl")
+        return Format::JsonLines;
+    if (name == "json")
+        return Format::JsonArray;
+    if (name == "sql")
+        return Format::Sql;
+    throw std::runtime_error("Unknown export format: " + name);
+}
+
+Writer::Writer(std::FILE* out, Format format, size_t bufferSize) : out(out), format(format), capacity(bufferSize) {
+    buffer.reserve(capacity + capacity / 4);
+}
+
+Writer::~Writer() {
+    try {
+        finish();
+    } catch (...) {
+    }
+}
+
+void Writer::begin(const std::vector<types::Column>& columns) {
+    keys.clear();
+    numeric.clear();
+    blob.clear();
+    for (const auto& column : columns) {
+        std::string key;
+        appendJson(key, column.name);
+        keys.push_back(key + ":");
+        numeric.push_back(isNumericType(column.type));
+        std::string type = column.type;
+        std::transform(type.begin(), type.end(), type.begin(), [](unsigned char c) { return std::toupper(c); });
+        blob.push_back(type.find("BLOB") != std::string::npos);
+    }
+
+    if (format == Format::Sql) {
+        insert = "INSERT INTO ";
+        insert += table.empty() ? base::quoteName("data") : table;
+        insert += " (";
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (i != 0)
+                insert += ", ";
+            insert += base::quoteName(columns[i].name);
+        }
+        insert += ") VALUES (";
+    }
+
+    if (format == Format::JsonArray) {
+        buffer += '[';
+    } else if (format == Format::Csv) {
+        for (size_t i = 0; i < columns.size(); ++i) {
+            if (i != 0)
+                buffer += ',';
+            appendCsv(buffer, columns[i].name);
+        }
+        buffer += '\n';
+    }
+}
+
+void Writer::row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) {
+    if (format == Format::Csv) {
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i != 0)
+                buffer += ',';
+            // NULL - пустое поле, пустая строка - пара кавычек
+            if (nulls[i])
+                continue;
+            if (values[i].empty())
+                buffer.append("\"\"");
+            else
+                appendCsv(buffer, values[i]);
+        }
+        buffer += '\n';
+    } else if (format == Format::Sql) {
+        buffer += insert;
+        for (size_t i = 0; i < values.size(); ++i) {
+            if (i != 0)
+                buffer.append(", ");
+            if (nulls[i]) {
+                buffer.append("NULL");
+            } else if (numeric[i] && isJsonNumber(values[i])) {
+                buffer.append(values[i]);
+            } else if (blob[i] && values[i].substr(0, 2) == "\\x") {
+                buffer.append("X'");
+                buffer.append(values[i].substr(2));
+                buffer += '\'';
+            } else {
+                appendSql(buffer, values[i]);
+            }
+        }
+        buffer.append(");\n");
+    } else {
+        if (format == Format::JsonArray)
+            buffer.append(count == 0 ? "\n" : ",\n");
+        buffer += '{';
+        for (size_t i = 0; i < values.size() && i < keys.size(); ++i) {
+            if (i != 0)
+                buffer += ',';
+            buffer += keys[i];
+            if (nulls[i])
+                buffer.append("null");
+            else if (numeric[i] && isJsonNumber(values[i]))
+                buffer.append(values[i]);
+            else
+                appendJson(buffer, values[i]);
+        }
+        buffer += '}';
+        if (format == Format::JsonLines)
+            buffer += '\n';
+    }
+
+    ++count;
+    if (buffer.size() >= capacity)
+        flush();
+}
+
+void Writer::write(const types::TableData& data) {
+    if (table.empty() && !data.title.empty())
+        table = base::quoteName(data.title);
+    begin(data.columns);
+    std::vector<std::string_view> values;
+    std::vector<bool> nulls;
+    for (size_t r = 0; r < data.data.size(); ++r) {
+        const auto& row = data.data[r];
+        values.assign(row.begin(), row.end());
+        nulls.assign(row.size(), false);
+        for (auto it = data.nulls.lower_bound({static_cast<int>(r), 0}); it != data.nulls.end() && it->first == static_cast<int>(r); ++it) {
+            if (it->second >= 0 && static_cast<size_t>(it->second) < nulls.size())
+                nulls[it->second] = true;
+        }
+        this->row(values, nulls);
+    }
+}
+
+void Writer::finish() {
+    if (finished)
+        return;
+    finished = true;
+    if (format == Format::JsonArray)
+        buffer.append(count == 0 ? "]\n" : "\n]\n");
+    flush();
+    std::fflush(out);
+}
+
+void Writer::flush() {
+    TRACE_SPAN("writer.flush");
+    if (!buffer.empty() && std::fwrite(buffer.data(), 1, buffer.size(), out) != buffer.size())
+        throw std::runtime_error("Failed to write export output");
+    written += buffer.size();
+    buffer.clear();
+}
+
+}  // namespace writer
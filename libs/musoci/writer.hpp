@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdio>
+
+#include "base.hpp"
+
+namespace writer {
+
+enum class Format { Csv, JsonLines, JsonArray, Sql };
+
+// csv, jsonl, json или sql
+Format parseFormat(const std::string& name);
+
+// Запись потока строк в файл через собственный большой буфер.
+// Значения экранируются сразу в буфер, без промежуточных объектов на строку.
+class Writer : public base::RowSink {
+ public:
+    Writer(std::FILE* out, Format format, size_t bufferSize = 1 << 20);
+    ~Writer() override;
+
+    // Таблица в INSERT для Format::Sql («схема.таблица» PostgreSQL делится на схему и таблицу); write без неё берёт title результата
+    void setTable(const std::string& name, bool postgres) { table = base::quoteTable(name, postgres); }
+
+    void begin(const std::vector<types::Column>& columns) override;
+    void row(const std::vector<std::string_view>& values, const std::vector<bool>& nulls) override;
+
+    // Уже прочитанный результат, NULL берутся из data.nulls
+    void write(const types::TableData& data);
+    // Закрывает массив JSON и сбрасывает буфер
+    void finish();
+
+    size_t rows() const { return count; }
+    size_t bytes() const { return written + buffer.size(); }
+
+ private:
+    std::FILE* out;
+    Format format;
+    size_t capacity;
+    std::string buffer;
+    size_t written = 0;
+    size_t count = 0;
+    bool finished = false;
+    // Готовые префиксы "имя": для JSON и признаки числовых колонок
+    std::vector<std::string> keys;
+    std::vector<bool> numeric;
+    // Для SQL: таблица в кавычках, начало INSERT до списка значений и колонки BLOB (значения \x пишутся литералом X'')
+    std::string table;
+    std::string insert;
+    std::vector<bool> blob;
+
+    void flush();
+};
+
+}  // namespace writer
@@ -1,8 +1,63 @@
+#pragma once
+
+#include <cstddef>
+
 namespace config {
 
 const int HEIGHT = 720;
 const int WIDTH = 1280;
 
+// Начальный размер страницы и шаг якорей
 const int ROWS_ON_PAGE = 1000;
 
+// Адаптивный размер страницы: бюджеты на одну загрузку и допустимые пределы
+const double LATENCY_BUDGET_MS = 50;
+const size_t BYTES_BUDGET = 4 << 20;
+const int MIN_ROWS_ON_PAGE = 50;
+const int MAX_ROWS_ON_PAGE = 20000;
+// Запас колонок, загружаемых за краями видимой области
+const int COLUMNS_MARGIN = 2;
+
+// Длина префикса больших значений на странице и размер блока при догрузке
+const size_t PREVIEW_LIMIT = 256;
+const size_t VALUE_CHUNK = 1 << 20;
+
+// Общий предел памяти под запомненные результаты чтений всех подключений и размер временного файла,
+// куда выносятся давно не использованные результаты сверх предела (0 - не выносить)
+const size_t CACHE_BYTES = 128 << 20;
+const size_t CACHE_SPILL_BYTES = size_t(1) << 30;
+// Наименьший промежуток между сверками версии данных перед чтением из кеша (у PostgreSQL это запрос к статистике)
+const int CACHE_RECHECK_MS = 250;
+
+// Период обновления метрик в строке состояния
+const int METRICS_REFRESH_MS = 1000;
+
+// Массовое удаление и замена: строк в одной транзакции и пауза между транзакциями
+const size_t BULK_CHUNK_ROWS = 1000;
+const int BULK_PAUSE_MS = 50;
+
+// Обновление открытой таблицы по уведомлениям об изменениях и период их ожидания.
+// Триггеры с NOTIFY в PostgreSQL создаются только по явному разрешению
+const bool LIVE_REFRESH = true;
+const bool LIVE_REFRESH_TRIGGERS = false;
+const int LIVE_REFRESH_MS = 500;
+
+// Режим слежения за растущей таблицей: строк в окне, строк при открытии, пределы порции и пауза между опросами
+const size_t TAIL_ROWS = 100000;
+const int TAIL_BACKLOG = 1000;
+const int TAIL_MIN_BATCH = 100;
+const int TAIL_MAX_BATCH = 10000;
+const int TAIL_POLL_MS = 200;
+
+// Сохранять якоря страниц между запусками
+const bool PERSIST_ANCHORS = true;
+
+// Сохранять список таблиц между запусками: при открытии он показывается сразу и проверяется в фоне
+const bool PERSIST_CATALOG = true;
+
+// Сохранять прочитанные страницы и схемы удалённых таблиц между запусками и предел файла одной таблицы.
+// Страницы проверяются по версиям таблиц сервера; счётчики статистики PostgreSQL отстают до секунды
+const bool PERSIST_PAGES = false;
+const size_t PERSIST_PAGE_BYTES = 256 << 20;
+
 }  // namespace config
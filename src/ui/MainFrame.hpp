@@ -1,43 +1,101 @@
 #pragma once
 
+#include <wx/choicdlg.h>
+#include <wx/clipbrd.h>
+#include <wx/filename.h>
 #include <wx/grid.h>
+#include <wx/stdpaths.h>
+#include <wx/timer.h>
 #include <wx/wx.h>
+#include <fstream>
+#include <chrono>
+#include <limits>
 #include <map>
+#include <mutex>
+#include <set>
 #include <stdexcept>
+#include <thread>
 #include <vector>
 
+#include "../../libs/musoci/bulk.hpp"
+#include "../../libs/musoci/cache.hpp"
+#include "../../libs/musoci/catalog.hpp"
+#include "../../libs/musoci/dump.hpp"
+#include "../../libs/musoci/importer.hpp"
+#include "../../libs/musoci/metrics.hpp"
+#include "../../libs/musoci/paging.hpp"
 #include "../../libs/musoci/postgresql.hpp"
 #include "../../libs/musoci/sqlite.hpp"
+#include "../../libs/musoci/trace.hpp"
+#include "../../libs/musoci/transfer.hpp"
+#include "../../libs/musoci/writer.hpp"
 #include "../core/config.hpp"
+#include "TableList.hpp"
+#include "TailFrame.hpp"
 
 class MainFrame : public wxFrame {
  public:
     MainFrame(std::unique_ptr<base::Database> _db)
         : wxFrame(nullptr, wxID_ANY, wxT("aleto"), wxDefaultPosition, wxSize(config::WIDTH, config::HEIGHT),
                   wxDEFAULT_FRAME_STYLE & ~(wxRESIZE_BORDER | wxMAXIMIZE_BOX)),
-          db(std::move(_db)) {
-        std::vector<types::TableSchema> schemas{};
+          registry(std::make_shared<metrics::Registry>()),
+          results(std::make_shared<cache::ResultCache>(config::CACHE_BYTES, config::CACHE_SPILL_BYTES)),
+          pages(config::PERSIST_PAGES ? std::make_shared<cache::PageStore>(
+                                            (wxStandardPaths::Get().GetUserLocalDataDir() + wxT("/pages")).ToStdString(), config::PERSIST_PAGE_BYTES)
+                                      : nullptr),
+          db(std::make_unique<cache::CachedDatabase>(std::make_unique<metrics::MeteredDatabase>(std::move(_db), registry), results, pages,
+                                                     std::chrono::milliseconds(config::CACHE_RECHECK_MS))) {
+        // Сохранённый с прошлого запуска список таблиц показывается сразу и проверяется в фоне
+        // Читаются только названия таблиц, колонки - при открытии таблицы
+        std::vector<std::string> tables{};
+        std::string catalogVersion{};
+        bool catalogLoaded = false;
+        if (config::PERSIST_CATALOG) {
+            catalogStore = std::make_unique<catalog::Store>((wxStandardPaths::Get().GetUserLocalDataDir() + wxT("/catalog")).ToStdString());
+            catalogLoaded = catalogStore->load(db->connectionId(), tables, catalogVersion);
+        }
+        if (!catalogLoaded) {
+            try {
+                tables = catalog::fetch(*db, catalogStore.get());
+            } catch (const std::exception& e) {
+                wxMessageBox(wxString::FromUTF8(e.what()), wxT("Подключение"), wxOK | wxICON_WARNING);
+            }
+
+            if (tables.size() == 0) {
+                wxMessageBox(wxT("База данных пуста"), wxT("Подключение"), wxOK | wxICON_WARNING);
+            }
+        }
+
+        // Большие значения приходят усечёнными и догружаются при открытии ячейки
+        db->setPreviewLimit(config::PREVIEW_LIMIT);
+
+        // Якоря страниц строятся на отдельном подключении, чтобы не блокировать интерфейс
         try {
-            schemas = db->getTables();
-        } catch (const std::exception& e) {
-            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Подключение"), wxOK | wxICON_WARNING);
+            std::string cacheDir{};
+            if (config::PERSIST_ANCHORS) {
+                cacheDir = (wxStandardPaths::Get().GetUserLocalDataDir() + wxT("/anchors")).ToStdString();
+            }
+            anchors = std::make_unique<paging::AnchorService>(db->clone(), cacheDir);
+            anchors->onReady = [this](const std::string& table) { CallAfter([this, table] { onAnchorsReady(table); }); };
+        } catch (const std::exception&) {
+            anchors.reset();
         }
 
-        if (schemas.size() == 0) {
-            wxMessageBox(wxT("База данных пуста"), wxT("Подключение"), wxOK | wxICON_WARNING);
+        // Уведомления ждёт отдельное подключение; без них (нет подключения для LISTEN или прав на триггеры) остаётся ручное обновление
+        if (config::LIVE_REFRESH) {
+            try {
+                startWatching(db->clone());
+            } catch (const std::exception&) {
+            }
         }
 
         wxBoxSizer* mainSizer = new wxBoxSizer(wxHORIZONTAL);
         wxPanel* panel = new wxPanel(this);
         panel->SetSizer(mainSizer);
 
-        tableList = new wxListBox(panel, wxID_ANY);
-        lastPages = std::map<std::string, int>();
-        for (const auto& schema : schemas) {
-            tableList->Append(wxString::FromUTF8(schema.title));
-            lastPages[schema.title] = 1000000;
-        }
-        tableList->Bind(wxEVT_LISTBOX, &MainFrame::onTableSelected, this);
+        tableList = new TableList(panel);
+        tableList->setTables(std::move(tables));
+        tableList->onSelected = [this](const std::string& table) { onTableSelected(table); };
         mainSizer->Add(tableList, 1, wxEXPAND | wxALL, 5);
 
         // Правая часть
@@ -49,6 +107,44 @@ class MainFrame : public wxFrame {
         wxButton* refreshDataButton = new wxButton(rightPanel, wxID_ANY, wxT("Обновить"));
         refreshDataButton->Bind(wxEVT_BUTTON, &MainFrame::refreshData, this);
         controlSizer->Add(refreshDataButton, 0, wxRIGHT, 8);
+        wxButton* columnsButton = new wxButton(rightPanel, wxID_ANY, wxT("Колонки"));
+        columnsButton->Bind(wxEVT_BUTTON, &MainFrame::onChooseColumns, this);
+        controlSizer->Add(columnsButton, 0, wxRIGHT, 8);
+        wxButton* duplicateButton = new wxButton(rightPanel, wxID_ANY, wxT("Дублировать"));
+        duplicateButton->Bind(wxEVT_BUTTON, &MainFrame::onDuplicateRows, this);
+        controlSizer->Add(duplicateButton, 0, wxRIGHT, 8);
+        wxButton* pasteButton = new wxButton(rightPanel, wxID_ANY, wxT("Вставить строки"));
+        pasteButton->Bind(wxEVT_BUTTON, &MainFrame::onPasteRows, this);
+        controlSizer->Add(pasteButton, 0, wxRIGHT, 8);
+        wxButton* removeButton = new wxButton(rightPanel, wxID_ANY, wxT("Удалить"));
+        removeButton->Bind(wxEVT_BUTTON, &MainFrame::onRemoveRows, this);
+        controlSizer->Add(removeButton, 0, wxRIGHT, 8);
+        wxButton* replaceButton = new wxButton(rightPanel, wxID_ANY, wxT("Заменить"));
+        replaceButton->Bind(wxEVT_BUTTON, &MainFrame::onReplaceValues, this);
+        controlSizer->Add(replaceButton, 0, wxRIGHT, 8);
+        wxButton* tailButton = new wxButton(rightPanel, wxID_ANY, wxT("Хвост"));
+        tailButton->Bind(wxEVT_BUTTON, &MainFrame::onTail, this);
+        controlSizer->Add(tailButton, 0, wxRIGHT, 8);
+        wxButton* metricsButton = new wxButton(rightPanel, wxID_ANY, wxT("Метрики"));
+        metricsButton->Bind(wxEVT_BUTTON, &MainFrame::onSaveMetrics, this);
+        controlSizer->Add(metricsButton, 0, wxRIGHT, 8);
+        wxButton* exportButton = new wxButton(rightPanel, wxID_ANY, wxT("Экспорт"));
+        exportButton->Bind(wxEVT_BUTTON, &MainFrame::onExport, this);
+        controlSizer->Add(exportButton, 0, wxRIGHT, 8);
+        wxButton* importButton = new wxButton(rightPanel, wxID_ANY, wxT("Импорт"));
+        importButton->Bind(wxEVT_BUTTON, &MainFrame::onImport, this);
+        controlSizer->Add(importButton, 0, wxRIGHT, 8);
+        wxButton* copyButton = new wxButton(rightPanel, wxID_ANY, wxT("В SQLite"));
+        copyButton->Bind(wxEVT_BUTTON, &MainFrame::onCopyToSqlite, this);
+        controlSizer->Add(copyButton, 0, wxRIGHT, 8);
+        wxButton* dumpButton = new wxButton(rightPanel, wxID_ANY, wxT("Дамп"));
+        dumpButton->Bind(wxEVT_BUTTON, &MainFrame::onDump, this);
+        controlSizer->Add(dumpButton, 0, wxRIGHT, 8);
+#ifdef ALETO_TRACING
+        wxButton* traceButton = new wxButton(rightPanel, wxID_ANY, wxT("Трасса"));
+        traceButton->Bind(wxEVT_BUTTON, &MainFrame::onSaveTrace, this);
+        controlSizer->Add(traceButton, 0, wxRIGHT, 8);
+#endif
         rightSizer->Add(controlSizer, 0, wxALL, 8);
 
         // Добавляем grid внутрь rightSizer
@@ -57,9 +153,18 @@ class MainFrame : public wxFrame {
         // grid->SetRowLabelSize(0);
         grid->EnableEditing(true);
         grid->Bind(wxEVT_GRID_CELL_CHANGED, &MainFrame::onCellChanged, this);
+        grid->Bind(wxEVT_GRID_EDITOR_SHOWN, &MainFrame::onEditorShown, this);
         rightSizer->Add(grid, 1, wxEXPAND | wxALL, 0);
         grid->Bind(wxEVT_GRID_LABEL_LEFT_CLICK, &MainFrame::onColumnHeaderClick, this);
 
+        // Колонки за пределами видимой области догружаются при прокрутке
+        for (const auto& scrollEvent : {wxEVT_SCROLLWIN_THUMBRELEASE, wxEVT_SCROLLWIN_LINEDOWN, wxEVT_SCROLLWIN_LINEUP, wxEVT_SCROLLWIN_PAGEDOWN,
+                                        wxEVT_SCROLLWIN_PAGEUP}) {
+            grid->Bind(scrollEvent, &MainFrame::onGridScrolled, this);
+        }
+        grid->Bind(wxEVT_SIZE, &MainFrame::onGridResized, this);
+        grid->Bind(wxEVT_GRID_SELECT_CELL, &MainFrame::onGridCellSelected, this);
+
         // Панель и сайзер для навигации
         wxBoxSizer* navigationSizer = new wxBoxSizer(wxHORIZONTAL);
         wxPanel* navigationPanel = new wxPanel(rightPanel);
@@ -80,79 +185,982 @@ class MainFrame : public wxFrame {
 
         rightSizer->Add(navigationPanel, 0, wxEXPAND | wxALL, 5);
 
+        // Положение в таблице, доступно после построения якорей
+        positionSlider = new wxSlider(rightPanel, wxID_ANY, 0, 0, 1000);
+        positionSlider->Bind(wxEVT_SCROLL_CHANGED, &MainFrame::onPositionChanged, this);
+        positionSlider->Enable(false);
+        rightSizer->Add(positionSlider, 0, wxEXPAND | wxLEFT | wxRIGHT, 15);
+
         // Присваиваем сайзер панели
         rightPanel->SetSizer(rightSizer);
 
-        if (schemas.size() != 0) {
-            loadPage(schemas[0].title);
+        // Строка состояния с задержками запросов
+        CreateStatusBar();
+        metricsTimer.SetOwner(this);
+        Bind(wxEVT_TIMER, &MainFrame::onMetricsTimer, this);
+        metricsTimer.Start(config::METRICS_REFRESH_MS);
+
+        if (catalogLoaded) {
+            try {
+                revalidateCatalog(db->clone(), catalogVersion);
+            } catch (const std::exception&) {
+            }
+        }
+
+        if (tableList->tables().size() != 0) {
+            loadPage(tableList->tables()[0]);
+        }
+    }
+
+    ~MainFrame() override {
+        jobStop = true;
+        if (jobThread.joinable()) {
+            jobThread.join();
+        }
+        watchStop = true;
+        if (watchThread.joinable()) {
+            watchThread.join();
+        }
+        if (catalogThread.joinable()) {
+            catalogThread.join();
         }
     }
 
  private:
-    std::unique_ptr<base::Database> db;
+    std::shared_ptr<metrics::Registry> registry;
+    // Кеш снаружи замеров: в метриках остаются только запросы, дошедшие до базы
+    std::shared_ptr<cache::ResultCache> results;
+    std::shared_ptr<cache::PageStore> pages;
+    std::unique_ptr<cache::CachedDatabase> db;
 
     std::string currentTable;
     int currentPage;
-    std::map<std::string, int> lastPages;
+    int currentOffset = 0;
+    int currentLimit = config::ROWS_ON_PAGE;
+    // Известная верхняя граница числа строк таблицы
+    std::map<std::string, long long> tableRows{};
+    paging::PageSizer pageSizer{config::LATENCY_BUDGET_MS, config::BYTES_BUDGET, config::MIN_ROWS_ON_PAGE, config::MAX_ROWS_ON_PAGE,
+                                config::ROWS_ON_PAGE};
     std::map<std::tuple<int, int>, std::string> editedCells{};
     std::map<int, bool> sortAscending{};
+    std::map<std::string, types::TableSchema> described{};
+    std::map<std::string, std::set<std::string>> hiddenColumns{};
+    std::vector<std::string> gridColumns{};
+    std::vector<bool> loadedColumns{};
+    std::vector<std::string> rowKeys{};
+    // Хеши строк страницы по ключу на момент загрузки
+    std::map<std::string, std::string> rowHashes{};
+    std::map<std::pair<int, int>, size_t> truncatedCells{};
+    // Ячейки со значением NULL: по тексту ячейки их не отличить от пустой строки или строки "NULL"
+    std::set<std::pair<int, int>> nullCells{};
+    std::unique_ptr<paging::AnchorService> anchors;
+    // Фоновая выгрузка, загрузка или массовое изменение, одновременно выполняется одна
+    std::thread jobThread;
+    std::atomic<bool> jobStop{false};
+    // Ход фоновой задачи для строки состояния
+    wxString jobStatus{};
+    // Ожидание уведомлений об изменениях открытой таблицы
+    std::thread watchThread;
+    std::atomic<bool> watchStop{false};
+    std::mutex watchMutex;
+    std::string watchedTable{};
+    // Список таблиц между запусками и его проверка на отдельном подключении
+    std::unique_ptr<catalog::Store> catalogStore;
+    std::thread catalogThread;
 
     wxGrid* grid;
-    wxListBox* tableList;
+    TableList* tableList;
     wxTextCtrl* pageText;
+    wxSlider* positionSlider;
+    wxTimer metricsTimer;
 
-    void onTableSelected(wxCommandEvent& event) {
-        std::string tableName = tableList->GetStringSelection().ToStdString();
+    void revalidateCatalog(std::unique_ptr<base::Database> worker, std::string version) {
+        catalogThread = std::thread([this, worker = std::move(worker), version] {
+            std::vector<std::string> tables{};
+            try {
+                if (catalog::revalidate(*worker, *catalogStore, version, tables)) {
+                    CallAfter([this, tables] { onCatalogChanged(tables); });
+                }
+            } catch (const std::exception&) {
+                // Остаётся сохранённый список
+            }
+        });
+    }
+
+    // Схема изменилась с прошлого запуска: список заменяется, описания таблиц перечитываются при обращении
+    void onCatalogChanged(const std::vector<std::string>& tables) {
+        tableList->setTables(tables);
+        described.clear();
+    }
+
+    void onTableSelected(const std::string& tableName) {
+        TRACE_SPAN("ui.tableSelected");
         loadPage(tableName);
     }
 
-    void onPrevPage(wxCommandEvent&) { loadPage(currentTable, currentPage - 1); }
+    void onPrevPage(wxCommandEvent&) {
+        TRACE_SPAN("ui.prevPage");
+        if (currentOffset > 0) {
+            loadRows(currentTable, std::max(0, currentOffset - pageSizer.rowsFor(currentTable)));
+        }
+    }
 
-    void onNextPage(wxCommandEvent&) { loadPage(currentTable, currentPage + 1); }
+    void onNextPage(wxCommandEvent&) {
+        TRACE_SPAN("ui.nextPage");
+        loadRows(currentTable, currentOffset + grid->GetNumberRows());
+    }
 
     void goToPage(wxCommandEvent&) {
+        TRACE_SPAN("ui.goToPage");
         int page = std::stoi(pageText->GetValue().ToStdString());
         if (page > 0 && page != currentPage) {
             loadPage(currentTable, page);
         }
     }
 
+    // Таблица изменена через приложение: известное число строк и якоря страниц больше не верны
+    void forgetRows(const std::string& tableName) {
+        tableRows.erase(tableName);
+        if (anchors) {
+            anchors->invalidate(tableName);
+        }
+    }
+
+    long long rowsBound(const std::string& tableName) const {
+        auto it = tableRows.find(tableName);
+        return it == tableRows.end() ? std::numeric_limits<long long>::max() : it->second;
+    }
+
     void onCellChanged(wxGridEvent& event) {
         int row = event.GetRow();
         int col = event.GetCol();
 
         wxString newValue = grid->GetCellValue(row, col);
         grid->SetCellBackgroundColour(row, col, wxColour(255, 255, 153));
+        nullCells.erase({row, col});
 
         editedCells[std::make_tuple(row, col)] = newValue.ToStdString();
 
         event.Skip();
     }
 
-    void refreshData(wxCommandEvent&) { loadPage(currentTable, currentPage); }
+    // Две самые затратные по суммарному времени операции и попадания в кеш
+    void onMetricsTimer(wxTimerEvent&) {
+        std::vector<std::pair<double, std::string>> costs{};
+        auto snapshot = registry->snapshot();
+        for (const auto& [name, stats] : snapshot) {
+            costs.emplace_back(stats.latency.mean() * stats.calls, name);
+        }
+        std::sort(costs.rbegin(), costs.rend());
+
+        wxString text = jobStatus.empty() ? wxString() : jobStatus + wxT("   ");
+        for (size_t i = 0; i < costs.size() && i < 2; i++) {
+            const metrics::OperationStats& stats = snapshot[costs[i].second];
+            text += wxString::Format(wxT("%s: %llu выз., p50 %.1f мс, p99 %.1f мс, max %.1f мс, ошибок %llu   "), costs[i].second.c_str(),
+                                     static_cast<unsigned long long>(stats.calls), stats.latency.percentile(50) / 1000.0,
+                                     stats.latency.percentile(99) / 1000.0, stats.latency.max() / 1000.0, static_cast<unsigned long long>(stats.errors));
+        }
+        cache::Stats cached = results->stats();
+        if (cached.hits + cached.misses != 0) {
+            text += wxString::Format(wxT("кеш: %.0f%% попаданий, %.1f МБ в памяти, %.1f МБ на диске"),
+                                     100.0 * cached.hits / (cached.hits + cached.misses), cached.bytes / 1048576.0, cached.spilledBytes / 1048576.0);
+        }
+        SetStatusText(text);
+    }
+
+    // LISTEN (и триггер) ставится только на открытую таблицу и переставляется при выборе другой: подписка на все таблицы
+    // базы держала бы десятки тысяч каналов. Если подписаться не удалось, таблица обновляется вручную
+    void startWatching(std::unique_ptr<base::Database> worker) {
+        watchThread = std::thread([this, worker = std::move(worker)] {
+            std::string watched{};
+            std::unique_ptr<base::ChangeFeed> feed;
+            while (!watchStop) {
+                std::string wanted{};
+                {
+                    std::lock_guard<std::mutex> lock(watchMutex);
+                    wanted = watchedTable;
+                }
+                if (wanted != watched) {
+                    feed.reset();
+                    watched = wanted;
+                    try {
+                        if (!watched.empty()) {
+                            feed = worker->watch({watched}, config::LIVE_REFRESH_TRIGGERS);
+                        }
+                    } catch (const std::exception&) {
+                    }
+                }
+                if (!feed) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(config::LIVE_REFRESH_MS));
+                    continue;
+                }
+                std::vector<std::string> changed{};
+                try {
+                    changed = feed->wait(std::chrono::milliseconds(config::LIVE_REFRESH_MS));
+                } catch (const std::exception&) {
+                    feed.reset();
+                }
+                if (!changed.empty()) {
+                    CallAfter([this, changed] { onTablesChanged(changed); });
+                }
+            }
+        });
+    }
+
+    void watchTable(const std::string& tableName) {
+        std::lock_guard<std::mutex> lock(watchMutex);
+        watchedTable = tableName;
+    }
+
+    // Сбрасывается известное число строк изменённых таблиц; страница перечитывается, только если изменилась открытая таблица
+    void onTablesChanged(const std::vector<std::string>& tables) {
+        for (const auto& table : tables) {
+            tableRows.erase(table);
+        }
+        if (std::find(tables.begin(), tables.end(), currentTable) == tables.end() || grid->IsCellEditControlShown()) {
+            return;
+        }
+        refreshRows(true);
+    }
+
+    // Новые строки открытой таблицы в отдельном окне на своём подключении. Подключение без кеша: каждый опрос заполнял бы
+    // кеш устаревающими страницами. Предпросмотр выключен, потому что окно показывает значения целиком и усечение не учитывает
+    void onTail(wxCommandEvent&) {
+        if (currentTable.empty()) {
+            return;
+        }
+        const types::TableSchema& schema = tableSchema(currentTable);
+        if (schema.rowKey.empty()) {
+            wxMessageBox(wxT("Для слежения нужен первичный ключ из одной колонки"), wxT("Хвост"), wxOK | wxICON_INFORMATION);
+            return;
+        }
+        try {
+            std::unique_ptr<base::Database> worker = db->uncachedClone();
+            worker->setPreviewLimit(0);
+            TailFrame* frame = new TailFrame(this, std::move(worker), schema, chosenColumns(schema));
+            frame->Show();
+        } catch (const std::exception& e) {
+            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Хвост"), wxOK | wxICON_WARNING);
+        }
+    }
+
+    void onSaveMetrics(wxCommandEvent&) {
+        wxFileDialog dialog(this, wxT("Сохранить метрики"), "", "metrics.json", "JSON (*.json)|*.json", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+        if (dialog.ShowModal() != wxID_OK) {
+            return;
+        }
+        std::ofstream out(dialog.GetPath().ToStdString());
+        out << registry->toJson(db->connectionId());
+        if (!out) {
+            wxMessageBox(wxT("Не удалось сохранить метрики"), wxT("Метрики"), wxOK | wxICON_WARNING);
+        }
+    }
+
+    // Выгрузка всей таблицы курсором на отдельном подключении
+    void onExport(wxCommandEvent&) {
+        if (currentTable.empty()) {
+            return;
+        }
+        if (jobThread.joinable()) {
+            wxMessageBox(wxT("Дождитесь окончания фоновой задачи"), wxT("Экспорт"), wxOK | wxICON_INFORMATION);
+            return;
+        }
+        wxFileDialog dialog(this, wxT("Экспорт таблицы"), "", wxString::FromUTF8(currentTable) + ".csv",
+                            "CSV (*.csv)|*.csv|JSON Lines (*.jsonl)|*.jsonl|JSON (*.json)|*.json", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+        if (dialog.ShowModal() != wxID_OK) {
+            return;
+        }
+        const writer::Format formats[] = {writer::Format::Csv, writer::Format::JsonLines, writer::Format::JsonArray};
+        writer::Format format = formats[dialog.GetFilterIndex()];
+        std::string path = dialog.GetPath().ToStdString();
+        std::vector<std::string> columns = chosenColumns(tableSchema(currentTable));
+
+        std::unique_ptr<base::Database> worker;
+        try {
+            worker = db->clone();
+        } catch (const std::exception& e) {
+            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Экспорт"), wxOK | wxICON_WARNING);
+            return;
+        }
+        jobStop = false;
+        jobThread = std::thread([this, worker = std::move(worker), table = currentTable, columns, path, format] {
+            size_t rows = 0;
+            std::string error{};
+            try {
+                std::unique_ptr<std::FILE, int (*)(std::FILE*)> out(std::fopen(path.c_str(), "wb"), &std::fclose);
+                if (!out) {
+                    throw std::runtime_error("Failed to open " + path);
+                }
+                writer::Writer output(out.get(), format);
+                output.setTable(table, base::isPostgres(*worker));
+                rows = worker->streamTable(table, columns, output, jobStop);
+                output.finish();
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            CallAfter([this, rows, error] { onExportDone(rows, error); });
+        });
+    }
+
+    void onExportDone(size_t rows, const std::string& error) {
+        if (jobThread.joinable()) {
+            jobThread.join();
+        }
+        if (!error.empty()) {
+            wxMessageBox(wxString::FromUTF8(error), wxT("Экспорт"), wxOK | wxICON_WARNING);
+        } else {
+            wxMessageBox(wxString::Format(wxT("Выгружено строк: %zu"), rows), wxT("Экспорт"), wxOK | wxICON_INFORMATION);
+        }
+    }
+
+    // Загрузка CSV в новую или существующую таблицу на отдельном подключении
+    void onImport(wxCommandEvent&) {
+        if (jobThread.joinable()) {
+            wxMessageBox(wxT("Дождитесь окончания фоновой задачи"), wxT("Импорт"), wxOK | wxICON_INFORMATION);
+            return;
+        }
+        wxFileDialog dialog(this, wxT("Импорт CSV"), "", "", "CSV (*.csv)|*.csv", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+        if (dialog.ShowModal() != wxID_OK) {
+            return;
+        }
+        wxTextEntryDialog tableDialog(this, wxT("Таблица"), wxT("Импорт CSV"), wxFileName(dialog.GetPath()).GetName());
+        if (tableDialog.ShowModal() != wxID_OK || tableDialog.GetValue().empty()) {
+            return;
+        }
+        std::string path = dialog.GetPath().ToStdString();
+        std::string table = tableDialog.GetValue().ToStdString();
+
+        std::unique_ptr<base::Database> worker;
+        try {
+            worker = db->clone();
+        } catch (const std::exception& e) {
+            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Импорт"), wxOK | wxICON_WARNING);
+            return;
+        }
+        jobStop = false;
+        jobThread = std::thread([this, worker = std::move(worker), path, table] {
+            importer::Report report{};
+            std::string error{};
+            try {
+                report = importer::importCsv(*worker, path, table, importer::Options{}, nullptr, jobStop);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            CallAfter([this, report, error, table] { onImportDone(report, error, table); });
+        });
+    }
+
+    void onImportDone(const importer::Report& report, const std::string& error, const std::string& table) {
+        if (jobThread.joinable()) {
+            jobThread.join();
+        }
+        // Часть строк могла загрузиться и до ошибки, поэтому счётчик и якоря сбрасываются в любом случае
+        forgetRows(table);
+        if (!error.empty()) {
+            wxMessageBox(wxString::FromUTF8(error), wxT("Импорт"), wxOK | wxICON_WARNING);
+            return;
+        }
+
+        wxString text = wxString::Format(wxT("Загружено строк: %zu за %.1f с (%.0f строк/с), ошибочных строк: %zu"), report.rows, report.seconds,
+                                         report.rowsPerSecond(), report.badLines);
+        for (size_t i = 0; i < report.diagnostics.size() && i < 10; i++) {
+            text += wxString::Format(wxT("\nстрока %zu: "), report.diagnostics[i].line) + wxString::FromUTF8(report.diagnostics[i].message);
+        }
+        wxMessageBox(text, wxT("Импорт"), wxOK | wxICON_INFORMATION);
+
+        described.erase(table);
+        tableList->add(table);
+        if (table == currentTable) {
+            loadRows(currentTable, currentOffset);
+        }
+    }
+
+    // Копия текущей таблицы в локальный файл SQLite, типы колонок переводятся в типы SQLite
+    void onCopyToSqlite(wxCommandEvent&) {
+        if (currentTable.empty()) {
+            return;
+        }
+        if (jobThread.joinable()) {
+            wxMessageBox(wxT("Дождитесь окончания фоновой задачи"), wxT("Копирование"), wxOK | wxICON_INFORMATION);
+            return;
+        }
+        wxFileDialog dialog(this, wxT("Копировать таблицу в SQLite"), "", "", "SQLite (*.db;*.sqlite)|*.db;*.sqlite", wxFD_SAVE);
+        if (dialog.ShowModal() != wxID_OK) {
+            return;
+        }
+
+        std::unique_ptr<base::Database> source;
+        std::unique_ptr<base::Database> target;
+        try {
+            source = db->clone();
+            target = std::make_unique<sqlite::SQLiteDB>(dialog.GetPath().ToStdString());
+        } catch (const std::exception& e) {
+            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Копирование"), wxOK | wxICON_WARNING);
+            return;
+        }
+        jobStop = false;
+        jobStatus = wxT("Копирование...");
+        jobThread = std::thread([this, source = std::move(source), target = std::move(target), table = currentTable] {
+            transfer::Report report{};
+            std::string error{};
+            transfer::Progress progress = [this](size_t rows) {
+                CallAfter([this, rows] { jobStatus = wxString::Format(wxT("Копирование: %zu строк"), rows); });
+            };
+            try {
+                std::string targetTable = transfer::targetName(table, base::isPostgres(*source), false);
+                report = transfer::copyTable(*source, *target, table, targetTable, transfer::Options{}, progress, jobStop);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            CallAfter([this, report, error] { onCopyDone(report, error); });
+        });
+    }
+
+    void onCopyDone(const transfer::Report& report, const std::string& error) {
+        if (jobThread.joinable()) {
+            jobThread.join();
+        }
+        jobStatus.clear();
+        if (!error.empty()) {
+            wxMessageBox(wxString::FromUTF8(error), wxT("Копирование"), wxOK | wxICON_WARNING);
+        } else {
+            wxMessageBox(wxString::Format(wxT("Скопировано строк: %zu за %.1f с (%.0f строк/с)"), report.rows, report.seconds, report.rowsPerSecond()),
+                         wxT("Копирование"), wxOK | wxICON_INFORMATION);
+        }
+    }
+
+    // Согласованная выгрузка всех таблиц в CSV; в каталоге с прерванной выгрузкой её можно продолжить
+    void onDump(wxCommandEvent&) {
+        if (jobThread.joinable()) {
+            wxMessageBox(wxT("Дождитесь окончания фоновой задачи"), wxT("Дамп"), wxOK | wxICON_INFORMATION);
+            return;
+        }
+        wxDirDialog dialog(this, wxT("Каталог для дампа"), "", wxDD_DEFAULT_STYLE);
+        if (dialog.ShowModal() != wxID_OK) {
+            return;
+        }
+        dump::Options options{};
+        if (wxFileExists(dialog.GetPath() + wxT("/dump.json"))) {
+            options.resume = wxMessageBox(wxT("Продолжить прерванный дамп?"), wxT("Дамп"), wxYES_NO | wxICON_QUESTION) == wxYES;
+        }
+        std::string path = dialog.GetPath().ToStdString();
+
+        std::unique_ptr<base::Database> worker;
+        try {
+            worker = db->clone();
+        } catch (const std::exception& e) {
+            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Дамп"), wxOK | wxICON_WARNING);
+            return;
+        }
+        jobStop = false;
+        jobStatus = wxT("Дамп...");
+        jobThread = std::thread([this, worker = std::move(worker), path, options] {
+            dump::Report report{};
+            std::string error{};
+            dump::Progress progress = [this](size_t done, size_t total) {
+                CallAfter([this, done, total] { jobStatus = wxString::Format(wxT("Дамп: %zu из %zu частей"), done, total); });
+            };
+            try {
+                report = dump::dumpDatabase(*worker, path, options, progress, jobStop);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            CallAfter([this, report, error] { onDumpDone(report, error); });
+        });
+    }
+
+    void onDumpDone(const dump::Report& report, const std::string& error) {
+        if (jobThread.joinable()) {
+            jobThread.join();
+        }
+        jobStatus.clear();
+        if (!error.empty()) {
+            wxMessageBox(wxString::FromUTF8(error), wxT("Дамп"), wxOK | wxICON_WARNING);
+        } else if (report.interrupted) {
+            wxMessageBox(wxString::Format(wxT("Дамп прерван, строк: %zu. Его можно продолжить, выбрав тот же каталог"), report.rows), wxT("Дамп"),
+                         wxOK | wxICON_WARNING);
+        } else {
+            wxMessageBox(wxString::Format(wxT("Таблиц: %zu, частей: %zu (готовых ранее: %zu), строк: %zu за %.1f с"), report.tables, report.parts,
+                                          report.skipped, report.rows, report.seconds),
+                         wxT("Дамп"), wxOK | wxICON_INFORMATION);
+        }
+    }
+
+    // Выделенные строки по ключам или, без выделения, все строки под условием WHERE
+    void onRemoveRows(wxCommandEvent&) {
+        std::vector<std::string> keys{};
+        std::string where{};
+        if (!chooseRows(wxT("Удаление"), keys, where)) {
+            return;
+        }
+        wxString question = keys.empty() ? wxT("Удалить строки, где ") + wxString::FromUTF8(where) + wxT("?")
+                                         : wxString::Format(wxT("Удалить строк: %zu?"), keys.size());
+        if (wxMessageBox(question, wxT("Удаление"), wxYES_NO | wxICON_QUESTION) != wxYES) {
+            return;
+        }
+        runBulk(wxT("Удаление"), [keys, where](base::Database& worker, const std::string& table, const std::string& key, const bulk::Options& options,
+                                                 const bulk::Progress& progress, const std::atomic<bool>& stop) {
+            return keys.empty() ? bulk::removeWhere(worker, table, key, where, options, progress, stop)
+                                : bulk::removeByKeys(worker, table, key, keys, options, progress, stop);
+        });
+    }
+
+    // Одно значение в колонке выделенных строк или строк под условием
+    void onReplaceValues(wxCommandEvent&) {
+        std::vector<std::string> keys{};
+        std::string where{};
+        if (!chooseRows(wxT("Замена"), keys, where)) {
+            return;
+        }
+        wxArrayString names{};
+        for (const auto& column : tableSchema(currentTable).columns) {
+            names.Add(wxString::FromUTF8(column.name));
+        }
+        wxSingleChoiceDialog columnDialog(this, wxT("Колонка"), wxT("Замена"), names);
+        if (columnDialog.ShowModal() != wxID_OK) {
+            return;
+        }
+        wxTextEntryDialog valueDialog(this, wxT("Новое значение (\\N - NULL)"), wxT("Замена"));
+        if (valueDialog.ShowModal() != wxID_OK) {
+            return;
+        }
+        std::vector<std::pair<std::string, std::string>> values{{columnDialog.GetStringSelection().ToUTF8().data(), valueDialog.GetValue().ToUTF8().data()}};
+        std::vector<bool> nulls{isNullText(valueDialog.GetValue())};
+        runBulk(wxT("Замена"), [keys, where, values, nulls](base::Database& worker, const std::string& table, const std::string& key,
+                                                             const bulk::Options& options, const bulk::Progress& progress, const std::atomic<bool>& stop) {
+            return keys.empty() ? bulk::updateWhere(worker, table, key, where, values, nulls, options, progress, stop)
+                                : bulk::updateByKeys(worker, table, key, keys, values, nulls, options, progress, stop);
+        });
+    }
+
+    // Ключи выделенных строк, а без выделения - условие WHERE из диалога
+    bool chooseRows(const wxString& title, std::vector<std::string>& keys, std::string& where) {
+        if (currentTable.empty()) {
+            return false;
+        }
+        if (tableSchema(currentTable).rowKey.empty()) {
+            wxMessageBox(wxT("У таблицы нет ключа"), title, wxOK | wxICON_INFORMATION);
+            return false;
+        }
+        if (jobThread.joinable()) {
+            wxMessageBox(wxT("Дождитесь окончания фоновой задачи"), title, wxOK | wxICON_INFORMATION);
+            return false;
+        }
+        for (int row : grid->GetSelectedRows()) {
+            if (row < rowKeys.size()) {
+                keys.push_back(rowKeys[row]);
+            }
+        }
+        if (!keys.empty()) {
+            return true;
+        }
+        wxTextEntryDialog dialog(this, wxT("Условие WHERE"), title);
+        if (dialog.ShowModal() != wxID_OK || dialog.GetValue().empty()) {
+            return false;
+        }
+        where = dialog.GetValue().ToStdString();
+        return true;
+    }
+
+    using BulkJob = std::function<size_t(base::Database&, const std::string&, const std::string&, const bulk::Options&, const bulk::Progress&,
+                                         const std::atomic<bool>&)>;
+
+    // Изменение блоками на отдельном подключении, ход задачи показывается в строке состояния
+    void runBulk(const wxString& title, BulkJob job) {
+        std::unique_ptr<base::Database> worker;
+        try {
+            worker = db->clone();
+        } catch (const std::exception& e) {
+            wxMessageBox(wxString::FromUTF8(e.what()), title, wxOK | wxICON_WARNING);
+            return;
+        }
+        jobStop = false;
+        jobStatus = title + wxT("...");
+        jobThread = std::thread([this, worker = std::move(worker), job = std::move(job), title, table = currentTable,
+                                 key = tableSchema(currentTable).rowKey] {
+            size_t rows = 0;
+            std::string error{};
+            bulk::Progress progress = [this, title](size_t done, size_t total) {
+                wxString status = total == 0 ? wxString::Format(wxT("%s: %zu строк"), title, done)
+                                             : wxString::Format(wxT("%s: %zu из %zu строк"), title, done, total);
+                CallAfter([this, status] { jobStatus = status; });
+            };
+            try {
+                rows = job(*worker, table, key, bulk::Options{config::BULK_CHUNK_ROWS, std::chrono::milliseconds(config::BULK_PAUSE_MS)}, progress,
+                           jobStop);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+            CallAfter([this, title, rows, error, table] { onBulkDone(title, rows, error, table); });
+        });
+    }
+
+    void onBulkDone(const wxString& title, size_t rows, const std::string& error, const std::string& table) {
+        if (jobThread.joinable()) {
+            jobThread.join();
+        }
+        jobStatus.clear();
+        // Блоки до ошибки уже зафиксированы, поэтому число изменённых строк показывается и при ошибке
+        wxString text = wxString::Format(wxT("Изменено строк: %zu"), rows);
+        if (!error.empty()) {
+            text += wxT("\n") + wxString::FromUTF8(error);
+        }
+        wxMessageBox(text, title, wxOK | (error.empty() ? wxICON_INFORMATION : wxICON_WARNING));
+        forgetRows(table);
+        if (table == currentTable) {
+            loadRows(currentTable, currentOffset);
+        }
+    }
+
+#ifdef ALETO_TRACING
+    void onSaveTrace(wxCommandEvent&) {
+        wxFileDialog dialog(this, wxT("Сохранить трассу"), "", "trace.json", "Chrome trace (*.json)|*.json", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+        if (dialog.ShowModal() == wxID_OK && !trace::dump(dialog.GetPath().ToStdString())) {
+            wxMessageBox(wxT("Не удалось сохранить трассу"), wxT("Трасса"), wxOK | wxICON_WARNING);
+        }
+    }
+#endif
+
+    void refreshData(wxCommandEvent&) { refreshRows(false); }
+
+    // Значение NULL при вставке из буфера обмена и в замене, как в текстовом формате COPY
+    static bool isNullText(const wxString& cell) { return cell == wxT("\\N"); }
+
+    // Копии выделенных строк без колонок первичного ключа, новые ключи назначает база
+    void onDuplicateRows(wxCommandEvent&) {
+        wxArrayInt selected = grid->GetSelectedRows();
+        if (currentTable.empty() || selected.empty()) {
+            return;
+        }
+
+        std::vector<int> missing{};
+        for (int i = 0; i < loadedColumns.size(); i++) {
+            if (!loadedColumns[i]) {
+                missing.push_back(i);
+            }
+        }
+        loadColumns(missing);
+
+        const types::TableSchema& schema = tableSchema(currentTable);
+        std::vector<int> columns{};
+        std::vector<std::string> names{};
+        for (int c = 0; c < gridColumns.size(); c++) {
+            auto it = std::find_if(schema.columns.begin(), schema.columns.end(), [&](const types::Column& column) { return column.name == gridColumns[c]; });
+            if (it == schema.columns.end() || !it->primary_key) {
+                columns.push_back(c);
+                names.push_back(gridColumns[c]);
+            }
+        }
+
+        types::ColumnBatch batch(names);
+        batch.reserve(selected.size());
+        for (int row : selected) {
+            std::vector<std::string> values{};
+            std::vector<bool> nulls{};
+            for (int c : columns) {
+                if (truncatedCells.count({row, c}) != 0 && !loadFullValue(row, c)) {
+                    return;
+                }
+                values.push_back(grid->GetCellValue(row, c).ToUTF8().data());
+                nulls.push_back(nullCells.count({row, c}) != 0);
+            }
+            batch.append(values, nulls);
+        }
+        insertRows(batch);
+    }
+
+    // Строки из буфера обмена в табличном формате (табуляция между значениями), начиная с колонки курсора; \N - NULL
+    void onPasteRows(wxCommandEvent&) {
+        if (currentTable.empty() || gridColumns.empty()) {
+            return;
+        }
+        wxString text{};
+        if (wxTheClipboard->Open()) {
+            if (wxTheClipboard->IsSupported(wxDF_TEXT)) {
+                wxTextDataObject data;
+                wxTheClipboard->GetData(data);
+                text = data.GetText();
+            }
+            wxTheClipboard->Close();
+        }
+
+        std::vector<std::vector<wxString>> rows{};
+        size_t width = 0;
+        for (const wxString& line : wxSplit(text, '\n', '\0')) {
+            wxString trimmed = line;
+            if (trimmed.EndsWith(wxT("\r"))) {
+                trimmed.RemoveLast();
+            }
+            if (trimmed.empty()) {
+                continue;
+            }
+            wxArrayString fields = wxSplit(trimmed, '\t', '\0');
+            rows.emplace_back(fields.begin(), fields.end());
+            width = std::max(width, rows.back().size());
+        }
+
+        int first = std::max(0, grid->GetGridCursorCol());
+        width = std::min(width, gridColumns.size() - first);
+        if (rows.empty() || width == 0) {
+            return;
+        }
+
+        types::ColumnBatch batch(std::vector<std::string>(gridColumns.begin() + first, gridColumns.begin() + first + width));
+        batch.reserve(rows.size());
+        for (const auto& row : rows) {
+            std::vector<std::string> values{};
+            std::vector<bool> nulls{};
+            for (size_t c = 0; c < width; c++) {
+                wxString cell = c < row.size() ? row[c] : wxString();
+                values.push_back(cell.ToUTF8().data());
+                nulls.push_back(isNullText(cell));
+            }
+            batch.append(values, nulls);
+        }
+        insertRows(batch);
+    }
+
+    // Один пакет вместо addRow на строку; строки с ошибками пропускаются и перечисляются
+    void insertRows(const types::ColumnBatch& batch) {
+        types::BatchResult result{};
+        try {
+            wxBusyCursor busy;
+            result = db->addRows(currentTable, batch, true);
+        } catch (const std::exception& e) {
+            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Вставка"), wxOK | wxICON_WARNING);
+            return;
+        }
+
+        if (!result.errors.empty()) {
+            wxString text = wxString::Format(wxT("Вставлено строк: %zu из %zu"), result.inserted, batch.rows());
+            for (size_t i = 0; i < result.errors.size() && i < 10; i++) {
+                text += wxString::Format(wxT("\nстрока %zu: "), result.errors[i].first + 1) + wxString::FromUTF8(result.errors[i].second);
+            }
+            wxMessageBox(text, wxT("Вставка"), wxOK | wxICON_WARNING);
+        }
+        forgetRows(currentTable);
+        loadRows(currentTable, currentOffset);
+    }
+
+    void onEditorShown(wxGridEvent& event) {
+        int row = event.GetRow();
+        int col = event.GetCol();
+        if (truncatedCells.count({row, col}) == 0) {
+            event.Skip();
+            return;
+        }
+        // Усечённое значение нельзя редактировать, пока не загружено полностью
+        if (row >= rowKeys.size() || !loadFullValue(row, col)) {
+            event.Veto();
+            return;
+        }
+        event.Skip();
+    }
+
+    bool loadFullValue(int row, int col) {
+        const types::TableSchema& schema = tableSchema(currentTable);
+        std::pair<std::string, std::string> where{schema.rowKey, rowKeys[row]};
+        types::Column column{gridColumns[col], true, false, ""};
+        for (const auto& described : schema.columns) {
+            if (described.name == column.name) {
+                column = described;
+            }
+        }
+        std::string value{};
+        // Позиция - в единицах базы (символы или байты), а не длина собранного значения
+        size_t offset = 0;
+        try {
+            wxBusyCursor busy;
+            while (true) {
+                std::string chunk = db->readValue(currentTable, where, column, offset, config::VALUE_CHUNK);
+                if (chunk.empty()) {
+                    break;
+                }
+                value += chunk;
+            }
+        } catch (const std::exception& e) {
+            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Подключение"), wxOK | wxICON_WARNING);
+            return false;
+        }
+
+        truncatedCells.erase({row, col});
+        grid->SetCellValue(row, col, wxString::FromUTF8(value));
+        grid->SetCellTextColour(row, col, grid->GetDefaultCellTextColour());
+        return true;
+    }
+
+    void onPositionChanged(wxScrollEvent&) {
+        TRACE_SPAN("ui.positionChanged");
+        long long rows = rowsBound(currentTable);
+        int offset = static_cast<int>((rows - 1) * positionSlider->GetValue() / positionSlider->GetMax());
+        if (offset < currentOffset || offset >= currentOffset + currentLimit) {
+            loadRows(currentTable, offset);
+        }
+    }
+
+    void onAnchorsReady(const std::string& table) {
+        long long rows = anchors->approxRows(table, tableSchema(table).rowKey);
+        if (rows == 0) {
+            return;
+        }
+        tableRows[table] = std::min(rows, rowsBound(table));
+        if (table == currentTable) {
+            updatePosition();
+        }
+    }
+
+    void updatePosition() {
+        const std::string& key = tableSchema(currentTable).rowKey;
+        bool known = anchors && !key.empty() && anchors->approxRows(currentTable, key) > 0;
+        positionSlider->Enable(known);
+        if (known && rowsBound(currentTable) > 1) {
+            positionSlider->SetValue(static_cast<int>(currentOffset * static_cast<long long>(positionSlider->GetMax()) / (rowsBound(currentTable) - 1)));
+        }
+    }
+
+    const types::TableSchema& tableSchema(const std::string& tableName) {
+        auto it = described.find(tableName);
+        if (it != described.end()) {
+            return it->second;
+        }
+
+        types::TableSchema schema{tableName, {}};
+        try {
+            schema = db->describe(tableName);
+        } catch (const std::exception&) {
+            // Без описания таблица листается через OFFSET
+        }
+        if (anchors && !schema.rowKey.empty()) {
+            anchors->request(tableName, schema.rowKey, config::ROWS_ON_PAGE);
+        }
+        return described[tableName] = schema;
+    }
+
+    // Переход по якорю: один seek по ключу вместо OFFSET через всю таблицу
+    types::TableData fetchPage(const std::string& tableName, int offset, int limit, const std::vector<std::string>& columns, bool hashes) {
+        return paging::fetchPage(*db, anchors.get(), tableSchema(tableName), offset, limit, columns, hashes);
+    }
+
+    std::vector<std::string> chosenColumns(const types::TableSchema& schema) {
+        const std::set<std::string>& hidden = hiddenColumns[schema.title];
+        std::vector<std::string> columns{};
+        for (const auto& column : schema.columns) {
+            if (hidden.count(column.name) == 0) {
+                columns.push_back(column.name);
+            }
+        }
+        return columns;
+    }
+
+    // Колонки в горизонтальной области просмотра с небольшим запасом по краям
+    std::vector<int> visibleColumns(int count) {
+        int x = 0, y = 0, unitX = 0, unitY = 0, width = 0, height = 0;
+        grid->GetViewStart(&x, &y);
+        grid->GetScrollPixelsPerUnit(&unitX, &unitY);
+        grid->GetGridWindow()->GetClientSize(&width, &height);
+
+        int first = 0, last = 0;
+        if (grid->GetNumberCols() == count) {
+            first = grid->XToCol(x * unitX, true);
+            last = grid->XToCol(x * unitX + width, true);
+        } else {
+            last = width / grid->GetDefaultColSize();
+        }
+        first = std::max(0, first - config::COLUMNS_MARGIN);
+        last = std::min(count - 1, last + config::COLUMNS_MARGIN);
+
+        std::vector<int> columns{};
+        for (int i = first; i <= last; i++) {
+            columns.push_back(i);
+        }
+        return columns;
+    }
 
     void loadPage(std::string tableName, int page = 1) {
-        if (page <= 0 || page > lastPages[tableName]) {
+        if (page > 0) {
+            loadRows(tableName, (page - 1) * pageSizer.rowsFor(tableName));
+        }
+    }
+
+    // Размер страницы подбирается под бюджет задержки и объёма по прошлым загрузкам таблицы.
+    // quiet - без сообщений об ошибках (фоновое обновление)
+    void loadRows(std::string tableName, int offset, bool quiet = false) {
+        TRACE_SPAN("ui.loadRows");
+        if (offset < 0 || offset >= rowsBound(tableName)) {
             return;
         }
 
+        const types::TableSchema& schema = tableSchema(tableName);
+        std::vector<std::string> columns = chosenColumns(schema);
+        // Без ключа порядок строк между запросами не гарантирован, поэтому колонки грузятся сразу
+        bool lazy = !schema.rowKey.empty() && !columns.empty();
+        std::vector<int> wanted{};
+        std::vector<std::string> request = columns;
+        if (lazy) {
+            wanted = visibleColumns(columns.size());
+            request = {schema.rowKey};
+            for (int column : wanted) {
+                request.push_back(columns[column]);
+            }
+        }
+
+        int limit = pageSizer.rowsFor(tableName);
         types::TableData data{};
         try {
-            data = db->select(tableName, (page - 1) * config::ROWS_ON_PAGE, config::ROWS_ON_PAGE);
-            if (data.data.size() < config::ROWS_ON_PAGE && page < lastPages[tableName]) {
-                lastPages[tableName] = page;
+            // Хеши строк приходят тем же запросом, что и страница, поэтому описывают именно показанные значения
+            auto started = std::chrono::steady_clock::now();
+            uint64_t reads = db->databaseReads();
+            data = fetchPage(tableName, offset, limit, request, lazy);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - started;
+            // Ответ кеша не говорит о скорости базы и только завысил бы размер страницы
+            if (db->databaseReads() != reads) {
+                pageSizer.record(tableName, data.data.size(), data.byteSize(), elapsed.count());
+            }
+            if (data.data.size() < limit) {
+                tableRows[tableName] = std::min(rowsBound(tableName), static_cast<long long>(offset + data.data.size()));
             }
             if (data.data.size() == 0) {
                 throw std::runtime_error("Пустая страница");
             }
         } catch (const std::exception& e) {
-            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Подключение"), wxOK | wxICON_WARNING);
+            if (!quiet) {
+                wxMessageBox(wxString::FromUTF8(e.what()), wxT("Подключение"), wxOK | wxICON_WARNING);
+            }
             return;
         }
 
-        pageText->SetValue(wxString(std::to_string(page)));
-        currentPage = page;
+        currentPage = offset / limit + 1;
+        pageText->SetValue(wxString(std::to_string(currentPage)));
         currentTable = tableName;
+        watchTable(tableName);
+        currentOffset = offset;
+        currentLimit = limit;
+        updatePosition();
+
+        if (columns.empty()) {
+            for (const auto& column : data.columns) {
+                columns.push_back(column.name);
+            }
+        }
+        if (!lazy) {
+            for (int i = 0; i < columns.size(); i++) {
+                wanted.push_back(i);
+            }
+        }
+        gridColumns = columns;
+        loadedColumns.assign(columns.size(), false);
+        truncatedCells.clear();
+        nullCells.clear();
+        rowKeys.clear();
+        rowHashes.clear();
+        if (lazy) {
+            for (int i = 0; i < data.data.size(); i++) {
+                rowKeys.push_back(data.data[i][0]);
+                if (i < data.hashes.size()) {
+                    rowHashes[data.data[i][0]] = data.hashes[i];
+                }
+            }
+        }
 
         grid->ClearGrid();
         if (grid->GetNumberRows() != 0) {
@@ -161,16 +1169,265 @@ class MainFrame : public wxFrame {
         if (grid->GetNumberCols() != 0) {
             grid->DeleteCols(0, grid->GetNumberCols());
         }
-        grid->AppendCols(data.columns.size());
+        grid->AppendCols(gridColumns.size());
         grid->AppendRows(data.data.size());
-        for (int i = 0; i < data.columns.size(); i++) {
-            grid->SetColLabelValue(i, wxString::FromUTF8(data.columns[i].name));
+        for (int i = 0; i < gridColumns.size(); i++) {
+            grid->SetColLabelValue(i, wxString::FromUTF8(gridColumns[i]));
+        }
+        fillColumns(data, wanted, lazy ? 1 : 0);
+        if (lazy) {
+            CallAfter(&MainFrame::loadVisibleColumns);
+        }
+    }
+
+    std::map<std::string, std::string> pageHashes(const std::string& tableName, int offset, int limit) {
+        std::map<std::string, std::string> hashes{};
+        for (const auto& row : paging::fetchHashes(*db, anchors.get(), tableSchema(tableName), offset, limit).data) {
+            hashes[row[0]] = row[1];
         }
+        return hashes;
+    }
+
+    // Обновление открытой страницы по хешам строк: заново передаются и перерисовываются только изменившиеся строки,
+    // оформление остальных сохраняется. Если набор ключей страницы сменился, она перечитывается целиком
+    void refreshRows(bool quiet) {
+        TRACE_SPAN("ui.refreshRows");
+        // Об изменении известно (уведомление или обновление вручную), поэтому страница не берётся из кеша без сверки версии
+        db->expire();
+        if (rowHashes.empty() || rowHashes.size() != rowKeys.size()) {
+            loadRows(currentTable, currentOffset, quiet);
+            return;
+        }
+
+        std::map<std::string, std::string> hashes{};
+        try {
+            hashes = pageHashes(currentTable, currentOffset, currentLimit);
+        } catch (const std::exception& e) {
+            if (!quiet) {
+                wxMessageBox(wxString::FromUTF8(e.what()), wxT("Подключение"), wxOK | wxICON_WARNING);
+            }
+            return;
+        }
+
+        std::map<std::string, int> position{};
+        for (int i = 0; i < rowKeys.size(); i++) {
+            position[rowKeys[i]] = i;
+        }
+        std::vector<std::string> changed{};
+        for (const auto& [key, hash] : hashes) {
+            auto it = rowHashes.find(key);
+            if (it == rowHashes.end() || position.count(key) == 0) {
+                loadRows(currentTable, currentOffset, quiet);
+                return;
+            }
+            if (it->second != hash) {
+                changed.push_back(key);
+            }
+        }
+        if (hashes.size() != rowHashes.size()) {
+            loadRows(currentTable, currentOffset, quiet);
+            return;
+        }
+        if (changed.empty()) {
+            return;
+        }
+
+        std::vector<int> columns{};
+        std::vector<std::string> request{tableSchema(currentTable).rowKey};
+        for (int i = 0; i < loadedColumns.size(); i++) {
+            if (loadedColumns[i]) {
+                columns.push_back(i);
+                request.push_back(gridColumns[i]);
+            }
+        }
+        types::TableData data{};
+        try {
+            data = db->selectKeys(currentTable, request[0], changed, request);
+        } catch (const std::exception& e) {
+            if (!quiet) {
+                wxMessageBox(wxString::FromUTF8(e.what()), wxT("Подключение"), wxOK | wxICON_WARNING);
+            }
+            return;
+        }
+        fillRows(data, columns, position);
+        rowHashes = std::move(hashes);
+    }
+
+    // Перезаписывает загруженные колонки отдельных строк; строка grid находится по ключу в первой колонке data.
+    // Несохранённые правки не затираются
+    void fillRows(const types::TableData& data, const std::vector<int>& columns, const std::map<std::string, int>& position) {
+        TRACE_SPAN("grid.fillRows");
+        std::vector<int> rows(data.data.size(), -1);
+        grid->BeginBatch();
+        for (int i = 0; i < data.data.size(); i++) {
+            const auto& row = data.data[i];
+            auto it = position.find(row[0]);
+            if (it == position.end()) {
+                continue;
+            }
+            rows[i] = it->second;
+            for (int j = 0; j < columns.size() && j + 1 < row.size(); j++) {
+                if (editedCells.count(std::make_tuple(rows[i], columns[j])) != 0) {
+                    continue;
+                }
+                truncatedCells.erase({rows[i], columns[j]});
+                if (data.nulls.count({i, j + 1}) != 0) {
+                    nullCells.insert({rows[i], columns[j]});
+                } else {
+                    nullCells.erase({rows[i], columns[j]});
+                }
+                grid->SetCellValue(rows[i], columns[j], wxString::FromUTF8(row[j + 1]));
+                grid->SetCellTextColour(rows[i], columns[j], grid->GetDefaultCellTextColour());
+            }
+        }
+        for (const auto& [cell, length] : data.truncated) {
+            int col = cell.second - 1;
+            if (cell.first >= rows.size() || rows[cell.first] < 0 || col < 0 || col >= columns.size() ||
+                editedCells.count(std::make_tuple(rows[cell.first], columns[col])) != 0) {
+                continue;
+            }
+            int row = rows[cell.first];
+            truncatedCells[{row, columns[col]}] = length;
+            grid->SetCellValue(row, columns[col], grid->GetCellValue(row, columns[col]) + wxT("…"));
+            grid->SetCellTextColour(row, columns[col], wxColour(128, 128, 128));
+        }
+        grid->EndBatch();
+    }
+
+    // Заполняет колонки grid из data, начиная с колонки first результата. При first != 0 в первой колонке data - ключ,
+    // строка grid находится по нему: строки результата могут идти в другом порядке или отсутствовать
+    void fillColumns(const types::TableData& data, const std::vector<int>& columns, size_t first) {
+        auto started = std::chrono::steady_clock::now();
+        TRACE_SPAN("grid.fill");
+        int gridRows = grid->GetNumberRows();
+        std::map<std::string, int> position{};
+        if (first != 0) {
+            for (int i = 0; i < rowKeys.size(); i++) {
+                position[rowKeys[i]] = i;
+            }
+        }
+        std::vector<int> rows(data.data.size(), -1);
         for (int i = 0; i < data.data.size(); i++) {
-            for (int j = 0; j < data.data[i].size(); j++) {
-                grid->SetCellValue(i, j, wxString::FromUTF8(data.data[i][j]));
+            if (first == 0) {
+                rows[i] = i < gridRows ? i : -1;
+                continue;
+            }
+            auto it = position.find(data.data[i][0]);
+            rows[i] = it == position.end() ? -1 : it->second;
+        }
+
+        // Значения перекодируются прямо при заполнении, без промежуточной копии всей страницы
+        grid->BeginBatch();
+        {
+            TRACE_SPAN("grid.setCellValue");
+            for (int i = 0; i < data.data.size(); i++) {
+                const auto& row = data.data[i];
+                if (rows[i] < 0) {
+                    continue;
+                }
+                for (int j = 0; j < columns.size() && first + j < row.size(); j++) {
+                    if (data.nulls.count({i, static_cast<int>(first) + j}) != 0) {
+                        nullCells.insert({rows[i], columns[j]});
+                    }
+                    grid->SetCellValue(rows[i], columns[j], wxString::FromUTF8(row[first + j]));
+                }
             }
         }
+        for (const auto& [cell, length] : data.truncated) {
+            int col = cell.second - static_cast<int>(first);
+            if (cell.first >= rows.size() || rows[cell.first] < 0 || col < 0 || col >= columns.size()) {
+                continue;
+            }
+            int row = rows[cell.first];
+            truncatedCells[{row, columns[col]}] = length;
+            grid->SetCellValue(row, columns[col], grid->GetCellValue(row, columns[col]) + wxT("…"));
+            grid->SetCellTextColour(row, columns[col], wxColour(128, 128, 128));
+        }
+        grid->EndBatch();
+        for (int column : columns) {
+            loadedColumns[column] = true;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+        registry->record("grid.fill", elapsed.count(), data.data.size(), 0, false);
+    }
+
+    void loadColumns(const std::vector<int>& columns) {
+        TRACE_SPAN("ui.loadColumns");
+        if (columns.empty() || rowKeys.empty()) {
+            return;
+        }
+
+        std::vector<std::string> request{tableSchema(currentTable).rowKey};
+        for (int column : columns) {
+            request.push_back(gridColumns[column]);
+        }
+
+        // Строки выбираются по ключам показанных строк, а не заново по смещению: страница могла сдвинуться
+        types::TableData data{};
+        try {
+            data = db->selectKeys(currentTable, request[0], rowKeys, request);
+        } catch (const std::exception& e) {
+            wxMessageBox(wxString::FromUTF8(e.what()), wxT("Подключение"), wxOK | wxICON_WARNING);
+            return;
+        }
+        fillColumns(data, columns, 1);
+    }
+
+    void loadVisibleColumns() {
+        std::vector<int> missing{};
+        for (int column : visibleColumns(gridColumns.size())) {
+            if (!loadedColumns[column]) {
+                missing.push_back(column);
+            }
+        }
+        loadColumns(missing);
+    }
+
+    void onGridScrolled(wxScrollWinEvent& event) {
+        event.Skip();
+        CallAfter(&MainFrame::loadVisibleColumns);
+    }
+
+    void onGridResized(wxSizeEvent& event) {
+        event.Skip();
+        CallAfter(&MainFrame::loadVisibleColumns);
+    }
+
+    void onGridCellSelected(wxGridEvent& event) {
+        event.Skip();
+        CallAfter(&MainFrame::loadVisibleColumns);
+    }
+
+    void onChooseColumns(wxCommandEvent&) {
+        const types::TableSchema& schema = tableSchema(currentTable);
+        if (schema.columns.empty()) {
+            return;
+        }
+
+        wxArrayString names{};
+        wxArrayInt selected{};
+        std::set<std::string>& hidden = hiddenColumns[currentTable];
+        for (int i = 0; i < schema.columns.size(); i++) {
+            names.Add(wxString::FromUTF8(schema.columns[i].name));
+            if (hidden.count(schema.columns[i].name) == 0) {
+                selected.push_back(i);
+            }
+        }
+
+        wxMultiChoiceDialog dialog(this, wxT("Отображаемые колонки"), wxT("Колонки"), names);
+        dialog.SetSelections(selected);
+        if (dialog.ShowModal() != wxID_OK || dialog.GetSelections().empty()) {
+            return;
+        }
+
+        hidden.clear();
+        for (const auto& column : schema.columns) {
+            hidden.insert(column.name);
+        }
+        for (int i : dialog.GetSelections()) {
+            hidden.erase(schema.columns[i].name);
+        }
+        loadRows(currentTable, currentOffset);
     }
 
     void onColumnHeaderClick(wxGridEvent& event) {
@@ -201,6 +1458,15 @@ class MainFrame : public wxFrame {
         }
         grid->ForceRefresh();
 
+        // Сортировка переставляет строки, поэтому недогруженные колонки подтягиваются заранее
+        std::vector<int> missing{};
+        for (int i = 0; i < loadedColumns.size(); i++) {
+            if (!loadedColumns[i]) {
+                missing.push_back(i);
+            }
+        }
+        loadColumns(missing);
+
         int rows = grid->GetNumberRows();
         std::vector<std::pair<wxString, int>> data;
 
@@ -220,6 +1486,33 @@ class MainFrame : public wxFrame {
             sortedRows.push_back(std::move(row));
         }
 
+        std::map<int, int> newIndex{};
+        for (int i = 0; i < rows; ++i) {
+            newIndex[data[i].second] = i;
+        }
+        std::map<std::pair<int, int>, size_t> sortedTruncated{};
+        for (const auto& [cell, length] : truncatedCells) {
+            sortedTruncated[{newIndex[cell.first], cell.second}] = length;
+            grid->SetCellTextColour(cell.first, cell.second, grid->GetDefaultCellTextColour());
+        }
+        truncatedCells = std::move(sortedTruncated);
+        std::set<std::pair<int, int>> sortedNulls{};
+        for (const auto& cell : nullCells) {
+            sortedNulls.insert({newIndex[cell.first], cell.second});
+        }
+        nullCells = std::move(sortedNulls);
+        for (const auto& [cell, _] : truncatedCells) {
+            grid->SetCellTextColour(cell.first, cell.second, wxColour(128, 128, 128));
+        }
+
+        if (rowKeys.size() == rows) {
+            std::vector<std::string> sortedKeys;
+            for (const auto& [_, index] : data) {
+                sortedKeys.push_back(rowKeys[index]);
+            }
+            rowKeys = std::move(sortedKeys);
+        }
+
         // Обновляем строки в гриде
         for (int i = 0; i < rows; ++i) {
             for (int c = 0; c < grid->GetNumberCols(); ++c) {
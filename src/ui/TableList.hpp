@@ -0,0 +1,124 @@
+#pragma once
+
+#include <wx/listctrl.h>
+#include <wx/wx.h>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "../../libs/musoci/catalog.hpp"
+#include "../../libs/musoci/trace.hpp"
+
+// Виртуальный список: строки не создаются, подпись запрашивается только для видимых, поэтому
+// десятки тысяч таблиц показываются и фильтруются без задержки
+class TableListView : public wxListCtrl {
+ public:
+    TableListView(wxWindow* parent, const std::vector<std::string>& names, const std::vector<size_t>& shown)
+        : wxListCtrl(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL),
+          names(names),
+          shown(shown) {
+        AppendColumn(wxT("Схема"));
+        AppendColumn(wxT("Таблица"));
+        SetColumnWidth(0, 90);
+        SetColumnWidth(1, 180);
+    }
+
+    // Таблицы без схемы в названии (public и SQLite) показываются с пустой схемой
+    wxString OnGetItemText(long item, long column) const override {
+        const std::string& name = names[shown[item]];
+        size_t dot = name.find('.');
+        if (dot == std::string::npos)
+            return column == 0 ? wxString() : wxString::FromUTF8(name);
+        return wxString::FromUTF8(column == 0 ? name.substr(0, dot) : name.substr(dot + 1));
+    }
+
+ private:
+    const std::vector<std::string>& names;
+    const std::vector<size_t>& shown;
+};
+
+// Список таблиц с полем фильтра над ним. Фильтр нечёткий (catalog::NameIndex) и применяется при каждом вводе
+class TableList : public wxPanel {
+ public:
+    explicit TableList(wxWindow* parent) : wxPanel(parent) {
+        wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+        SetSizer(sizer);
+
+        filterText = new wxTextCtrl(this, wxID_ANY);
+        filterText->SetHint(wxT("Фильтр"));
+        filterText->Bind(wxEVT_TEXT, &TableList::onFilter, this);
+        sizer->Add(filterText, 0, wxEXPAND | wxBOTTOM, 5);
+
+        view = new TableListView(this, names, shown);
+        view->Bind(wxEVT_LIST_ITEM_SELECTED, &TableList::onItemSelected, this);
+        sizer->Add(view, 1, wxEXPAND);
+    }
+
+    // Выбор таблицы в списке
+    std::function<void(const std::string&)> onSelected;
+
+    // Список заменяется целиком, выбранная таблица остаётся выбранной, если она есть в новом списке
+    void setTables(std::vector<std::string> tables) {
+        TRACE_SPAN("ui.setTables");
+        std::string previous = selected();
+        names = std::move(tables);
+        index = catalog::NameIndex(names);
+        apply(previous);
+    }
+
+    void add(const std::string& table) {
+        for (const auto& name : names) {
+            if (name == table)
+                return;
+        }
+        std::string previous = selected();
+        names.push_back(table);
+        index = catalog::NameIndex(names);
+        apply(previous);
+    }
+
+    const std::vector<std::string>& tables() const { return names; }
+
+    std::string selected() const {
+        long item = view->GetFirstSelected();
+        return item < 0 ? std::string() : names[shown[item]];
+    }
+
+ private:
+    TableListView* view;
+    wxTextCtrl* filterText;
+    std::vector<std::string> names{};
+    catalog::NameIndex index{};
+    // Номера показанных названий в порядке показа
+    std::vector<size_t> shown{};
+    // Выбор восстанавливается программно и не должен открывать таблицу заново
+    bool restoring = false;
+
+    // Выбор в виртуальном списке хранится номером строки, поэтому при смене строк он снимается и ставится заново
+    void apply(const std::string& previous) {
+        restoring = true;
+        view->SetItemState(-1, 0, wxLIST_STATE_SELECTED);
+        shown = index.filter(filterText->GetValue().ToUTF8().data());
+        view->SetItemCount(static_cast<long>(shown.size()));
+        if (!shown.empty())
+            view->RefreshItems(0, static_cast<long>(shown.size()) - 1);
+        for (size_t i = 0; i < shown.size() && !previous.empty(); ++i) {
+            if (names[shown[i]] == previous) {
+                view->SetItemState(static_cast<long>(i), wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
+                view->EnsureVisible(static_cast<long>(i));
+                break;
+            }
+        }
+        restoring = false;
+    }
+
+    void onFilter(wxCommandEvent&) {
+        TRACE_SPAN("ui.filterTables");
+        apply(selected());
+    }
+
+    void onItemSelected(wxListEvent& event) {
+        if (!restoring && onSelected)
+            onSelected(names[shown[event.GetIndex()]]);
+    }
+};
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <wx/grid.h>
+#include <wx/wx.h>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../../libs/musoci/tail.hpp"
+#include "../../libs/musoci/trace.hpp"
+#include "../core/config.hpp"
+
+// Последние строки в кольцевом буфере. Grid запрашивает только видимые значения, поэтому
+// перекодировка не зависит от темпа вставки; старые строки вытесняются новыми
+class TailTable : public wxGridTableBase {
+ public:
+    TailTable(std::vector<std::string> columns, size_t capacity) : columns(std::move(columns)), capacity(capacity) {}
+
+    int GetNumberRows() override { return static_cast<int>(rows.size()); }
+    int GetNumberCols() override { return static_cast<int>(columns.size()); }
+
+    wxString GetValue(int row, int col) override {
+        const auto& values = rows[(first + row) % rows.size()];
+        return col < values.size() ? wxString::FromUTF8(values[col]) : wxString();
+    }
+
+    void SetValue(int, int, const wxString&) override {}
+    bool IsEmptyCell(int row, int col) override { return GetValue(row, col).empty(); }
+    wxString GetColLabelValue(int col) override { return wxString::FromUTF8(columns[col]); }
+
+    // Возвращает, на сколько выросло число строк (при вытеснении оно не меняется)
+    size_t append(std::deque<std::vector<std::string>>& batch) {
+        size_t before = rows.size();
+        size_t skip = batch.size() > capacity ? batch.size() - capacity : 0;
+        for (size_t i = skip; i < batch.size(); i++) {
+            if (rows.size() < capacity) {
+                rows.push_back(std::move(batch[i]));
+            } else {
+                rows[first] = std::move(batch[i]);
+                first = (first + 1) % capacity;
+            }
+        }
+        return rows.size() - before;
+    }
+
+ private:
+    std::vector<std::string> columns;
+    size_t capacity;
+    std::vector<std::vector<std::string>> rows{};
+    // Индекс самой старой строки после заполнения буфера
+    size_t first = 0;
+};
+
+// Режим tail -f: отдельное подключение опрашивает таблицу новыми строками по ключу, окно дописывает их снизу.
+// Порции копятся рабочим потоком и забираются интерфейсом не чаще, чем он успевает их показать
+class TailFrame : public wxFrame {
+ public:
+    TailFrame(wxWindow* parent, std::unique_ptr<base::Database> _db, const types::TableSchema& schema, const std::vector<std::string>& columns)
+        : wxFrame(parent, wxID_ANY, wxString::FromUTF8("tail " + schema.title), wxDefaultPosition, wxSize(config::WIDTH * 3 / 4, config::HEIGHT * 3 / 4)),
+          db(std::move(_db)),
+          follower(*db, schema.title, schema.rowKey, columns,
+                   {config::TAIL_MIN_BATCH, config::TAIL_MAX_BATCH, std::chrono::milliseconds(config::TAIL_POLL_MS)}) {
+        wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+        wxPanel* panel = new wxPanel(this);
+        panel->SetSizer(sizer);
+
+        followBox = new wxCheckBox(panel, wxID_ANY, wxT("Прокручивать к новым строкам"));
+        followBox->SetValue(true);
+        sizer->Add(followBox, 0, wxALL, 8);
+
+        std::vector<std::string> names{schema.rowKey};
+        for (const auto& column : columns) {
+            if (column != schema.rowKey) {
+                names.push_back(column);
+            }
+        }
+        if (columns.empty()) {
+            for (const auto& column : schema.columns) {
+                if (column.name != schema.rowKey) {
+                    names.push_back(column.name);
+                }
+            }
+        }
+        table = new TailTable(names, config::TAIL_ROWS);
+        grid = new wxGrid(panel, wxID_ANY);
+        grid->SetTable(table, true);
+        grid->EnableEditing(false);
+        sizer->Add(grid, 1, wxEXPAND | wxALL, 0);
+
+        CreateStatusBar();
+        Bind(wxEVT_CLOSE_WINDOW, &TailFrame::onClose, this);
+
+        worker = std::thread([this] { run(); });
+    }
+
+    ~TailFrame() override { stopWorker(); }
+
+ private:
+    std::unique_ptr<base::Database> db;
+    tail::Follower follower;
+    std::thread worker;
+    std::atomic<bool> stop{false};
+
+    // Строки, прочитанные рабочим потоком и ещё не показанные; drain запланирован не больше одного раза.
+    // Больше буфера окна не копится: лишнее всё равно было бы вытеснено
+    std::mutex mutex;
+    std::deque<std::vector<std::string>> pending{};
+    bool scheduled = false;
+    int batch = 0;
+    size_t received = 0;
+
+    TailTable* table;
+    wxGrid* grid;
+    wxCheckBox* followBox;
+
+    void run() {
+        try {
+            follower.start(config::TAIL_BACKLOG);
+            while (!stop) {
+                types::TableData data = follower.poll();
+                if (!data.data.empty()) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    received += data.data.size();
+                    for (auto& row : data.data) {
+                        pending.push_back(std::move(row));
+                    }
+                    while (pending.size() > config::TAIL_ROWS) {
+                        pending.pop_front();
+                    }
+                    batch = follower.batch();
+                    if (!scheduled) {
+                        scheduled = true;
+                        CallAfter(&TailFrame::drain);
+                    }
+                }
+                for (auto left = follower.delay(); !stop && left.count() > 0; left -= std::chrono::milliseconds(10)) {
+                    std::this_thread::sleep_for(std::min(left, std::chrono::milliseconds(10)));
+                }
+            }
+        } catch (const std::exception& e) {
+            std::string error = e.what();
+            CallAfter([this, error] { SetStatusText(wxString::FromUTF8(error)); });
+        }
+    }
+
+    void drain() {
+        TRACE_SPAN("ui.tailDrain");
+        std::deque<std::vector<std::string>> rows{};
+        int rowsPerPoll = 0;
+        size_t total = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            rows.swap(pending);
+            scheduled = false;
+            rowsPerPoll = batch;
+            total = received;
+        }
+
+        grid->BeginBatch();
+        size_t added = table->append(rows);
+        if (added != 0) {
+            wxGridTableMessage message(table, wxGRIDTABLE_NOTIFY_ROWS_APPENDED, static_cast<int>(added));
+            grid->ProcessTableMessage(message);
+        }
+        grid->EndBatch();
+        grid->ForceRefresh();
+        if (followBox->GetValue() && table->GetNumberRows() > 0) {
+            grid->MakeCellVisible(table->GetNumberRows() - 1, 0);
+        }
+        SetStatusText(wxString::Format(wxT("Получено строк: %zu, в окне: %d, порция: %d"), total, table->GetNumberRows(), rowsPerPoll));
+    }
+
+    void stopWorker() {
+        stop = true;
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+
+    void onClose(wxCloseEvent&) {
+        stopWorker();
+        Destroy();
+    }
+};
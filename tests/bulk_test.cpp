@@ -0,0 +1,76 @@
+#include "../libs/musoci/bulk.hpp"
+#include "../libs/musoci/sqlite.hpp"
+#include "check.hpp"
+
+namespace {
+
+// Таблица t(id, v) со строками 1..count, v = 'x'
+void fill(sqlite::SQLiteDB& db, int count) {
+    db.executeQuery("CREATE TABLE t(id INTEGER PRIMARY KEY, v TEXT);");
+    db.executeQuery("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(count) +
+                    ") INSERT INTO t SELECT i, 'x' FROM n;");
+}
+
+std::vector<std::string> range(int first, int last) {
+    std::vector<std::string> keys;
+    for (int i = first; i <= last; ++i) {
+        keys.push_back(std::to_string(i));
+    }
+    return keys;
+}
+
+std::string scalar(sqlite::SQLiteDB& db, const std::string& sql) { return db.query(sql).data.at(0).at(0); }
+
+const bulk::Options FAST{3, std::chrono::milliseconds(0)};
+
+}  // namespace
+
+TEST(bulkUpdateByKeysInChunks) {
+    sqlite::SQLiteDB db(":memory:");
+    fill(db, 10);
+    std::vector<std::pair<size_t, size_t>> calls;
+    std::atomic<bool> stop{false};
+    size_t changed = bulk::updateByKeys(db, "t", "id", range(1, 10), {{"v", "y"}}, {}, FAST,
+                                        [&](size_t done, size_t total) { calls.emplace_back(done, total); }, stop);
+    CHECK_EQ(changed, 10u);
+    CHECK_EQ(calls.size(), 4u);
+    CHECK_EQ(calls.back().first, 10u);
+    CHECK_EQ(calls.back().second, 10u);
+    CHECK_EQ(scalar(db, "SELECT count(*) FROM t WHERE v = 'y';"), "10");
+}
+
+TEST(bulkUpdateWhereSetsNull) {
+    sqlite::SQLiteDB db(":memory:");
+    fill(db, 10);
+    std::atomic<bool> stop{false};
+    size_t changed = bulk::updateWhere(db, "t", "id", "id > 4", {{"v", ""}}, {true}, FAST, nullptr, stop);
+    CHECK_EQ(changed, 6u);
+    CHECK_EQ(scalar(db, "SELECT count(*) FROM t WHERE v IS NULL;"), "6");
+    CHECK_EQ(scalar(db, "SELECT count(*) FROM t WHERE v = '';"), "0");
+}
+
+TEST(bulkRemoveWhereWalksKeys) {
+    sqlite::SQLiteDB db(":memory:");
+    fill(db, 20);
+    std::atomic<bool> stop{false};
+    size_t chunks = 0;
+    size_t changed = bulk::removeWhere(db, "t", "id", "id % 2 = 0", FAST, [&](size_t, size_t) { ++chunks; }, stop);
+    CHECK_EQ(changed, 10u);
+    CHECK_EQ(chunks, 4u);
+    CHECK_EQ(scalar(db, "SELECT count(*) FROM t;"), "10");
+}
+
+TEST(bulkStopsBeforeFirstChunk) {
+    sqlite::SQLiteDB db(":memory:");
+    fill(db, 5);
+    std::atomic<bool> stop{true};
+    CHECK_EQ(bulk::removeByKeys(db, "t", "id", range(1, 5), FAST, nullptr, stop), 0u);
+    CHECK_EQ(scalar(db, "SELECT count(*) FROM t;"), "5");
+}
+
+TEST(sqliteChangeRowsAboveVariableLimit) {
+    sqlite::SQLiteDB db(":memory:");
+    fill(db, 40000);
+    CHECK_EQ(db.updateRows("t", "id", range(1, 40000), {{"v", "z"}}, {}), 40000u);
+    CHECK_EQ(db.selectKeys("t", "id", range(39990, 40000), {"id"}).data.size(), 11u);
+}
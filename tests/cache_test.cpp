@@ -0,0 +1,190 @@
+#include <filesystem>
+#include <stdexcept>
+
+#include "../libs/musoci/cache.hpp"
+#include "../libs/musoci/sqlite.hpp"
+#include "check.hpp"
+
+namespace {
+
+types::TableData page(const std::string& value) {
+    types::TableData data("t", {types::Column("id", false, true, "INTEGER"), types::Column("v", true, false, "TEXT")}, {{"1", value}, {"2", ""}}, 0, 2);
+    data.rowKey = "id";
+    data.truncated[{0, 1}] = 100000;
+    data.nulls.emplace(1, 1);
+    data.hashes = {"a1", "b2"};
+    return data;
+}
+
+const types::TableData& decoded(const std::shared_ptr<const void>& value) { return *std::static_pointer_cast<const types::TableData>(value); }
+
+std::string encode(const types::TableData& data) {
+    std::string out;
+    cache::codecOf<types::TableData>().encode(&data, out);
+    return out;
+}
+
+// Кодек, запись которого в файле вытеснения не читается
+const cache::Codec& broken() {
+    static const cache::Codec codec{
+        cache::codecOf<types::TableData>().encode,
+        [](const char*, size_t) -> std::shared_ptr<const void> { throw std::runtime_error("Corrupted cache spill record"); },
+        cache::codecOf<types::TableData>().size,
+    };
+    return codec;
+}
+
+std::string temporaryDir(const char* name) {
+    std::filesystem::path dir = std::filesystem::temp_directory_path() / name;
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    return dir.string();
+}
+
+}  // namespace
+
+TEST(cacheCodecRoundTrip) {
+    types::TableData data = page(std::string(300, 'x'));
+    std::string encoded = encode(data);
+    auto value = cache::codecOf<types::TableData>().decode(encoded.data(), encoded.size());
+    const types::TableData& copy = decoded(value);
+    CHECK_EQ(copy.title, "t");
+    CHECK_EQ(copy.rowKey, "id");
+    CHECK_EQ(copy.columns.size(), 2u);
+    CHECK(copy.columns[0].primary_key);
+    CHECK(copy.columns[1].nullable);
+    CHECK(copy.data == data.data);
+    CHECK(copy.truncated == data.truncated);
+    CHECK(copy.nulls == data.nulls);
+    CHECK(copy.hashes == data.hashes);
+    CHECK_EQ(copy.count, 2);
+}
+
+TEST(cacheCodecRejectsCutRecord) {
+    std::string encoded = encode(page("value"));
+    for (size_t size : {size_t{0}, size_t{3}, encoded.size() / 2, encoded.size() - 1}) {
+        bool thrown = false;
+        try {
+            cache::codecOf<types::TableData>().decode(encoded.data(), size);
+        } catch (const std::exception&) {
+            thrown = true;
+        }
+        CHECK(thrown);
+    }
+}
+
+TEST(resultCacheSpillsAndFaultsBack) {
+    cache::ResultCache results(8192, 1 << 20, temporaryDir("aleto_test_spill"));
+    for (int i = 0; i < 20; ++i) {
+        results.store("1/" + std::to_string(i), std::make_shared<const types::TableData>(page(std::string(1000, 'a' + i))),
+                      cache::codecOf<types::TableData>());
+    }
+    cache::Stats before = results.stats();
+    CHECK(before.spills > 0);
+    CHECK(before.bytes <= 8192u);
+
+    auto value = results.find("1/0");
+    CHECK(value != nullptr);
+    if (value)
+        CHECK_EQ(decoded(value).data[0][1], std::string(1000, 'a'));
+    cache::Stats after = results.stats();
+    CHECK_EQ(after.faults, before.faults + 1);
+    CHECK_EQ(after.hits, before.hits + 1);
+
+    results.invalidate("1/");
+    CHECK(results.find("1/0") == nullptr);
+    CHECK_EQ(results.stats().spilledEntries, 0u);
+}
+
+TEST(resultCacheUnreadableSpillIsMiss) {
+    cache::ResultCache results(8192, 1 << 20, temporaryDir("aleto_test_spill"));
+    results.store("1/broken", std::make_shared<const types::TableData>(page(std::string(1000, 'b'))), broken());
+    for (int i = 0; i < 10; ++i) {
+        results.store("1/" + std::to_string(i), std::make_shared<const types::TableData>(page(std::string(1000, 'c'))),
+                      cache::codecOf<types::TableData>());
+    }
+    CHECK(results.stats().spills > 0);
+
+    uint64_t misses = results.stats().misses;
+    CHECK(results.find("1/broken") == nullptr);
+    cache::Stats stats = results.stats();
+    CHECK_EQ(stats.misses, misses + 1);
+    CHECK_EQ(stats.hits, 0u);
+    CHECK_EQ(stats.faults, 0u);
+    // Запись удалена, следующее обращение - обычный промах
+    CHECK(results.find("1/broken") == nullptr);
+    CHECK_EQ(results.stats().misses, misses + 2);
+}
+
+TEST(pageStoreKeepsValuesPerVersion) {
+    std::string dir = temporaryDir("aleto_test_pages");
+    const cache::Codec& codec = cache::codecOf<types::TableData>();
+    types::TableData data = page("stored");
+    {
+        cache::PageStore store(dir, 1 << 20);
+        store.store("pg://db", "public.t", "v1", "select", &data, codec);
+    }
+
+    cache::PageStore reopened(dir, 1 << 20);
+    auto found = reopened.find("pg://db", "public.t", "v1", "select", codec);
+    CHECK(found != nullptr);
+    if (found) {
+        CHECK_EQ(decoded(found).data[0][1], "stored");
+        CHECK(decoded(found).nulls == data.nulls);
+    }
+    CHECK(reopened.find("pg://db", "public.t", "v1", "seek", codec) == nullptr);
+    // Другая версия таблицы начинает файл заново
+    CHECK(reopened.find("pg://db", "public.t", "v2", "select", codec) == nullptr);
+    CHECK(reopened.find("pg://db", "public.t", "v1", "select", codec) == nullptr);
+    std::filesystem::remove_all(dir);
+}
+
+TEST(pageStoreSharedBetweenRuns) {
+    std::string dir = temporaryDir("aleto_test_shared_pages");
+    const cache::Codec& codec = cache::codecOf<types::TableData>();
+    types::TableData first = page("first"), second = page("second"), newer = page("newer");
+    // Два хранилища над одним каталогом - как два запуска: записи дописываются в конец файла, а не поверх чужих
+    cache::PageStore left(dir, 1 << 20), right(dir, 1 << 20);
+    left.store("pg://db", "public.t", "v1", "select", &first, codec);
+    right.store("pg://db", "public.t", "v1", "seek", &second, codec);
+    auto found = left.find("pg://db", "public.t", "v1", "select", codec);
+    CHECK(found != nullptr);
+    if (found)
+        CHECK_EQ(decoded(found).data[0][1], "first");
+    found = cache::PageStore(dir, 1 << 20).find("pg://db", "public.t", "v1", "seek", codec);
+    CHECK(found != nullptr);
+    if (found)
+        CHECK_EQ(decoded(found).data[0][1], "second");
+
+    // Другой запуск начал файл с новой версией и записал тот же ключ на то же место: старая запись не выдаётся
+    right.store("pg://db", "public.t", "v2", "select", &newer, codec);
+    CHECK(left.find("pg://db", "public.t", "v1", "select", codec) == nullptr);
+    found = right.find("pg://db", "public.t", "v2", "select", codec);
+    CHECK(found != nullptr);
+    if (found)
+        CHECK_EQ(decoded(found).data[0][1], "newer");
+    std::filesystem::remove_all(dir);
+}
+
+TEST(cachedDatabaseRechecksVersionByInterval) {
+    std::string dir = temporaryDir("aleto_test_recheck");
+    std::string path = dir + "/db.sqlite";
+    auto results = std::make_shared<cache::ResultCache>(1 << 20, 0);
+    cache::CachedDatabase db(std::make_unique<sqlite::SQLiteDB>(path), results, nullptr, std::chrono::hours(1));
+    db.executeQuery("CREATE TABLE t(id INTEGER PRIMARY KEY, v TEXT);");
+    db.executeQuery("INSERT INTO t VALUES (1, 'a');");
+    CHECK_EQ(db.select("t", 0, 10, {}).data.size(), 1u);
+
+    // Изменение другим подключением в пределах recheck не видно, после expire - видно
+    sqlite::SQLiteDB other(path);
+    other.executeQuery("INSERT INTO t VALUES (2, 'b');");
+    CHECK_EQ(db.select("t", 0, 10, {}).data.size(), 1u);
+    db.expire();
+    CHECK_EQ(db.select("t", 0, 10, {}).data.size(), 2u);
+
+    // Изменение через копию сверяется сразу
+    auto copy = db.clone();
+    copy->addRow("t", {{"id", "3"}, {"v", "c"}});
+    CHECK_EQ(db.select("t", 0, 10, {}).data.size(), 3u);
+    std::filesystem::remove_all(dir);
+}
@@ -0,0 +1,61 @@
+#include "../libs/musoci/catalog.hpp"
+#include "../libs/musoci/sqlite.hpp"
+#include "check.hpp"
+
+TEST(catalogVersionFollowsSchema) {
+    sqlite::SQLiteDB db(":memory:");
+    std::string before = catalog::version(db);
+    CHECK(!before.empty());
+    db.executeQuery("CREATE TABLE t(id INTEGER PRIMARY KEY);");
+    std::string after = catalog::version(db);
+    CHECK(after != before);
+    db.executeQuery("INSERT INTO t VALUES (1);");
+    CHECK_EQ(catalog::version(db), after);
+    // Данные отдельных таблиц SQLite не версионируются, поэтому страницы на диск не сохраняются
+    CHECK(db.tableVersions().empty());
+}
+
+TEST(catalogFetchSurvivesUnwritableStore) {
+    sqlite::SQLiteDB db(":memory:");
+    db.executeQuery("CREATE TABLE t(id INTEGER PRIMARY KEY);");
+    // Каталог внутри обычного файла создать нельзя, запись списка падает
+    catalog::Store store("/dev/null/catalog");
+    std::vector<std::string> tables = catalog::fetch(db, &store);
+    CHECK_EQ(tables.size(), 1u);
+    CHECK_EQ(tables[0], "t");
+}
+
+namespace {
+
+const std::vector<std::string> NAMES{"public_log", "sales.orders", "audit.records", "sales.order_items"};
+
+}  // namespace
+
+TEST(nameIndexEmptyQueryKeepsOrder) {
+    catalog::NameIndex index(NAMES);
+    CHECK_EQ(index.size(), 4u);
+    std::vector<size_t> all{0, 1, 2, 3};
+    CHECK(index.filter("") == all);
+}
+
+TEST(nameIndexRanksWordStartsAndSubstrings) {
+    catalog::NameIndex index(NAMES);
+    // Подстрока в начале слова выше разбросанных символов, при равной оценке короткое название выше
+    std::vector<size_t> expected{1, 3, 2};
+    CHECK(index.filter("ORD") == expected);
+    std::vector<size_t> sales{1, 3};
+    CHECK(index.filter("sal.ord") == sales);
+    CHECK(index.filter("xyz").empty());
+}
+
+TEST(nameIndexNarrowingMatchesFreshFilter) {
+    catalog::NameIndex typed(NAMES);
+    typed.filter("o");
+    typed.filter("or");
+    std::vector<size_t> narrowed = typed.filter("ore");
+    catalog::NameIndex fresh(NAMES);
+    CHECK(narrowed == fresh.filter("ore"));
+    // Стёртый символ - снова поиск по всем названиям
+    CHECK(typed.filter("l") == fresh.filter("l"));
+    CHECK_EQ(typed.filter("l").size(), 3u);
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Минимальный набор для модульных тестов musoci: TEST регистрирует функцию, CHECK считает неудачи
+namespace check {
+
+struct Case {
+    const char* name;
+    std::function<void()> run;
+};
+
+inline std::vector<Case>& cases() {
+    static std::vector<Case> all;
+    return all;
+}
+
+inline int& failures() {
+    static int count = 0;
+    return count;
+}
+
+struct Registrar {
+    Registrar(const char* name, std::function<void()> run) { cases().push_back({name, std::move(run)}); }
+};
+
+inline void fail(const char* file, int line, const std::string& text) {
+    ++failures();
+    std::cerr << file << ":" << line << ": " << text << "\n";
+}
+
+}  // namespace check
+
+#define CHECK_CONCAT_(a, b) a##b
+#define CHECK_CONCAT(a, b) CHECK_CONCAT_(a, b)
+
+#define TEST(name)                                                      \
+    static void name();                                                 \
+    static check::Registrar CHECK_CONCAT(name, _registrar)(#name, &name); \
+    static void name()
+
+#define CHECK(expr)                                              \
+    do {                                                         \
+        if (!(expr))                                             \
+            check::fail(__FILE__, __LINE__, "CHECK(" #expr ")"); \
+    } while (false)
+
+#define CHECK_EQ(a, b)                                                   \
+    do {                                                                 \
+        if (!((a) == (b)))                                               \
+            check::fail(__FILE__, __LINE__, "CHECK_EQ(" #a ", " #b ")"); \
+    } while (false)
@@ -0,0 +1,126 @@
+#include "../libs/musoci/diff.hpp"
+#include "../libs/musoci/sqlite.hpp"
+#include "check.hpp"
+
+namespace {
+
+// Таблица t(id, v) со строками 1..count, v = 'x' || id
+void fill(sqlite::SQLiteDB& db, int count) {
+    db.executeQuery("CREATE TABLE t(id INTEGER PRIMARY KEY, v TEXT);");
+    db.executeQuery("WITH RECURSIVE n(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM n WHERE i < " + std::to_string(count) +
+                    ") INSERT INTO t SELECT i, 'x' || i FROM n;");
+}
+
+std::string scalar(sqlite::SQLiteDB& db, const std::string& sql) { return db.query(sql).data.at(0).at(0); }
+
+struct Found {
+    diff::Change change;
+    diff::Row left;
+    diff::Row right;
+};
+
+diff::Report compare(sqlite::SQLiteDB& left, sqlite::SQLiteDB& right, std::vector<Found>& found) {
+    diff::Options options;
+    options.chunkRows = 1000;
+    options.leafRows = 50;
+    std::atomic<bool> stop{false};
+    return diff::compareTables(
+        left, right, "t", "t", options, [&found](diff::Change change, const diff::Row& l, const diff::Row& r) { found.push_back({change, l, r}); },
+        nullptr, stop);
+}
+
+}  // namespace
+
+TEST(diffEqualTablesComparedByHashes) {
+    sqlite::SQLiteDB left(":memory:"), right(":memory:");
+    fill(left, 5000);
+    fill(right, 5000);
+    std::vector<Found> found;
+    diff::Report report = compare(left, right, found);
+    CHECK_EQ(report.differences(), 0u);
+    CHECK_EQ(report.fetched, 0u);
+    CHECK_EQ(report.chunks, 5u);
+    CHECK(found.empty());
+}
+
+TEST(diffNarrowsToChangedRows) {
+    sqlite::SQLiteDB left(":memory:"), right(":memory:");
+    fill(left, 5000);
+    fill(right, 5000);
+    left.executeQuery("DELETE FROM t WHERE id = 1200;");
+    right.executeQuery("INSERT INTO t VALUES (6000, 'y');");
+    right.executeQuery("UPDATE t SET v = 'z' WHERE id = 3333;");
+    std::vector<Found> found;
+    diff::Report report = compare(left, right, found);
+    CHECK_EQ(report.missing, 0u);
+    CHECK_EQ(report.extra, 2u);
+    CHECK_EQ(report.changed, 1u);
+    // Сравниваются только листья с отличиями, а не куски целиком
+    CHECK(report.fetched < 500u);
+    CHECK_EQ(found.size(), 3u);
+    CHECK_EQ(found[0].right.values.at(0), "1200");
+    CHECK_EQ(found[1].left.values.at(1), "x3333");
+    CHECK_EQ(found[1].right.values.at(1), "z");
+    CHECK_EQ(found[2].right.values.at(0), "6000");
+}
+
+TEST(diffKeepsNullApartFromText) {
+    sqlite::SQLiteDB left(":memory:"), right(":memory:");
+    fill(left, 10);
+    fill(right, 10);
+    left.executeQuery("UPDATE t SET v = NULL WHERE id = 4;");
+    right.executeQuery("UPDATE t SET v = 'NULL' WHERE id = 4;");
+    std::vector<Found> found;
+    diff::Report report = compare(left, right, found);
+    CHECK_EQ(report.changed, 1u);
+    CHECK_EQ(found.size(), 1u);
+    CHECK(found[0].left.nulls.at(1));
+    CHECK(!found[0].right.nulls.at(1));
+    CHECK_EQ(found[0].right.values.at(1), "NULL");
+}
+
+TEST(sqliteExactSumBeyondInt64) {
+    sqlite::SQLiteDB db(":memory:");
+    db.executeQuery("CREATE TABLE n(x INTEGER);");
+    db.executeQuery("INSERT INTO n VALUES (9223372036854775807), (9223372036854775807), (2);");
+    CHECK_EQ(scalar(db, "SELECT aleto_sum(x) FROM n;"), "18446744073709551616");
+    db.executeQuery("DELETE FROM n;");
+    db.executeQuery("INSERT INTO n VALUES (-9223372036854775808), (-9223372036854775808), (-1);");
+    CHECK_EQ(scalar(db, "SELECT aleto_sum(x) FROM n;"), "-18446744073709551617");
+    db.executeQuery("INSERT INTO n VALUES (9223372036854775807), (9223372036854775807), (3);");
+    CHECK_EQ(scalar(db, "SELECT aleto_sum(x) FROM n;"), "0");
+}
+
+TEST(diffQuotesTableAndColumnNames) {
+    sqlite::SQLiteDB left(":memory:"), right(":memory:");
+    for (auto* db : {&left, &right}) {
+        db->executeQuery("CREATE TABLE \"my \"\"t\"\"\"(\"order\" INTEGER PRIMARY KEY, \"group\" TEXT);");
+        db->executeQuery("INSERT INTO \"my \"\"t\"\"\" VALUES (1, 'a'), (2, 'b'), (3, 'c');");
+    }
+    right.executeQuery("UPDATE \"my \"\"t\"\"\" SET \"group\" = 'z' WHERE \"order\" = 2;");
+    std::vector<Found> found;
+    std::atomic<bool> stop{false};
+    diff::Report report = diff::compareTables(
+        left, right, "my \"t\"", "my \"t\"", diff::Options{},
+        [&found](diff::Change change, const diff::Row& l, const diff::Row& r) { found.push_back({change, l, r}); }, nullptr, stop);
+    CHECK_EQ(report.changed, 1u);
+    CHECK_EQ(found.size(), 1u);
+    CHECK_EQ(found[0].right.values.at(1), "z");
+    CHECK_EQ(left.seek("my \"t\"", "order", "2", false, 0, 10, {"group"}, false).data.at(0).at(0), "c");
+}
+
+TEST(diffStoppedReportsInterrupted) {
+    sqlite::SQLiteDB left(":memory:"), right(":memory:");
+    fill(left, 5000);
+    fill(right, 10);
+    diff::Options options;
+    options.chunkRows = 1000;
+    std::atomic<bool> stop{false};
+    size_t visits = 0;
+    diff::Report report = diff::compareTables(
+        left, right, "t", "t", options, [&visits](diff::Change, const diff::Row&, const diff::Row&) { ++visits; },
+        [&stop](size_t done, size_t) { stop = done == 2; }, stop);
+    CHECK(report.interrupted);
+    CHECK_EQ(report.missing, 1990u);
+    CHECK_EQ(visits, 1990u);
+}
@@ -0,0 +1,16 @@
+#include <exception>
+
+#include "check.hpp"
+
+int main() {
+    for (const auto& test : check::cases()) {
+        int before = check::failures();
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            check::fail(test.name, 0, std::string("exception: ") + e.what());
+        }
+        std::cout << (check::failures() == before ? "ok   " : "FAIL ") << test.name << "\n";
+    }
+    return check::failures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,72 @@
+#include <filesystem>
+
+#include "../libs/musoci/paging.hpp"
+#include "check.hpp"
+
+namespace {
+
+paging::AnchorIndex anchors(int count, int step) {
+    paging::AnchorIndex index{"t", "id", step};
+    for (int i = 0; i < count; ++i) {
+        index.append(std::to_string(i * step + 1));
+    }
+    return index;
+}
+
+}  // namespace
+
+TEST(anchorLocateWithinIndex) {
+    paging::AnchorIndex index = anchors(5, 100);
+    std::string anchor;
+    int rest = -1;
+    CHECK(index.locate(0, anchor, rest));
+    CHECK_EQ(anchor, "1");
+    CHECK_EQ(rest, 0);
+    CHECK(index.locate(250, anchor, rest));
+    CHECK_EQ(anchor, "201");
+    CHECK_EQ(rest, 50);
+    CHECK(index.locate(399, anchor, rest));
+    CHECK_EQ(anchor, "301");
+    CHECK_EQ(rest, 99);
+}
+
+TEST(anchorLocatePastLastAnchor) {
+    paging::AnchorIndex index = anchors(3, 10);
+    std::string anchor;
+    int rest = 0;
+    CHECK(index.locate(95, anchor, rest));
+    CHECK_EQ(anchor, "21");
+    CHECK_EQ(rest, 75);
+    CHECK(!index.locate(-1, anchor, rest));
+    paging::AnchorIndex empty("t", "id", 10);
+    CHECK(!empty.locate(0, anchor, rest));
+    CHECK_EQ(index.approxRows(), 30);
+}
+
+TEST(anchorSaveLoadKeepsVersion) {
+    paging::AnchorIndex index = anchors(4, 7);
+    index.version = "42:1:2:3";
+    std::string path = (std::filesystem::temp_directory_path() / "aleto_test.anchors").string();
+    CHECK(index.save(path));
+
+    paging::AnchorIndex loaded{"t", "id", 7};
+    CHECK(loaded.load(path));
+    CHECK_EQ(loaded.size(), index.size());
+    CHECK_EQ(loaded.at(3), "22");
+    CHECK_EQ(loaded.version, "42:1:2:3");
+
+    // Другой шаг или таблица - другой индекс
+    paging::AnchorIndex other{"t", "id", 8};
+    CHECK(!other.load(path));
+    std::filesystem::remove(path);
+}
+
+TEST(pageSizerClampsBeforeCast) {
+    paging::PageSizer sizer(50, 0, 50, 20000, 1000);
+    CHECK_EQ(sizer.rowsFor("t"), 1000);
+    // Почти нулевое время на строку даёт число строк за пределами int
+    sizer.record("t", 1000, 0, 1e-300);
+    CHECK_EQ(sizer.rowsFor("t"), 20000);
+    sizer.record("slow", 10, 0, 1e6);
+    CHECK_EQ(sizer.rowsFor("slow"), 50);
+}